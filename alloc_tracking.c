@@ -0,0 +1,134 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>       //
+//                                                                            //
+//  This file is part of Signal-IO-NIXNET.                                    //
+//                                                                            //
+//  Signal-IO-NIXNETs free software: you can redistribute it and/or modify    //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,       //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.  //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Link with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free:
+// every allocation made by the plug-in code goes through the counters below
+
+#ifndef ALLOCATION_TRACKING
+  #define ALLOCATION_TRACKING
+#endif
+#include "alloc_tracking.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+void* __real_malloc( size_t );
+void* __real_calloc( size_t, size_t );
+void* __real_realloc( void*, size_t );
+void __real_free( void* );
+
+typedef struct _AllocationCounters
+{
+  size_t allocationsCount, allocatedBytes, freesCount;
+}
+AllocationCounters;
+
+static AllocationCounters countersList[ ALLOCATION_PHASES_NUMBER ];
+static __thread int currentPhase = ALLOCATION_PHASE_INIT;   // Per thread, as e.g. a cycle thread may run while host one loads tasks
+static bool isStrict = false;
+
+static void CountAllocation( size_t size )
+{
+  int phase = currentPhase;
+  
+  __atomic_add_fetch( &(countersList[ phase ].allocationsCount), 1, __ATOMIC_RELAXED );
+  __atomic_add_fetch( &(countersList[ phase ].allocatedBytes), size, __ATOMIC_RELAXED );
+  
+  if( isStrict && phase == ALLOCATION_PHASE_CYCLE )
+  {
+    // No stdio here: it could allocate
+    static const char message[] = "heap allocation during steady state cycle\n";
+    (void) !write( STDERR_FILENO, message, sizeof(message) - 1 );
+    abort();
+  }
+}
+
+void* __wrap_malloc( size_t size )
+{
+  CountAllocation( size );
+  return __real_malloc( size );
+}
+
+void* __wrap_calloc( size_t elementsNumber, size_t size )
+{
+  CountAllocation( elementsNumber * size );
+  return __real_calloc( elementsNumber, size );
+}
+
+void* __wrap_realloc( void* pointer, size_t size )
+{
+  CountAllocation( size );
+  return __real_realloc( pointer, size );
+}
+
+void __wrap_free( void* pointer )
+{
+  if( pointer != NULL )
+  {
+    int phase = currentPhase;
+    __atomic_add_fetch( &(countersList[ phase ].freesCount), 1, __ATOMIC_RELAXED );
+  }
+  
+  __real_free( pointer );
+}
+
+void AllocTracking_SetPhase( enum AllocationPhase phase )
+{
+  if( phase < ALLOCATION_PHASES_NUMBER ) currentPhase = (int) phase;
+}
+
+size_t AllocTracking_GetAllocationsCount( enum AllocationPhase phase )
+{
+  return ( phase < ALLOCATION_PHASES_NUMBER ) ? __atomic_load_n( &(countersList[ phase ].allocationsCount), __ATOMIC_RELAXED ) : 0;
+}
+
+size_t AllocTracking_GetAllocatedBytes( enum AllocationPhase phase )
+{
+  return ( phase < ALLOCATION_PHASES_NUMBER ) ? __atomic_load_n( &(countersList[ phase ].allocatedBytes), __ATOMIC_RELAXED ) : 0;
+}
+
+size_t AllocTracking_GetFreesCount( enum AllocationPhase phase )
+{
+  return ( phase < ALLOCATION_PHASES_NUMBER ) ? __atomic_load_n( &(countersList[ phase ].freesCount), __ATOMIC_RELAXED ) : 0;
+}
+
+void AllocTracking_SetStrict( bool enable )
+{
+  isStrict = enable;
+}
+
+static void PrintReport( void )
+{
+  const char* PHASE_NAMES[ ALLOCATION_PHASES_NUMBER ] = { "init", "cycle", "shutdown" };
+  
+  for( int phase = 0; phase < ALLOCATION_PHASES_NUMBER; phase++ )
+    fprintf( stderr, "allocations (%s): %zu (%zu bytes), frees: %zu\n", PHASE_NAMES[ phase ], 
+             countersList[ phase ].allocationsCount, countersList[ phase ].allocatedBytes, countersList[ phase ].freesCount );
+}
+
+// Strict mode and exit report enabled from environment, so that test runs need no code changes
+__attribute__((constructor)) static void LoadConfiguration( void )
+{
+  if( getenv( "ALLOCATION_TRACKING_STRICT" ) != NULL ) isStrict = true;
+  if( getenv( "ALLOCATION_TRACKING_REPORT" ) != NULL ) atexit( PrintReport );
+}
@@ -0,0 +1,51 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>       //
+//                                                                            //
+//  This file is part of Signal-IO-NIXNET.                                    //
+//                                                                            //
+//  Signal-IO-NIXNETs free software: you can redistribute it and/or modify    //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,       //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.  //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Heap allocations counting by execution phase (ALLOCATION_TRACKING builds),
+// with malloc/calloc/realloc/free wrapped at link time (see alloc_tracking.c)
+
+#ifndef ALLOC_TRACKING_H
+#define ALLOC_TRACKING_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+enum AllocationPhase { ALLOCATION_PHASE_INIT, ALLOCATION_PHASE_CYCLE, ALLOCATION_PHASE_SHUTDOWN, ALLOCATION_PHASES_NUMBER };
+
+#ifdef ALLOCATION_TRACKING
+
+void AllocTracking_SetPhase( enum AllocationPhase );
+size_t AllocTracking_GetAllocationsCount( enum AllocationPhase );
+size_t AllocTracking_GetAllocatedBytes( enum AllocationPhase );
+size_t AllocTracking_GetFreesCount( enum AllocationPhase );
+// Abort on any allocation during steady state cycle phase
+void AllocTracking_SetStrict( bool );
+
+#define ALLOCATION_PHASE( phase ) AllocTracking_SetPhase( ALLOCATION_PHASE_##phase )
+
+#else
+
+#define ALLOCATION_PHASE( phase )
+
+#endif
+
+#endif // ALLOC_TRACKING_H
@@ -0,0 +1,106 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>       //
+//                                                                            //
+//  This file is part of Signal-IO-NIXNET.                                    //
+//                                                                            //
+//  Signal-IO-NIXNETs free software: you can redistribute it and/or modify    //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,       //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.  //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Input wait benchmark: time spent on the measures reads of a control loop cycle (right after SYNC, while the nodes'
+// TPDOs are still coming), host processor time it takes and stale samples, for each input (TPDO) wait strategy.
+// Waits are bounded by the cycle period. Usage: benchmark_input_wait [<cycles number> [<nodes number> ...]]
+
+#include "ni_can_epos.c"
+
+#include "benchmark_stub.h"
+
+#define DEFAULT_CYCLES_NUMBER 1000
+#define OUTPUT_CHANNEL 0              // Position setpoint, on RPDO1
+
+static unsigned long cyclesNumber = DEFAULT_CYCLES_NUMBER;
+static enum CANInputWait inputWaitStrategy = CAN_INPUT_WAIT_NONE;
+
+bool RunInputWait( size_t nodesNumber )
+{
+  unsigned long period = BenchmarkStub_GetCyclePeriod( nodesNumber );
+  
+  CANNetwork_SetInputWait( inputWaitStrategy, CAN_INPUT_SPIN_TIME, period / 1000.0 );
+  
+  if( !BenchmarkStub_InitNodes( nodesNumber, NULL, OUTPUT_CHANNEL ) ) return false;
+  if( BenchmarkStub_EnableNodes( nodesNumber, OUTPUT_CHANNEL, period ) < 0.0 )
+  {
+    fprintf( stderr, "%u nodes not enabled after %g s\n", (unsigned int) nodesNumber, BENCHMARK_STARTUP_TIMEOUT );
+    return false;
+  }
+  
+  SignalIOStatistics initialStatistics = SIGNAL_IO_STATISTICS_INIT, statistics = SIGNAL_IO_STATISTICS_INIT;
+  GetBusStatistics( &initialStatistics );
+  
+  // Control loop reading measures right after the cycle SYNC (sent once all setpoints are written), then waiting for the next cycle
+  double readTime = 0.0, readCPUTime = 0.0, measure;
+  for( unsigned long cycleIndex = 0; cycleIndex < cyclesNumber; cycleIndex++ )
+  {
+    double cycleStartTime = Time_GetExecSeconds();
+    
+    for( size_t nodeID = 1; nodeID <= nodesNumber; nodeID++ )
+      Write( benchmarkTasksList[ nodeID ], OUTPUT_CHANNEL, (double) cycleIndex );
+    
+    double readStartTime = Time_GetExecSeconds();
+    double readStartCPUTime = BenchmarkStub_GetCPUTime();
+    for( size_t nodeID = 1; nodeID <= nodesNumber; nodeID++ )
+      Read( benchmarkTasksList[ nodeID ], 0, &measure );
+    readCPUTime += BenchmarkStub_GetCPUTime() - readStartCPUTime;
+    readTime += Time_GetExecSeconds() - readStartTime;
+    
+    unsigned long cycleTime = (unsigned long) ( ( Time_GetExecSeconds() - cycleStartTime ) * 1000.0 );
+    if( cycleTime < period ) Time_Delay( period - cycleTime );
+  }
+  
+  GetBusStatistics( &statistics );
+  
+  printf( "%8s %5u %6lu %10.1f %10.1f %10.1f %8lu\n", CAN_INPUT_WAIT_NAMES[ inputWaitStrategy ], (unsigned int) nodesNumber, period,
+          readTime / cyclesNumber * 1.0e6, readCPUTime / cyclesNumber * 1.0e6, statistics.averageResponseTime * 1.0e6,
+          statistics.staleSamplesCount - initialStatistics.staleSamplesCount );
+  
+  BenchmarkStub_EndNodes( nodesNumber );
+  
+  return true;
+}
+
+int main( int argc, char** argv )
+{
+  if( argc > 1 ) cyclesNumber = strtoul( argv[ 1 ], NULL, 0 );
+  if( cyclesNumber == 0 ) cyclesNumber = DEFAULT_CYCLES_NUMBER;
+  
+  size_t nodeCountsList[ BENCHMARK_NODES_MAX ];
+  size_t countsNumber = BenchmarkStub_GetNodeCounts( argc, argv, 2, nodeCountsList, BENCHMARK_NODES_MAX );
+  
+  printf( "%lu cycles per run (read time in virtual us, host processor time in us, latency in us)\n", cyclesNumber );
+  printf( "%8s %5s %6s %10s %10s %10s %8s\n", "wait", "nodes", "period", "readTime", "readCPU", "avgSync2Rx", "stale" );
+  
+  bool isSuccessful = true;
+  for( size_t countIndex = 0; countIndex < countsNumber; countIndex++ )
+  {
+    for( int waitIndex = 0; waitIndex < CAN_INPUT_WAITS_NUMBER; waitIndex++ )
+    {
+      inputWaitStrategy = (enum CANInputWait) waitIndex;
+      if( !BenchmarkStub_RunIsolated( RunInputWait, nodeCountsList[ countIndex ] ) ) isSuccessful = false;
+    }
+  }
+  
+  return isSuccessful ? EXIT_SUCCESS : EXIT_FAILURE;
+}
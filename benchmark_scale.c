@@ -0,0 +1,95 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>       //
+//                                                                            //
+//  This file is part of Signal-IO-NIXNET.                                    //
+//                                                                            //
+//  Signal-IO-NIXNETs free software: you can redistribute it and/or modify    //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,       //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.  //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Scale benchmark: startup time, host processor time and heap usage per network cycle, and SYNC to TPDO
+// response latency, for growing numbers of (simulated) nodes up to the full CANopen network (127 nodes).
+// Usage: benchmark_scale [<cycles number> [<nodes number> ...]]
+
+#include "ni_can_epos.c"
+
+#include "benchmark_stub.h"
+
+#define DEFAULT_CYCLES_NUMBER 1000
+#define OUTPUT_CHANNEL 0              // Position setpoint, on RPDO1
+
+static unsigned long cyclesNumber = DEFAULT_CYCLES_NUMBER;
+
+bool RunScale( size_t nodesNumber )
+{
+  unsigned long period = BenchmarkStub_GetCyclePeriod( nodesNumber );
+  
+  size_t initialHeapSize = BenchmarkStub_GetHeapSize();
+  double initialCPUTime = BenchmarkStub_GetCPUTime();
+  
+  if( !BenchmarkStub_InitNodes( nodesNumber, NULL, OUTPUT_CHANNEL ) ) return false;
+  double startupTime = BenchmarkStub_EnableNodes( nodesNumber, OUTPUT_CHANNEL, period );
+  if( startupTime < 0.0 )
+  {
+    fprintf( stderr, "%u nodes not enabled after %g s\n", (unsigned int) nodesNumber, BENCHMARK_STARTUP_TIMEOUT );
+    return false;
+  }
+  
+  double startupCPUTime = BenchmarkStub_GetCPUTime() - initialCPUTime;
+  size_t heapSize = BenchmarkStub_GetHeapSize() - initialHeapSize;
+  
+  SignalIOStatistics initialStatistics = SIGNAL_IO_STATISTICS_INIT, statistics = SIGNAL_IO_STATISTICS_INIT;
+  GetBusStatistics( &initialStatistics );
+  
+  double cyclesStartTime = BenchmarkStub_GetCPUTime();
+  for( unsigned long cycleIndex = 0; cycleIndex < cyclesNumber; cycleIndex++ )
+    BenchmarkStub_RunCycle( nodesNumber, OUTPUT_CHANNEL, (double) cycleIndex, period );
+  double cycleCPUTime = ( BenchmarkStub_GetCPUTime() - cyclesStartTime ) / cyclesNumber;
+  
+  GetBusStatistics( &statistics );
+  nxStubBusStats_t busStatistics;
+  nxStub_GetBusStats( &busStatistics );
+  
+  printf( "%5u %6lu %10.3f %10.3f %10.2f %10.1f %10.1f %10.1f %10.1f %8.1f %8lu\n", (unsigned int) nodesNumber, period,
+          startupTime, startupCPUTime * 1000.0, cycleCPUTime * 1.0e6, heapSize / 1024.0, 
+          statistics.minResponseTime * 1.0e6, statistics.averageResponseTime * 1.0e6, statistics.maxResponseTime * 1.0e6,
+          100.0 * busStatistics.BusyTime / busStatistics.ElapsedTime, statistics.staleSamplesCount - initialStatistics.staleSamplesCount );
+  
+  BenchmarkStub_EndNodes( nodesNumber );
+  
+  return true;
+}
+
+int main( int argc, char** argv )
+{
+  if( argc > 1 ) cyclesNumber = strtoul( argv[ 1 ], NULL, 0 );
+  if( cyclesNumber == 0 ) cyclesNumber = DEFAULT_CYCLES_NUMBER;
+  
+  size_t nodeCountsList[ BENCHMARK_NODES_MAX ];
+  size_t countsNumber = BenchmarkStub_GetNodeCounts( argc, argv, 2, nodeCountsList, BENCHMARK_NODES_MAX );
+  
+  printf( "%lu cycles per run (startup time in virtual seconds, host processor time in ms and us, latency in us)\n", cyclesNumber );
+  printf( "%5s %6s %10s %10s %10s %10s %10s %10s %10s %8s %8s\n", "nodes", "period", "startup", "startupCPU", "cycleCPU", 
+          "heap(KiB)", "minSync2Rx", "avgSync2Rx", "maxSync2Rx", "load(%)", "stale" );
+  
+  bool isSuccessful = true;
+  for( size_t countIndex = 0; countIndex < countsNumber; countIndex++ )
+  {
+    if( !BenchmarkStub_RunIsolated( RunScale, nodeCountsList[ countIndex ] ) ) isSuccessful = false;
+  }
+  
+  return isSuccessful ? EXIT_SUCCESS : EXIT_FAILURE;
+}
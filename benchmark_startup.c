@@ -0,0 +1,111 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>       //
+//                                                                            //
+//  This file is part of Signal-IO-NIXNET.                                    //
+//                                                                            //
+//  Signal-IO-NIXNETs free software: you can redistribute it and/or modify    //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,       //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.  //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Startup benchmark: time from first session creation until all (simulated) nodes reach Operation Enabled state
+// (with their configuration commands done),
+// split into startup profile phases (summed over nodes, and slowest node), for growing numbers of nodes.
+// Usage: benchmark_startup [-v] [-c "<task configuration suffix>"] [<nodes number> ...]
+// (-v prints per node breakdown, -c appends e.g. rate divisors or PDO mapping tokens to every node ID)
+
+#include "ni_can_epos.c"
+
+#include "benchmark_stub.h"
+
+#include <string.h>
+
+#define OUTPUT_CHANNEL 0              // Position setpoint, on RPDO1
+
+static bool isVerbose = false;
+static const char* configSuffix = NULL;
+
+bool RunStartup( size_t nodesNumber )
+{
+  unsigned long period = BenchmarkStub_GetCyclePeriod( nodesNumber );
+  
+  double startTime = Time_GetExecSeconds();
+  if( !BenchmarkStub_InitNodes( nodesNumber, configSuffix, OUTPUT_CHANNEL ) ) return false;
+  double loadTime = Time_GetExecSeconds() - startTime;
+  
+  if( BenchmarkStub_EnableNodes( nodesNumber, OUTPUT_CHANNEL, period ) < 0.0 )
+  {
+    fprintf( stderr, "%u nodes not enabled after %g s\n", (unsigned int) nodesNumber, BENCHMARK_STARTUP_TIMEOUT );
+    return false;
+  }
+  double startupTime = Time_GetExecSeconds() - startTime;
+  
+  // Node 0 accounts for network wide phases
+  double phaseTotalsList[ STARTUP_PHASES_NUMBER ] = { 0.0 }, phaseMaximaList[ STARTUP_PHASES_NUMBER ] = { 0.0 };
+  for( int phase = 0; phase < STARTUP_PHASES_NUMBER; phase++ )
+  {
+    for( size_t nodeID = 0; nodeID <= nodesNumber; nodeID++ )
+    {
+      double phaseTime = startupTimesList[ phase ][ nodeID ];
+      phaseTotalsList[ phase ] += phaseTime;
+      if( phaseTime > phaseMaximaList[ phase ] ) phaseMaximaList[ phase ] = phaseTime;
+    }
+  }
+  
+  printf( "%5u %6lu %9.3f %9.3f", (unsigned int) nodesNumber, period, startupTime, loadTime );
+  for( int phase = 0; phase < STARTUP_PHASES_NUMBER; phase++ )
+    printf( " %9.3f %9.3f", phaseTotalsList[ phase ], phaseMaximaList[ phase ] );
+  printf( "\n" );
+  
+  if( isVerbose )
+  {
+    fflush( stdout );
+    StartupProfile_Print();
+  }
+  
+  BenchmarkStub_EndNodes( nodesNumber );
+  
+  return true;
+}
+
+int main( int argc, char** argv )
+{
+  int argumentIndex = 1;
+  for( ; argumentIndex < argc && argv[ argumentIndex ][ 0 ] == '-'; argumentIndex++ )
+  {
+    if( strcmp( argv[ argumentIndex ], "-v" ) == 0 ) isVerbose = true;
+    else if( strcmp( argv[ argumentIndex ], "-c" ) == 0 && argumentIndex + 1 < argc ) configSuffix = argv[ ++argumentIndex ];
+  }
+  
+  size_t nodeCountsList[ BENCHMARK_NODES_MAX ];
+  size_t countsNumber = BenchmarkStub_GetNodeCounts( argc, argv, argumentIndex, nodeCountsList, BENCHMARK_NODES_MAX );
+  
+  printf( "startup until Operation Enabled (virtual seconds; phase times as sum over nodes / slowest node)\n" );
+  printf( "%5s %6s %9s %9s", "nodes", "period", "total", "loading" );
+  for( int phase = 0; phase < STARTUP_PHASES_NUMBER; phase++ )
+    printf( " %19.19s", STARTUP_PHASE_NAMES[ phase ] );
+  printf( "\n%32s", "" );
+  for( int phase = 0; phase < STARTUP_PHASES_NUMBER; phase++ )
+    printf( " %9s %9s", "sum", "max" );
+  printf( "\n" );
+  
+  bool isSuccessful = true;
+  for( size_t countIndex = 0; countIndex < countsNumber; countIndex++ )
+  {
+    if( !BenchmarkStub_RunIsolated( RunStartup, nodeCountsList[ countIndex ] ) ) isSuccessful = false;
+  }
+  
+  return isSuccessful ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,176 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>       //
+//                                                                            //
+//  This file is part of Signal-IO-NIXNET.                                    //
+//                                                                            //
+//  Signal-IO-NIXNETs free software: you can redistribute it and/or modify    //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,       //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.  //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Helpers for benchmarks driving the plug-in (built in, by including ni_can_epos.c before this file)
+// against simulated drives of the NI-XNET stub, on virtual time (NIXNET_STUB_VIRTUAL_TIME and timing_virtual.c),
+// so that results don't depend on host load. Every run goes on a child process, starting from clean plug-in
+// and bus states
+
+#ifndef BENCHMARK_STUB_H
+#define BENCHMARK_STUB_H
+
+#ifndef NIXNET_STUB_VIRTUAL_TIME
+  #error "benchmarks require NI-XNET stub on virtual time (NIXNET_STUB_VIRTUAL_TIME)"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#ifdef __GLIBC__
+  #include <malloc.h>
+#endif
+
+#define BENCHMARK_NODES_MAX 127
+#define BENCHMARK_STARTUP_TIMEOUT 120.0      // Virtual seconds for all nodes to reach Operation Enabled state
+#define BENCHMARK_FRAME_BITS 130             // 8 bytes data frame, with worst case bit stuffing
+#define BENCHMARK_BUS_LOAD_MAX 0.8
+
+static int benchmarkTasksList[ BENCHMARK_NODES_MAX + 1 ];
+
+// Shortest cycle period (in milliseconds) keeping the bus load of 2 RPDOs and 2 TPDOs per node (and SYNC) under limit
+unsigned long BenchmarkStub_GetCyclePeriod( size_t nodesNumber )
+{
+  double cycleBits = ( 4 * nodesNumber + 1 ) * BENCHMARK_FRAME_BITS;
+  double cycleTime = cycleBits / ( STUB_DEFAULT_BIT_RATE * BENCHMARK_BUS_LOAD_MAX );
+
+  return (unsigned long) ceil( cycleTime * 1000.0 );
+}
+
+// Load tasks for nodes 1 to <nodesNumber> (configuration suffix appended to node ID), acquiring given output channel
+bool BenchmarkStub_InitNodes( size_t nodesNumber, const char* configSuffix, unsigned int outputChannel )
+{
+  char taskConfig[ 256 ];
+  for( size_t nodeID = 1; nodeID <= nodesNumber; nodeID++ )
+  {
+    snprintf( taskConfig, sizeof(taskConfig), "%u%s", (unsigned int) nodeID, ( configSuffix != NULL ) ? configSuffix : "" );
+    if( (benchmarkTasksList[ nodeID ] = InitDevice( taskConfig )) == -1 ) return false;
+    if( !AcquireOutputChannel( benchmarkTasksList[ nodeID ], outputChannel ) ) return false;
+  }
+
+  return true;
+}
+
+// One network cycle as run by a control loop: setpoints for all nodes, cycle period wait and measures of all nodes
+void BenchmarkStub_RunCycle( size_t nodesNumber, unsigned int outputChannel, double setpoint, unsigned long period )
+{
+  for( size_t nodeID = 1; nodeID <= nodesNumber; nodeID++ )
+    Write( benchmarkTasksList[ nodeID ], outputChannel, setpoint );
+
+  Time_Delay( period );
+
+  double measure;
+  for( size_t nodeID = 1; nodeID <= nodesNumber; nodeID++ )
+    Read( benchmarkTasksList[ nodeID ], 0, &measure );
+}
+
+bool BenchmarkStub_IsNodeEnabled( size_t nodeID )
+{
+  khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) benchmarkTasksList[ nodeID ] );
+  if( taskIndex == kh_end( tasksList ) ) return false;
+
+  return ( kh_value( tasksList, taskIndex )->statusWord & OPERATION_ENABLED );
+}
+
+// Run cycles until every node reaches Operation Enabled state and queued configuration commands are done,
+// returning the virtual time it took (negative on timeout)
+double BenchmarkStub_EnableNodes( size_t nodesNumber, unsigned int outputChannel, unsigned long period )
+{
+  double startTime = Time_GetExecSeconds();
+
+  size_t enabledNodesNumber = 0;
+  while( enabledNodesNumber < nodesNumber || !CANCommands_IsEmpty() )
+  {
+    if( Time_GetExecSeconds() - startTime > BENCHMARK_STARTUP_TIMEOUT ) return -1.0;
+
+    BenchmarkStub_RunCycle( nodesNumber, outputChannel, 0.0, period );
+
+    enabledNodesNumber = 0;
+    for( size_t nodeID = 1; nodeID <= nodesNumber; nodeID++ )
+      if( BenchmarkStub_IsNodeEnabled( nodeID ) ) enabledNodesNumber++;
+  }
+
+  return Time_GetExecSeconds() - startTime;
+}
+
+void BenchmarkStub_EndNodes( size_t nodesNumber )
+{
+  for( size_t nodeID = 1; nodeID <= nodesNumber; nodeID++ )
+    EndDevice( benchmarkTasksList[ nodeID ] );
+}
+
+// Bytes currently allocated from the heap (0 where unknown)
+size_t BenchmarkStub_GetHeapSize()
+{
+#if defined( __GLIBC__ ) && ( __GLIBC__ > 2 || __GLIBC_MINOR__ >= 33 )
+  return mallinfo2().uordblks;
+#else
+  return 0;
+#endif
+}
+
+// Host processor time spent by the benchmark, in seconds (virtual time delays don't count)
+double BenchmarkStub_GetCPUTime()
+{
+  struct timespec cpuTime;
+  clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &cpuTime );
+
+  return cpuTime.tv_sec + cpuTime.tv_nsec / 1.0e9;
+}
+
+// Call given run function on a child process, returning whether it succeeded
+bool BenchmarkStub_RunIsolated( bool (*Run)( size_t ), size_t nodesNumber )
+{
+  fflush( stdout );
+
+  pid_t runProcess = fork();
+  if( runProcess < 0 ) return false;
+  if( runProcess == 0 ) exit( Run( nodesNumber ) ? EXIT_SUCCESS : EXIT_FAILURE );
+
+  int runStatus;
+  if( waitpid( runProcess, &runStatus, 0 ) < 0 ) return false;
+
+  return ( WIFEXITED( runStatus ) && WEXITSTATUS( runStatus ) == EXIT_SUCCESS );
+}
+
+// Node counts given as program arguments (from <firstArgument> on), or default ones
+size_t BenchmarkStub_GetNodeCounts( int argc, char** argv, int firstArgument, size_t* nodeCountsList, size_t countsMax )
+{
+  const size_t DEFAULT_NODE_COUNTS[] = { 1, 8, 32, 64, BENCHMARK_NODES_MAX };
+
+  size_t countsNumber = 0;
+  for( int argumentIndex = firstArgument; argumentIndex < argc && countsNumber < countsMax; argumentIndex++ )
+  {
+    size_t nodesNumber = (size_t) strtoul( argv[ argumentIndex ], NULL, 0 );
+    if( nodesNumber >= 1 && nodesNumber <= BENCHMARK_NODES_MAX ) nodeCountsList[ countsNumber++ ] = nodesNumber;
+  }
+
+  if( countsNumber > 0 ) return countsNumber;
+
+  for( ; countsNumber < sizeof(DEFAULT_NODE_COUNTS) / sizeof(size_t) && countsNumber < countsMax; countsNumber++ )
+    nodeCountsList[ countsNumber ] = DEFAULT_NODE_COUNTS[ countsNumber ];
+
+  return countsNumber;
+}
+
+#endif // BENCHMARK_STUB_H
@@ -0,0 +1,192 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>       //
+//                                                                            //
+//  This file is part of Signal-IO-NIXNET.                                    //
+//                                                                            //
+//  Signal-IO-NIXNETs free software: you can redistribute it and/or modify    //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,       //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.  //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Out-of-process CAN bus simulator: hosts the NI-XNET stub bus and drives,
+// serving controller processes (plug-ins built with NIXNET_SHM) over shared memory
+
+#include "nixnet_stub.h"
+
+#define NIXNET_SHM_SERVER
+#include "nixnet_shm.h"
+
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define IDLE_SLEEP_TIME 10000 // nanoseconds
+
+typedef struct _SessionOwner
+{
+  int clientIndex;
+  uint32_t clientSession;
+}
+SessionOwner;
+
+static nxShmBus* bus = NULL;
+static nxSessionRef_t clientSessionsList[ NIXNET_SHM_CLIENTS_MAX ][ NIXNET_SHM_SESSIONS_MAX ];
+static SessionOwner sessionOwnersList[ STUB_SESSIONS_MAX ];
+static volatile sig_atomic_t isRunning = 1;
+
+static void HandleSignal( int signalNumber )
+{
+  isRunning = 0;
+}
+
+// Forward frames received by simulated input sessions to the controller that opened them
+static void ForwardFrame( nxSessionRef_t sessionRef, const nxFrameVar_t* frame )
+{
+  SessionOwner* owner = &(sessionOwnersList[ sessionRef ]);
+  if( owner->clientIndex < 0 ) return;
+  
+  nxShmRecord record = { .type = NXSHM_FRAME, .session = owner->clientSession, .timestamp = frame->Timestamp, .identifier = frame->Identifier };
+  record.payloadLength = frame->PayloadLength;
+  memcpy( record.payload, frame->Payload, sizeof(record.payload) );
+  
+  if( !nxShmRing_Push( &(bus->clientsList[ owner->clientIndex ].rxRing), &record ) )
+    fprintf( stderr, "client %d receive ring full: frame 0x%03X dropped\n", owner->clientIndex, (unsigned int) frame->Identifier );
+}
+
+static void ReleaseClient( int clientIndex )
+{
+  nxShmClient* client = &(bus->clientsList[ clientIndex ]);
+  
+  for( size_t sessionRef = 0; sessionRef < STUB_SESSIONS_MAX; sessionRef++ )
+  {
+    if( sessionOwnersList[ sessionRef ].clientIndex != clientIndex ) continue;
+    nxClear( (nxSessionRef_t) sessionRef );
+    sessionOwnersList[ sessionRef ].clientIndex = -1;
+  }
+  
+  client->txRing.head = client->txRing.tail = 0;
+  client->rxRing.head = client->rxRing.tail = 0;
+  client->processID = 0;
+  __atomic_store_n( &(client->state), NXSHM_CLIENT_FREE, __ATOMIC_RELEASE );
+  
+  printf( "client %d released\n", clientIndex );
+}
+
+static bool ProcessClient( int clientIndex )
+{
+  nxShmClient* client = &(bus->clientsList[ clientIndex ]);
+  
+  uint32_t state = __atomic_load_n( &(client->state), __ATOMIC_ACQUIRE );
+  if( state == NXSHM_CLIENT_FREE ) return false;
+  
+  // Detaching or crashed controller process
+  if( state == NXSHM_CLIENT_DETACHING || ( client->processID > 0 && kill( client->processID, 0 ) == -1 && errno == ESRCH ) )
+  {
+    ReleaseClient( clientIndex );
+    return true;
+  }
+  
+  bool hasActivity = false;
+  nxShmRecord record;
+  while( nxShmRing_Pop( &(client->txRing), &record ) )
+  {
+    hasActivity = true;
+    
+    if( record.session >= NIXNET_SHM_SESSIONS_MAX ) continue;
+    nxSessionRef_t* ref_session = &(clientSessionsList[ clientIndex ][ record.session ]);
+    
+    if( record.type == NXSHM_SESSION_CREATE )
+    {
+      if( nxCreateSession( "database", "NETCAN", record.name, "SHM", record.mode, ref_session ) != nxSuccess ) continue;
+      sessionOwnersList[ *ref_session ] = (SessionOwner) { clientIndex, record.session };
+    }
+    else if( record.type == NXSHM_SESSION_CLEAR )
+    {
+      nxClear( *ref_session );
+      sessionOwnersList[ *ref_session ].clientIndex = -1;
+    }
+    else if( record.type == NXSHM_FRAME )
+    {
+      nxFrameVar_t frame = { 0, record.identifier, nxFrameType_CAN_Data, 0, 0, record.payloadLength, { 0 } };
+      memcpy( frame.Payload, record.payload, sizeof(frame.Payload) );
+      nxWriteFrame( *ref_session, &frame, sizeof(nxFrameVar_t), 0.0 );
+    }
+  }
+  
+  return hasActivity;
+}
+
+int main( int argc, char** argv )
+{
+  const char* sharedMemoryName = ( argc > 1 ) ? argv[ 1 ] : nxShm_GetName();
+  
+  shm_unlink( sharedMemoryName );
+  int sharedMemoryFD = shm_open( sharedMemoryName, O_CREAT | O_RDWR, 0666 );
+  if( sharedMemoryFD == -1 || ftruncate( sharedMemoryFD, sizeof(nxShmBus) ) == -1 )
+  {
+    perror( "shared memory creation failed" );
+    return -1;
+  }
+  
+  bus = (nxShmBus*) mmap( NULL, sizeof(nxShmBus), PROT_READ | PROT_WRITE, MAP_SHARED, sharedMemoryFD, 0 );
+  close( sharedMemoryFD );
+  if( bus == MAP_FAILED )
+  {
+    perror( "shared memory mapping failed" );
+    shm_unlink( sharedMemoryName );
+    return -1;
+  }
+  
+  memset( bus, 0, sizeof(nxShmBus) );
+  for( size_t sessionRef = 0; sessionRef < STUB_SESSIONS_MAX; sessionRef++ )
+    sessionOwnersList[ sessionRef ].clientIndex = -1;
+  
+  nxStub_SetDeliveryCallback( ForwardFrame );
+  
+  signal( SIGINT, HandleSignal );
+  signal( SIGTERM, HandleSignal );
+  
+  __atomic_store_n( &(bus->processID), (int32_t) getpid(), __ATOMIC_RELEASE );
+  __atomic_store_n( &(bus->magic), NIXNET_SHM_MAGIC, __ATOMIC_RELEASE );
+  
+  setvbuf( stdout, NULL, _IOLBF, 0 );
+  printf( "simulated CAN bus running on shared memory %s\n", sharedMemoryName );
+  
+  while( isRunning )
+  {
+    bool hasActivity = false;
+    for( int clientIndex = 0; clientIndex < NIXNET_SHM_CLIENTS_MAX; clientIndex++ )
+      hasActivity |= ProcessClient( clientIndex );
+    
+    nxStub_Update();
+    __atomic_store_n( &(bus->time), StubClock_GetTime() / 100, __ATOMIC_RELEASE );
+    
+    if( !hasActivity )
+    {
+      struct timespec idleTime = { 0, IDLE_SLEEP_TIME };
+      nanosleep( &idleTime, NULL );
+    }
+  }
+  
+  // Attached controllers stop waiting for records to be taken
+  __atomic_store_n( &(bus->processID), 0, __ATOMIC_RELEASE );
+  
+  munmap( bus, sizeof(nxShmBus) );
+  shm_unlink( sharedMemoryName );
+  
+  return 0;
+}
@@ -0,0 +1,640 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                      //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>                 //
+//                                                                                      //
+//  This file is part of Signal-IO-NIXNET.                                              //
+//                                                                                      //
+//  Signal-IO-NIXNET is free software: you can redistribute it and/or modify            //
+//  it under the terms of the GNU Lesser General Public License as published            //
+//  by the Free Software Foundation, either version 3 of the License, or                //
+//  (at your option) any later version.                                                 //
+//                                                                                      //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,                 //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of                      //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                        //
+//  GNU Lesser General Public License for more details.                                 //
+//                                                                                      //
+//  You should have received a copy of the GNU Lesser General Public License            //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.            //
+//                                                                                      //
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+// Capture of frames read and written by the plug-in. Appending a frame only copies it
+// into a ring buffer; a background thread packs records into blocks (delta encoded
+// timestamps and identifiers), compresses them with a small LZ77 coder and writes them to file.
+//
+// File format: sequence of blocks, each one a CANCaptureBlockHeader followed by its
+// stored data (compressed if storedSize < rawSize). Raw block data is a sequence of records:
+//   varint( zigzag( time - previous time ) )   (interface time, first one relative to block firstTime)
+//   varint( zigzag( identifier - previous identifier ) )   (first one relative to 0)
+//   direction << 7 | payload length
+//   payload bytes
+//
+// A sidecar index file (capture path + ".idx") holds one CANCaptureIndexEntry per block, with
+// its file offset, time range and the nodes with frames in it, for seeking by time and node.
+
+#ifndef CAN_CAPTURE_H
+#define CAN_CAPTURE_H
+
+#include "threads/threading.h"
+#include "threads/semaphores.h"
+
+#include "debug/data_logging.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 64 bits file offsets, as captures may grow past 2 GB (off_t needs _FILE_OFFSET_BITS=64 on 32 bits POSIX systems)
+#ifdef _WIN32
+  #define CAPTURE_TELL( file ) ( (int64_t) _ftelli64( file ) )
+  #define CAPTURE_SEEK( file, offset ) _fseeki64( file, (__int64) (offset), SEEK_SET )
+#else
+  #include <sys/types.h>
+  #define CAPTURE_TELL( file ) ( (int64_t) ftello( file ) )
+  #define CAPTURE_SEEK( file, offset ) fseeko( file, (off_t) (offset), SEEK_SET )
+#endif
+
+#define CAN_CAPTURE_RING_LENGTH 16384           // Must be a power of 2
+#define CAN_CAPTURE_WAKE_RECORDS 1024           // Records appended between writer thread wake-ups
+#define CAN_CAPTURE_BLOCK_RECORDS 4096
+#define CAN_CAPTURE_RECORD_SIZE_MAX ( 10 + 5 + 1 + 8 )
+#define CAN_CAPTURE_BLOCK_SIZE_MAX ( CAN_CAPTURE_BLOCK_RECORDS * CAN_CAPTURE_RECORD_SIZE_MAX )
+#define CAN_CAPTURE_MAGIC 0x4243584E            // "NXCB"
+#define CAN_CAPTURE_NODES_NUMBER 128            // Node 0 holds network frames (NMT and SYNC)
+#define CAN_CAPTURE_INDEX_EXTENSION ".idx"
+#define CAN_CAPTURE_PATH_MAX_LENGTH 256
+
+enum CANCaptureDirection { CAPTURE_RX = 0, CAPTURE_TX = 1 };
+
+typedef struct _CANCaptureRecord
+{
+  uint64_t time;                    // Interface timestamp (100 ns units, as nxTimestamp_t)
+  uint32_t identifier;              // CAN identifier (CANopen COB-ID)
+  uint8_t direction;
+  uint8_t length;
+  uint8_t payload[ 8 ];
+}
+CANCaptureRecord;
+
+typedef struct _CANCaptureBlockHeader
+{
+  uint32_t magic;
+  uint32_t recordsNumber;
+  uint32_t rawSize;
+  uint32_t storedSize;
+  uint64_t firstTime, lastTime;
+}
+CANCaptureBlockHeader;
+
+typedef struct _CANCaptureIndexEntry
+{
+  uint64_t offset;                  // Block header position in capture file
+  uint64_t firstTime, lastTime;
+  uint32_t recordsNumber;
+  uint32_t storedSize;
+  uint32_t nodesMask[ CAN_CAPTURE_NODES_NUMBER / 32 ];
+}
+CANCaptureIndexEntry;
+
+typedef struct _CANCaptureIndexData
+{
+  CANCaptureIndexEntry* entriesList;
+  size_t entriesNumber;
+  uint32_t* nodeBlocksList[ CAN_CAPTURE_NODES_NUMBER ];    // Indexes of blocks with frames of each node
+  size_t nodeBlocksNumber[ CAN_CAPTURE_NODES_NUMBER ];
+}
+CANCaptureIndexData;
+
+typedef CANCaptureIndexData* CANCaptureIndex;
+
+typedef struct _CANCaptureSlot
+{
+  size_t sequence;                  // Stored relative to slot position (see can_commands.h queue)
+  CANCaptureRecord record;
+}
+CANCaptureSlot;
+
+static CANCaptureSlot captureRing[ CAN_CAPTURE_RING_LENGTH ];
+static size_t captureHead = 0, captureTail = 0;
+static size_t captureDropsCount = 0;
+static bool isCapturing = false;
+static Semaphore captureEvent = NULL;
+static Thread captureThread = THREAD_INVALID_HANDLE;
+static FILE* captureFile = NULL;
+static FILE* captureIndexFile = NULL;
+
+// Writer thread block state
+static CANCaptureBlockHeader captureBlockHeader;
+static CANCaptureIndexEntry captureIndexEntry;
+static uint8_t captureRawBlock[ CAN_CAPTURE_BLOCK_SIZE_MAX ];
+static uint8_t captureStoredBlock[ CAN_CAPTURE_BLOCK_SIZE_MAX ];
+static uint64_t capturePreviousTime;
+static uint32_t capturePreviousIdentifier;
+
+// Tell if frames are being captured (e.g. to skip getting their timestamps otherwise)
+bool CANCapture_IsActive()
+{
+  return __atomic_load_n( &isCapturing, __ATOMIC_RELAXED );
+}
+
+// Copy frame to capture ring (never blocks: frames are dropped if the writer thread lags behind)
+void CANCapture_Append( uint64_t timestamp, uint32_t identifier, enum CANCaptureDirection direction, const uint8_t* payload, uint8_t length )
+{
+  if( !__atomic_load_n( &isCapturing, __ATOMIC_RELAXED ) ) return;
+
+  size_t position = __atomic_load_n( &captureHead, __ATOMIC_RELAXED );
+  do
+  {
+    if( position - __atomic_load_n( &captureTail, __ATOMIC_ACQUIRE ) >= CAN_CAPTURE_RING_LENGTH )
+    {
+      __atomic_add_fetch( &captureDropsCount, 1, __ATOMIC_RELAXED );
+      return;
+    }
+  } while( !__atomic_compare_exchange_n( &captureHead, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
+
+  size_t slotIndex = position & ( CAN_CAPTURE_RING_LENGTH - 1 );
+  CANCaptureRecord* record = &(captureRing[ slotIndex ].record);
+  record->time = timestamp;
+  record->identifier = identifier;
+  record->direction = (uint8_t) direction;
+  record->length = ( length > 8 ) ? 8 : length;
+  memcpy( record->payload, payload, record->length );
+
+  __atomic_store_n( &(captureRing[ slotIndex ].sequence), position + 1 - slotIndex, __ATOMIC_RELEASE );
+
+  if( ( position + 1 ) % CAN_CAPTURE_WAKE_RECORDS == 0 ) Semaphores.Increment( captureEvent );
+}
+
+size_t CANCapture_GetDroppedCount()
+{
+  return __atomic_load_n( &captureDropsCount, __ATOMIC_RELAXED );
+}
+
+static size_t WriteVarInt( uint8_t* buffer, uint64_t value )
+{
+  size_t length = 0;
+  while( value >= 0x80 )
+  {
+    buffer[ length++ ] = (uint8_t) ( value | 0x80 );
+    value >>= 7;
+  }
+  buffer[ length++ ] = (uint8_t) value;
+
+  return length;
+}
+
+static size_t ReadVarInt( const uint8_t* buffer, size_t bufferSize, uint64_t* ref_value )
+{
+  uint64_t value = 0;
+  for( size_t length = 0; length < bufferSize && length < 10; length++ )
+  {
+    value |= (uint64_t) ( buffer[ length ] & 0x7F ) << ( 7 * length );
+    if( !( buffer[ length ] & 0x80 ) )
+    {
+      *ref_value = value;
+      return length + 1;
+    }
+  }
+
+  return 0;
+}
+
+#define ZIGZAG_ENCODE( value ) ( ( (uint64_t) (value) << 1 ) ^ (uint64_t) ( (int64_t) (value) >> 63 ) )
+#define ZIGZAG_DECODE( value ) ( (int64_t) ( (value) >> 1 ) ^ -(int64_t) ( (value) & 1 ) )
+
+#define LZ_HASH_BITS 12
+#define LZ_MATCH_MIN 4
+#define LZ_OFFSET_MAX 65535
+
+static uint32_t ReadWord32( const uint8_t* data ) { uint32_t value; memcpy( &value, data, sizeof(value) ); return value; }
+
+static size_t WriteLZLength( uint8_t* output, size_t outputSize, size_t outputLength, size_t length )
+{
+  for( ; length >= 255; length -= 255 )
+  {
+    if( outputLength >= outputSize ) return 0;
+    output[ outputLength++ ] = 255;
+  }
+  if( outputLength >= outputSize ) return 0;
+  output[ outputLength++ ] = (uint8_t) length;
+
+  return outputLength;
+}
+
+// Emit literals followed by match (matchLength 0 only for the last sequence)
+static size_t WriteLZSequence( uint8_t* output, size_t outputSize, size_t outputLength, const uint8_t* literals, size_t literalsLength, size_t offset, size_t matchLength )
+{
+  size_t matchCode = ( matchLength > 0 ) ? matchLength - LZ_MATCH_MIN : 0;
+
+  if( outputLength >= outputSize ) return 0;
+  output[ outputLength++ ] = (uint8_t) ( ( ( literalsLength < 15 ) ? literalsLength : 15 ) << 4 | ( ( matchCode < 15 ) ? matchCode : 15 ) );
+  if( literalsLength >= 15 && ( outputLength = WriteLZLength( output, outputSize, outputLength, literalsLength - 15 ) ) == 0 ) return 0;
+
+  if( outputLength + literalsLength > outputSize ) return 0;
+  memcpy( output + outputLength, literals, literalsLength );
+  outputLength += literalsLength;
+
+  if( matchLength == 0 ) return outputLength;
+
+  if( outputLength + 2 > outputSize ) return 0;
+  output[ outputLength++ ] = (uint8_t) ( offset & 0xFF );
+  output[ outputLength++ ] = (uint8_t) ( offset >> 8 );
+  if( matchCode >= 15 && ( outputLength = WriteLZLength( output, outputSize, outputLength, matchCode - 15 ) ) == 0 ) return 0;
+
+  return outputLength;
+}
+
+// Compress data (LZ4 like sequences), returning 0 if output would not be smaller than input
+size_t CANCapture_Compress( const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputSize )
+{
+  static uint32_t hashTable[ 1 << LZ_HASH_BITS ];         // Positions + 1 (0 for empty entries)
+
+  if( outputSize > inputSize ) outputSize = inputSize;
+
+  memset( hashTable, 0, sizeof(hashTable) );
+
+  size_t position = 0, anchor = 0, outputLength = 0;
+  while( position + LZ_MATCH_MIN <= inputSize )
+  {
+    uint32_t sequence = ReadWord32( input + position );
+    uint32_t hash = ( sequence * 2654435761U ) >> ( 32 - LZ_HASH_BITS );
+    size_t reference = hashTable[ hash ];
+    hashTable[ hash ] = (uint32_t) position + 1;
+
+    if( reference == 0 || position - ( reference - 1 ) > LZ_OFFSET_MAX || ReadWord32( input + reference - 1 ) != sequence )
+    {
+      position++;
+      continue;
+    }
+    reference--;
+
+    size_t matchLength = LZ_MATCH_MIN;
+    while( position + matchLength < inputSize && input[ reference + matchLength ] == input[ position + matchLength ] ) matchLength++;
+
+    outputLength = WriteLZSequence( output, outputSize, outputLength, input + anchor, position - anchor, position - reference, matchLength );
+    if( outputLength == 0 ) return 0;
+
+    position += matchLength;
+    anchor = position;
+  }
+
+  outputLength = WriteLZSequence( output, outputSize, outputLength, input + anchor, inputSize - anchor, 0, 0 );
+  if( outputLength >= inputSize ) return 0;
+
+  return outputLength;
+}
+
+static bool ReadLZLength( const uint8_t* input, size_t inputSize, size_t* ref_position, size_t* ref_length )
+{
+  uint8_t byte;
+  do
+  {
+    if( *ref_position >= inputSize ) return false;
+    byte = input[ (*ref_position)++ ];
+    *ref_length += byte;
+  } while( byte == 255 );
+
+  return true;
+}
+
+// Decompress data to given size (false on corrupted input)
+bool CANCapture_Decompress( const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputSize )
+{
+  size_t position = 0, outputLength = 0;
+  while( position < inputSize )
+  {
+    uint8_t token = input[ position++ ];
+
+    size_t literalsLength = token >> 4;
+    if( literalsLength == 15 && !ReadLZLength( input, inputSize, &position, &literalsLength ) ) return false;
+    if( position + literalsLength > inputSize || outputLength + literalsLength > outputSize ) return false;
+    memcpy( output + outputLength, input + position, literalsLength );
+    position += literalsLength;
+    outputLength += literalsLength;
+
+    if( outputLength == outputSize ) return true;
+
+    if( position + 2 > inputSize ) return false;
+    size_t offset = input[ position ] + input[ position + 1 ] * 0x100;
+    position += 2;
+    size_t matchLength = token & 0x0F;
+    if( matchLength == 15 && !ReadLZLength( input, inputSize, &position, &matchLength ) ) return false;
+    matchLength += LZ_MATCH_MIN;
+    if( offset == 0 || offset > outputLength || outputLength + matchLength > outputSize ) return false;
+    // Byte by byte, as overlapping matches repeat their own output
+    for( size_t byteIndex = 0; byteIndex < matchLength; byteIndex++, outputLength++ )
+      output[ outputLength ] = output[ outputLength - offset ];
+  }
+
+  return ( outputLength == outputSize );
+}
+
+// Decode raw block data into records (returns number of decoded records)
+size_t CANCapture_DecodeBlock( const CANCaptureBlockHeader* header, const uint8_t* data, CANCaptureRecord* recordsList, size_t recordsMax )
+{
+  uint64_t time = header->firstTime;
+  uint32_t identifier = 0;
+
+  size_t position = 0, recordsNumber = 0;
+  while( position < header->rawSize && recordsNumber < recordsMax && recordsNumber < header->recordsNumber )
+  {
+    uint64_t timeDelta, identifierDelta;
+    size_t length = ReadVarInt( data + position, header->rawSize - position, &timeDelta );
+    if( length == 0 ) break;
+    position += length;
+    if( ( length = ReadVarInt( data + position, header->rawSize - position, &identifierDelta ) ) == 0 ) break;
+    position += length;
+    if( position >= header->rawSize ) break;
+
+    CANCaptureRecord* record = &(recordsList[ recordsNumber ]);
+    time += ZIGZAG_DECODE( timeDelta );
+    identifier += (uint32_t) ZIGZAG_DECODE( identifierDelta );
+    record->time = time;
+    record->identifier = identifier;
+    record->direction = data[ position ] >> 7;
+    record->length = data[ position++ ] & 0x0F;
+    if( record->length > 8 || position + record->length > header->rawSize ) break;
+    memcpy( record->payload, data + position, record->length );
+    position += record->length;
+    recordsNumber++;
+  }
+
+  return recordsNumber;
+}
+
+static void WriteCaptureBlock()
+{
+  if( captureBlockHeader.recordsNumber == 0 ) return;
+
+  captureBlockHeader.magic = CAN_CAPTURE_MAGIC;
+
+  const uint8_t* storedData = captureStoredBlock;
+  captureBlockHeader.storedSize = (uint32_t) CANCapture_Compress( captureRawBlock, captureBlockHeader.rawSize, captureStoredBlock, sizeof(captureStoredBlock) );
+  if( captureBlockHeader.storedSize == 0 )
+  {
+    captureBlockHeader.storedSize = captureBlockHeader.rawSize;
+    storedData = captureRawBlock;
+  }
+
+  int64_t blockOffset = CAPTURE_TELL( captureFile );
+  captureIndexEntry.offset = (uint64_t) blockOffset;
+  
+  if( blockOffset < 0 || fwrite( &captureBlockHeader, sizeof(CANCaptureBlockHeader), 1, captureFile ) != 1 
+      || fwrite( storedData, 1, captureBlockHeader.storedSize, captureFile ) != captureBlockHeader.storedSize )
+  {
+    DEBUG_PRINT( "error writing capture block (%u records dropped)", captureBlockHeader.recordsNumber );
+    __atomic_add_fetch( &captureDropsCount, captureBlockHeader.recordsNumber, __ATOMIC_RELAXED );
+    // Next block overwrites partially written one
+    if( blockOffset >= 0 ) CAPTURE_SEEK( captureFile, blockOffset );
+  }
+  else if( captureIndexFile != NULL )
+  {
+    captureIndexEntry.firstTime = captureBlockHeader.firstTime;
+    captureIndexEntry.lastTime = captureBlockHeader.lastTime;
+    captureIndexEntry.recordsNumber = captureBlockHeader.recordsNumber;
+    captureIndexEntry.storedSize = captureBlockHeader.storedSize;
+    // Blocks are still read sequentially without their index entries
+    if( fwrite( &captureIndexEntry, sizeof(CANCaptureIndexEntry), 1, captureIndexFile ) != 1 )
+      DEBUG_PRINT( "error writing capture index entry for block at offset %lld", (long long) blockOffset );
+  }
+  
+  memset( captureIndexEntry.nodesMask, 0, sizeof(captureIndexEntry.nodesMask) );
+  captureBlockHeader.recordsNumber = 0;
+  captureBlockHeader.rawSize = 0;
+}
+
+static void EncodeCaptureRecord( const CANCaptureRecord* record )
+{
+  if( captureBlockHeader.recordsNumber == 0 )
+  {
+    captureBlockHeader.firstTime = capturePreviousTime = record->time;
+    capturePreviousIdentifier = 0;
+  }
+
+  uint8_t* data = captureRawBlock + captureBlockHeader.rawSize;
+  size_t length = WriteVarInt( data, ZIGZAG_ENCODE( (int64_t) ( record->time - capturePreviousTime ) ) );
+  length += WriteVarInt( data + length, ZIGZAG_ENCODE( (int64_t) record->identifier - (int64_t) capturePreviousIdentifier ) );
+  data[ length++ ] = (uint8_t) ( record->direction << 7 | record->length );
+  memcpy( data + length, record->payload, record->length );
+  length += record->length;
+
+  captureBlockHeader.rawSize += (uint32_t) length;
+  captureBlockHeader.recordsNumber++;
+  captureBlockHeader.lastTime = capturePreviousTime = record->time;
+  capturePreviousIdentifier = record->identifier;
+  
+  // CANopen node ID is on the identifier lower bits (0 for NMT and SYNC)
+  uint32_t nodeID = record->identifier & ( CAN_CAPTURE_NODES_NUMBER - 1 );
+  captureIndexEntry.nodesMask[ nodeID / 32 ] |= 1U << ( nodeID % 32 );
+
+  if( captureBlockHeader.recordsNumber >= CAN_CAPTURE_BLOCK_RECORDS ) WriteCaptureBlock();
+}
+
+// Move published records from ring to current block
+static void DrainCaptureRing()
+{
+  size_t position = __atomic_load_n( &captureTail, __ATOMIC_RELAXED );
+  while( true )
+  {
+    size_t slotIndex = position & ( CAN_CAPTURE_RING_LENGTH - 1 );
+    if( __atomic_load_n( &(captureRing[ slotIndex ].sequence), __ATOMIC_ACQUIRE ) + slotIndex != position + 1 ) break;
+
+    EncodeCaptureRecord( &(captureRing[ slotIndex ].record) );
+
+    __atomic_store_n( &(captureRing[ slotIndex ].sequence), position + CAN_CAPTURE_RING_LENGTH - slotIndex, __ATOMIC_RELAXED );
+    __atomic_store_n( &captureTail, ++position, __ATOMIC_RELEASE );
+  }
+}
+
+static void* AsyncWriteCapture( void* data )
+{
+  while( __atomic_load_n( &isCapturing, __ATOMIC_ACQUIRE ) )
+  {
+    Semaphores.Decrement( captureEvent );
+    DrainCaptureRing();
+  }
+
+  return NULL;
+}
+
+bool CANCapture_Start( const char* filePath )
+{
+  if( isCapturing ) return false;
+
+  if( (captureFile = fopen( filePath, "wb" )) == NULL )
+  {
+    DEBUG_PRINT( "error opening capture file %s", filePath );
+    return false;
+  }
+
+  char indexFilePath[ CAN_CAPTURE_PATH_MAX_LENGTH ];
+  snprintf( indexFilePath, CAN_CAPTURE_PATH_MAX_LENGTH, "%s" CAN_CAPTURE_INDEX_EXTENSION, filePath );
+  if( (captureIndexFile = fopen( indexFilePath, "wb" )) == NULL ) DEBUG_PRINT( "error opening capture index file %s", indexFilePath );
+
+  captureBlockHeader.recordsNumber = 0;
+  captureBlockHeader.rawSize = 0;
+  memset( captureIndexEntry.nodesMask, 0, sizeof(captureIndexEntry.nodesMask) );
+  captureEvent = Semaphores.Create( 0, CAN_CAPTURE_RING_LENGTH );
+
+  __atomic_store_n( &isCapturing, true, __ATOMIC_RELEASE );
+  captureThread = Threading.StartThread( AsyncWriteCapture, NULL, THREAD_JOINABLE );
+
+  return true;
+}
+
+void CANCapture_Stop()
+{
+  if( !isCapturing ) return;
+
+  __atomic_store_n( &isCapturing, false, __ATOMIC_RELEASE );
+  Semaphores.Increment( captureEvent );
+  Threading.WaitExit( captureThread, 5000 );
+
+  DrainCaptureRing();
+  WriteCaptureBlock();
+
+  Semaphores.Discard( captureEvent );
+  fclose( captureFile );
+  captureFile = NULL;
+  if( captureIndexFile != NULL ) fclose( captureIndexFile );
+  captureIndexFile = NULL;
+
+  if( captureDropsCount > 0 ) DEBUG_PRINT( "%lu frames dropped from capture", (unsigned long) captureDropsCount );
+}
+
+void CANCaptureIndex_Discard( CANCaptureIndex );
+
+// Load sidecar index of given capture file (per node block lists are built from block nodes masks)
+CANCaptureIndex CANCaptureIndex_Load( const char* filePath )
+{
+  char indexFilePath[ CAN_CAPTURE_PATH_MAX_LENGTH ];
+  snprintf( indexFilePath, CAN_CAPTURE_PATH_MAX_LENGTH, "%s" CAN_CAPTURE_INDEX_EXTENSION, filePath );
+  
+  FILE* indexFile = fopen( indexFilePath, "rb" );
+  if( indexFile == NULL ) return NULL;
+  
+  CANCaptureIndex index = (CANCaptureIndex) calloc( 1, sizeof(CANCaptureIndexData) );
+  if( index == NULL )
+  {
+    fclose( indexFile );
+    return NULL;
+  }
+  
+  int64_t indexSize = -1;
+  if( fseek( indexFile, 0, SEEK_END ) == 0 ) indexSize = CAPTURE_TELL( indexFile );
+  if( indexSize < 0 || CAPTURE_SEEK( indexFile, 0 ) != 0 )
+  {
+    fclose( indexFile );
+    free( index );
+    return NULL;
+  }
+  
+  index->entriesNumber = (size_t) ( (uint64_t) indexSize / sizeof(CANCaptureIndexEntry) );
+  index->entriesList = (CANCaptureIndexEntry*) malloc( ( index->entriesNumber + 1 ) * sizeof(CANCaptureIndexEntry) );
+  if( index->entriesList == NULL )
+  {
+    fclose( indexFile );
+    free( index );
+    return NULL;
+  }
+  
+  index->entriesNumber = fread( index->entriesList, sizeof(CANCaptureIndexEntry), index->entriesNumber, indexFile );
+  fclose( indexFile );
+  
+  for( size_t entryIndex = 0; entryIndex < index->entriesNumber; entryIndex++ )
+  {
+    for( size_t nodeID = 0; nodeID < CAN_CAPTURE_NODES_NUMBER; nodeID++ )
+      if( index->entriesList[ entryIndex ].nodesMask[ nodeID / 32 ] & ( 1U << ( nodeID % 32 ) ) ) index->nodeBlocksNumber[ nodeID ]++;
+  }
+  
+  for( size_t nodeID = 0; nodeID < CAN_CAPTURE_NODES_NUMBER; nodeID++ )
+  {
+    if( index->nodeBlocksNumber[ nodeID ] == 0 ) continue;
+    index->nodeBlocksList[ nodeID ] = (uint32_t*) malloc( index->nodeBlocksNumber[ nodeID ] * sizeof(uint32_t) );
+    if( index->nodeBlocksList[ nodeID ] == NULL )
+    {
+      CANCaptureIndex_Discard( index );
+      return NULL;
+    }
+    index->nodeBlocksNumber[ nodeID ] = 0;
+  }
+  
+  for( size_t entryIndex = 0; entryIndex < index->entriesNumber; entryIndex++ )
+  {
+    for( size_t nodeID = 0; nodeID < CAN_CAPTURE_NODES_NUMBER; nodeID++ )
+    {
+      if( index->entriesList[ entryIndex ].nodesMask[ nodeID / 32 ] & ( 1U << ( nodeID % 32 ) ) )
+        index->nodeBlocksList[ nodeID ][ index->nodeBlocksNumber[ nodeID ]++ ] = (uint32_t) entryIndex;
+    }
+  }
+  
+  return index;
+}
+
+void CANCaptureIndex_Discard( CANCaptureIndex index )
+{
+  if( index == NULL ) return;
+  
+  for( size_t nodeID = 0; nodeID < CAN_CAPTURE_NODES_NUMBER; nodeID++ )
+    free( index->nodeBlocksList[ nodeID ] );
+  free( index->entriesList );
+  free( index );
+}
+
+// Get first block with records at or after given time (entries number if there is none)
+size_t CANCaptureIndex_FindTime( CANCaptureIndex index, uint64_t time )
+{
+  size_t lowerIndex = 0, upperIndex = index->entriesNumber;
+  while( lowerIndex < upperIndex )
+  {
+    size_t middleIndex = lowerIndex + ( upperIndex - lowerIndex ) / 2;
+    if( index->entriesList[ middleIndex ].lastTime < time ) lowerIndex = middleIndex + 1;
+    else upperIndex = middleIndex;
+  }
+  
+  return lowerIndex;
+}
+
+// Get first block with frames of given node at or after given time (entries number if there is none)
+size_t CANCaptureIndex_FindNodeTime( CANCaptureIndex index, unsigned int nodeID, uint64_t time )
+{
+  if( nodeID >= CAN_CAPTURE_NODES_NUMBER ) return index->entriesNumber;
+  
+  const uint32_t* blocksList = index->nodeBlocksList[ nodeID ];
+  size_t lowerIndex = 0, upperIndex = index->nodeBlocksNumber[ nodeID ];
+  while( lowerIndex < upperIndex )
+  {
+    size_t middleIndex = lowerIndex + ( upperIndex - lowerIndex ) / 2;
+    if( index->entriesList[ blocksList[ middleIndex ] ].lastTime < time ) lowerIndex = middleIndex + 1;
+    else upperIndex = middleIndex;
+  }
+  
+  return ( lowerIndex < index->nodeBlocksNumber[ nodeID ] ) ? blocksList[ lowerIndex ] : index->entriesNumber;
+}
+
+// Read and decode only the given block from capture file (returns number of records)
+size_t CANCapture_ReadBlock( FILE* file, const CANCaptureIndexEntry* entry, CANCaptureRecord* recordsList, size_t recordsMax )
+{
+  static uint8_t storedData[ CAN_CAPTURE_BLOCK_SIZE_MAX ], rawData[ CAN_CAPTURE_BLOCK_SIZE_MAX ];
+  
+  CANCaptureBlockHeader header;
+  if( CAPTURE_SEEK( file, entry->offset ) != 0 ) return 0;
+  if( fread( &header, sizeof(CANCaptureBlockHeader), 1, file ) != 1 || header.magic != CAN_CAPTURE_MAGIC ) return 0;
+  if( header.storedSize > CAN_CAPTURE_BLOCK_SIZE_MAX || header.rawSize > CAN_CAPTURE_BLOCK_SIZE_MAX ) return 0;
+  if( fread( storedData, 1, header.storedSize, file ) != header.storedSize ) return 0;
+  
+  const uint8_t* data = storedData;
+  if( header.storedSize < header.rawSize )
+  {
+    if( !CANCapture_Decompress( storedData, header.storedSize, rawData, header.rawSize ) ) return 0;
+    data = rawData;
+  }
+  
+  return CANCapture_DecodeBlock( &header, data, recordsList, recordsMax );
+}
+
+#endif  /* CAN_CAPTURE_H */
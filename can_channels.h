@@ -0,0 +1,361 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                      //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>                 //
+//                                                                                      //
+//  This file is part of Signal-IO-NIXNET.                                              //
+//                                                                                      //
+//  Signal-IO-NIXNET is free software: you can redistribute it and/or modify            //
+//  it under the terms of the GNU Lesser General Public License as published            //
+//  by the Free Software Foundation, either version 3 of the License, or                //
+//  (at your option) any later version.                                                 //
+//                                                                                      //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,                 //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of                      //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                        //
+//  GNU Lesser General Public License for more details.                                 //
+//                                                                                      //
+//  You should have received a copy of the GNU Lesser General Public License            //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.            //
+//                                                                                      //
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+// Plug-in channels bound to objects mapped on the node PDOs. The mapping (EPOS factory one
+// by default) is turned at task loading into decode/encode descriptors (payload offset,
+// length, sign and scale), so that cycle updates only shift bytes and scale values.
+// Custom mappings are given as task configuration tokens (separated by spaces), one per PDO:
+//   <TPDO1|TPDO2|RPDO1|RPDO2>=<index>.<subindex>.[u]<bits>[/<raw units per channel unit>],...
+// e.g. "TPDO2=606C.00.32,20F4.00.16,2071.01.u16" (hexadecimal objects, unsigned with 'u').
+// Every object mapped on a TPDO becomes an input channel and every object mapped on a RPDO
+// (but the controlword, updated by the plug-in) becomes an output channel, in mapping order
+
+#ifndef CAN_CHANNELS_H
+#define CAN_CHANNELS_H
+
+#include "can_network.h"
+#include "can_commands.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define CAN_CHANNELS_MAX 16                // Per direction
+#define CAN_PDO_ENTRIES_MAX 8              // Byte aligned objects only
+
+#define CAN_CONTROL_WORD_INDEX 0x6040
+#define CAN_STATUS_WORD_INDEX 0x6041
+
+typedef struct _CANChannel
+{
+  uint16_t index;
+  uint8_t subIndex;
+  uint8_t pdoType;                       // enum CANFrameTypes (CAN_FRAME_TYPES_NUMBER if not mapped)
+  uint8_t entryIndex;                    // Position on PDO mapping
+  uint8_t offset, length;                // Payload bytes
+  uint32_t signBit;                      // Raw value sign bit (0 for unsigned objects)
+  double rawScale, valueScale;           // Raw units per channel unit and its inverse
+  uint32_t mappingEntry;                 // Object mapped on its PDO position while the channel is in use
+  int operationMode;                     // Operation mode selected while the output is in use (0 for none)
+}
+CANChannel;
+
+typedef struct _CANChannelsMap
+{
+  CANChannel entriesList[ 2 ][ CAN_FRAME_TYPES_NUMBER ][ CAN_PDO_ENTRIES_MAX ];   // Input (TPDOs) and output (RPDOs) mappings
+  size_t entriesNumbersList[ 2 ][ CAN_FRAME_TYPES_NUMBER ];
+  bool isConfiguredList[ 2 ][ CAN_FRAME_TYPES_NUMBER ];                          // Mapping to be written to the node
+  CANChannel inputsList[ CAN_CHANNELS_MAX ], outputsList[ CAN_CHANNELS_MAX ];
+  size_t inputsNumber, outputsNumber;
+  CANChannel statusWord, controlWord;
+}
+CANChannelsMap;
+
+enum { CAN_CHANNELS_INPUT, CAN_CHANNELS_OUTPUT };
+
+#define CAN_MAPPING_ENTRY( index, subIndex, bits ) ( ( (uint32_t) (index) << 16 ) | ( (uint32_t) (subIndex) << 8 ) | (uint32_t) (bits) )
+
+// Operation modes selected by EPOS (CiA 402 and vendor specific) setpoint objects
+static int GetOutputOperationMode( uint16_t index )
+{
+  switch( index )
+  {
+    case 0x2062: return 0xFF;   // Position mode setting value
+    case 0x206B: return 0xFE;   // Velocity mode setting value
+    case 0x2030: return 0xFD;   // Current mode setting value
+    case 0x607A: return 0x01;   // Profile position target
+    case 0x60FF: return 0x03;   // Profile velocity target
+  }
+  
+  return 0;
+}
+
+static bool AddMappingEntry( CANChannelsMap* map, int direction, enum CANFrameTypes pdoType, uint16_t index, uint8_t subIndex, unsigned int bits, bool isSigned, double rawScale )
+{
+  size_t entryIndex = map->entriesNumbersList[ direction ][ pdoType ];
+  if( entryIndex >= CAN_PDO_ENTRIES_MAX || bits == 0 || bits > 32 || bits % 8 != 0 || rawScale == 0.0 ) return false;
+  
+  size_t offset = 0;
+  if( entryIndex > 0 ) offset = map->entriesList[ direction ][ pdoType ][ entryIndex - 1 ].offset + map->entriesList[ direction ][ pdoType ][ entryIndex - 1 ].length;
+  if( offset + bits / 8 > 8 ) return false;
+  
+  CANChannel* entry = &(map->entriesList[ direction ][ pdoType ][ entryIndex ]);
+  entry->index = index;
+  entry->subIndex = subIndex;
+  entry->pdoType = (uint8_t) pdoType;
+  entry->entryIndex = (uint8_t) entryIndex;
+  entry->offset = (uint8_t) offset;
+  entry->length = (uint8_t) ( bits / 8 );
+  entry->signBit = isSigned ? ( 1U << ( bits - 1 ) ) : 0;
+  entry->rawScale = rawScale;
+  entry->valueScale = 1.0 / rawScale;
+  entry->mappingEntry = CAN_MAPPING_ENTRY( index, subIndex, bits );
+  entry->operationMode = ( direction == CAN_CHANNELS_OUTPUT ) ? GetOutputOperationMode( index ) : 0;
+  
+  map->entriesNumbersList[ direction ][ pdoType ]++;
+  
+  return true;
+}
+
+// Find mapped object (NULL if it is not mapped on any PDO of given direction)
+static CANChannel* FindMappingEntry( CANChannelsMap* map, int direction, uint16_t index, uint8_t subIndex )
+{
+  for( size_t pdoType = PDO01; pdoType < CAN_FRAME_TYPES_NUMBER; pdoType++ )
+  {
+    for( size_t entryIndex = 0; entryIndex < map->entriesNumbersList[ direction ][ pdoType ]; entryIndex++ )
+    {
+      CANChannel* entry = &(map->entriesList[ direction ][ pdoType ][ entryIndex ]);
+      if( entry->index == index && entry->subIndex == subIndex ) return entry;
+    }
+  }
+  
+  return NULL;
+}
+
+static void AddMappedChannel( CANChannel* channelsList, size_t* ref_channelsNumber, const CANChannel* entry )
+{
+  if( entry == NULL || *ref_channelsNumber >= CAN_CHANNELS_MAX ) return;
+  
+  channelsList[ (*ref_channelsNumber)++ ] = *entry;
+}
+
+// EPOS factory mapping, with channels numbered as the original fixed plug-in ones
+static void LoadDefaultMappings( CANChannelsMap* map, bool* isDefaultList )
+{
+  const size_t INPUT = CAN_CHANNELS_INPUT, OUTPUT = CAN_CHANNELS_OUTPUT;
+  
+  if( isDefaultList[ 0 ] )
+  {
+    AddMappingEntry( map, INPUT, PDO01, 0x6064, 0x00, 32, true, 1.0 );      // Position actual (encoder counts)
+    AddMappingEntry( map, INPUT, PDO01, 0x6078, 0x00, 16, true, 1000.0 );   // Current actual (A)
+    AddMappingEntry( map, INPUT, PDO01, 0x6041, 0x00, 16, false, 1.0 );     // Statusword
+  }
+  if( isDefaultList[ 1 ] )
+  {
+    AddMappingEntry( map, INPUT, PDO02, 0x606C, 0x00, 32, true, 1.0 );      // Velocity actual (rpm)
+    AddMappingEntry( map, INPUT, PDO02, 0x207C, 0x01, 16, false, 1.0 );     // Analog input
+  }
+  if( isDefaultList[ 2 ] )
+  {
+    AddMappingEntry( map, OUTPUT, PDO01, 0x2062, 0x00, 32, true, 1.0 );     // Position mode setting (encoder counts)
+    AddMappingEntry( map, OUTPUT, PDO01, 0x2030, 0x00, 16, true, 1000.0 );  // Current mode setting (A)
+    AddMappingEntry( map, OUTPUT, PDO01, 0x6040, 0x00, 16, false, 1.0 );    // Controlword
+  }
+  if( isDefaultList[ 3 ] )
+  {
+    AddMappingEntry( map, OUTPUT, PDO02, 0x206B, 0x00, 32, true, 1.0 );     // Velocity mode setting (rpm)
+    AddMappingEntry( map, OUTPUT, PDO02, 0x2078, 0x01, 16, false, 1.0 );    // Digital outputs
+  }
+}
+
+// Parse mapping tokens of task configuration and build channel descriptors (false on invalid mapping)
+bool CANChannels_Load( CANChannelsMap* map, const char* config )
+{
+  const char* PDO_NAMES[ 4 ] = { "TPDO1=", "TPDO2=", "RPDO1=", "RPDO2=" };
+  
+  memset( map, 0, sizeof(CANChannelsMap) );
+  
+  bool isDefaultList[ 4 ] = { true, true, true, true };
+  
+  while( config != NULL && *config != '\0' )
+  {
+    while( isspace( (unsigned char) *config ) ) config++;
+    if( *config == '\0' ) break;
+    
+    size_t pdoIndex = 0;
+    while( pdoIndex < 4 && strncmp( config, PDO_NAMES[ pdoIndex ], strlen( PDO_NAMES[ pdoIndex ] ) ) != 0 ) pdoIndex++;
+    if( pdoIndex >= 4 ) return false;
+    
+    int direction = ( pdoIndex < 2 ) ? CAN_CHANNELS_INPUT : CAN_CHANNELS_OUTPUT;
+    enum CANFrameTypes pdoType = PDO01 + pdoIndex % 2;
+    if( !isDefaultList[ pdoIndex ] ) return false;
+    isDefaultList[ pdoIndex ] = false;
+    map->isConfiguredList[ direction ][ pdoType ] = true;
+    
+    char* entryEnd = (char*) config + strlen( PDO_NAMES[ pdoIndex ] );
+    do
+    {
+      const char* entryStart = entryEnd + ( ( *entryEnd == ',' ) ? 1 : 0 );
+      uint16_t index = (uint16_t) strtoul( entryStart, &entryEnd, 16 );
+      if( entryEnd == entryStart || *entryEnd != '.' ) return false;
+      uint8_t subIndex = (uint8_t) strtoul( entryEnd + 1, &entryEnd, 16 );
+      if( *entryEnd != '.' ) return false;
+      bool isSigned = ( *(++entryEnd) != 'u' );
+      unsigned int bits = (unsigned int) strtoul( isSigned ? entryEnd : entryEnd + 1, &entryEnd, 10 );
+      double rawScale = ( *entryEnd == '/' ) ? strtod( entryEnd + 1, &entryEnd ) : 1.0;
+      if( !AddMappingEntry( map, direction, pdoType, index, subIndex, bits, isSigned, rawScale ) ) return false;
+    }
+    while( *entryEnd == ',' );
+    
+    if( *entryEnd != '\0' && !isspace( (unsigned char) *entryEnd ) ) return false;
+    config = entryEnd;
+  }
+  
+  LoadDefaultMappings( map, isDefaultList );
+  
+  CANChannel unmappedEntry = { .pdoType = CAN_FRAME_TYPES_NUMBER };
+  CANChannel* statusWordEntry = FindMappingEntry( map, CAN_CHANNELS_INPUT, CAN_STATUS_WORD_INDEX, 0x00 );
+  CANChannel* controlWordEntry = FindMappingEntry( map, CAN_CHANNELS_OUTPUT, CAN_CONTROL_WORD_INDEX, 0x00 );
+  map->statusWord = ( statusWordEntry != NULL ) ? *statusWordEntry : unmappedEntry;
+  map->controlWord = ( controlWordEntry != NULL ) ? *controlWordEntry : unmappedEntry;
+  
+  bool isDefaultMapping = true;
+  for( size_t pdoIndex = 0; pdoIndex < 4; pdoIndex++ )
+    isDefaultMapping = isDefaultMapping && isDefaultList[ pdoIndex ];
+  
+  if( isDefaultMapping )
+  {
+    const size_t INPUT = CAN_CHANNELS_INPUT, OUTPUT = CAN_CHANNELS_OUTPUT;
+    AddMappedChannel( map->inputsList, &(map->inputsNumber), FindMappingEntry( map, INPUT, 0x6064, 0x00 ) );
+    AddMappedChannel( map->inputsList, &(map->inputsNumber), FindMappingEntry( map, INPUT, 0x606C, 0x00 ) );
+    AddMappedChannel( map->inputsList, &(map->inputsNumber), FindMappingEntry( map, INPUT, 0x6078, 0x00 ) );
+    AddMappedChannel( map->inputsList, &(map->inputsNumber), FindMappingEntry( map, INPUT, 0x207C, 0x01 ) );
+    AddMappedChannel( map->outputsList, &(map->outputsNumber), FindMappingEntry( map, OUTPUT, 0x2062, 0x00 ) );
+    AddMappedChannel( map->outputsList, &(map->outputsNumber), FindMappingEntry( map, OUTPUT, 0x206B, 0x00 ) );
+    AddMappedChannel( map->outputsList, &(map->outputsNumber), FindMappingEntry( map, OUTPUT, 0x2030, 0x00 ) );
+    // Profile position target replaces position setting on RPDO01 while in use
+    AddMappedChannel( map->outputsList, &(map->outputsNumber), FindMappingEntry( map, OUTPUT, 0x2062, 0x00 ) );
+    CANChannel* profileChannel = &(map->outputsList[ map->outputsNumber - 1 ]);
+    profileChannel->index = 0x607A;
+    profileChannel->mappingEntry = CAN_MAPPING_ENTRY( 0x607A, 0x00, 32 );
+    profileChannel->operationMode = GetOutputOperationMode( 0x607A );
+    
+    return true;
+  }
+  
+  for( size_t pdoType = PDO01; pdoType < CAN_FRAME_TYPES_NUMBER; pdoType++ )
+  {
+    for( size_t entryIndex = 0; entryIndex < map->entriesNumbersList[ CAN_CHANNELS_INPUT ][ pdoType ]; entryIndex++ )
+      AddMappedChannel( map->inputsList, &(map->inputsNumber), &(map->entriesList[ CAN_CHANNELS_INPUT ][ pdoType ][ entryIndex ]) );
+  }
+  for( size_t pdoType = PDO01; pdoType < CAN_FRAME_TYPES_NUMBER; pdoType++ )
+  {
+    for( size_t entryIndex = 0; entryIndex < map->entriesNumbersList[ CAN_CHANNELS_OUTPUT ][ pdoType ]; entryIndex++ )
+    {
+      CANChannel* entry = &(map->entriesList[ CAN_CHANNELS_OUTPUT ][ pdoType ][ entryIndex ]);
+      if( entry->index != CAN_CONTROL_WORD_INDEX ) AddMappedChannel( map->outputsList, &(map->outputsNumber), entry );
+    }
+  }
+  
+  return true;
+}
+
+// Queue SDO writes of configured (non default) mappings to the node, going through pre-operational state
+void CANChannels_WriteMapping( CANChannelsMap* map, CANFrame writeFrame, CANFrame readFrame, unsigned int nodeID )
+{
+  const uint16_t MAPPING_INDEXES[ 2 ] = { 0x1A00, 0x1600 };
+  
+  bool isStopped = false;
+  for( int direction = CAN_CHANNELS_INPUT; direction <= CAN_CHANNELS_OUTPUT; direction++ )
+  {
+    for( size_t pdoType = PDO01; pdoType < CAN_FRAME_TYPES_NUMBER; pdoType++ )
+    {
+      if( !map->isConfiguredList[ direction ][ pdoType ] ) continue;
+      
+      if( !isStopped ) CANCommands_WriteNMT( 0x80, nodeID, 0 );
+      isStopped = true;
+      
+      uint16_t mappingIndex = MAPPING_INDEXES[ direction ] + pdoType - PDO01;
+      size_t entriesNumber = map->entriesNumbersList[ direction ][ pdoType ];
+      CANCommands_WriteSingleValue( writeFrame, readFrame, mappingIndex, 0x00, 0, 0, NULL, NULL );
+      for( size_t entryIndex = 0; entryIndex < entriesNumber; entryIndex++ )
+        CANCommands_WriteSingleValue( writeFrame, readFrame, mappingIndex, entryIndex + 1, (int) map->entriesList[ direction ][ pdoType ][ entryIndex ].mappingEntry, 0, NULL, NULL );
+      CANCommands_WriteSingleValue( writeFrame, readFrame, mappingIndex, 0x00, (int) entriesNumber, 0, NULL, NULL );
+    }
+  }
+  
+  if( isStopped ) CANCommands_WriteNMT( 0x01, nodeID, 0 );
+}
+
+// Queue SDO writes replacing the object mapped on the PDO position of an output channel (e.g. for its operation mode)
+void CANChannels_WriteOutputEntry( CANChannelsMap* map, const CANChannel* channel, uint32_t mappingEntry, CANFrame writeFrame, CANFrame readFrame, unsigned int nodeID )
+{
+  uint16_t mappingIndex = 0x1600 + channel->pdoType - PDO01;
+  
+  CANCommands_WriteNMT( 0x80, nodeID, 0 );
+  CANCommands_WriteSingleValue( writeFrame, readFrame, mappingIndex, 0x00, 0, 0, NULL, NULL );
+  CANCommands_WriteSingleValue( writeFrame, readFrame, mappingIndex, channel->entryIndex + 1, (int) mappingEntry, 0, NULL, NULL );
+  CANCommands_WriteSingleValue( writeFrame, readFrame, mappingIndex, 0x00, (int) map->entriesNumbersList[ CAN_CHANNELS_OUTPUT ][ channel->pdoType ], 0, NULL, NULL );
+  CANCommands_WriteNMT( 0x01, nodeID, 0 );
+}
+
+// Load optional rate divisors (from ":<node divisor>:<PDO01 divisor>:<PDO02 divisor>" configuration, following node ID),
+// rounded down to divisors of the schedule period, and reserve least loaded phases for them
+void CANChannels_LoadSchedule( const char* scheduleConfig, unsigned int divisorsList[ CAN_FRAME_TYPES_NUMBER ], unsigned int phasesList[ CAN_FRAME_TYPES_NUMBER ] )
+{
+  char* configEnd = (char*) scheduleConfig;
+  unsigned long nodeDivisor = ( *configEnd == ':' ) ? strtoul( configEnd + 1, &configEnd, 0 ) : 1;
+  for( size_t pdoType = PDO01; pdoType < CAN_FRAME_TYPES_NUMBER; pdoType++ )
+  {
+    unsigned long pdoDivisor = nodeDivisor * ( ( *configEnd == ':' ) ? strtoul( configEnd + 1, &configEnd, 0 ) : 1 );
+    divisorsList[ pdoType ] = CANNetwork_GetScheduleDivisor( pdoDivisor );
+    if( divisorsList[ pdoType ] != pdoDivisor ) DEBUG_PRINT( "PDO%02lu divisor %lu rounded to %u", pdoType, pdoDivisor, divisorsList[ pdoType ] );
+    phasesList[ pdoType ] = CANNetwork_AddScheduledFrame( divisorsList[ pdoType ] );
+  }
+}
+
+// Queue SDO writes making the node TPDO of given type answer every <divisor> SYNCs, starting on the one with counter
+// value of given phase (the start value only changes while the PDO is invalid), or every SYNC for divisor 1
+void CANChannels_WriteSchedule( enum CANFrameTypes pdoType, unsigned int divisor, unsigned int phase, CANFrame writeFrame, CANFrame readFrame, unsigned int nodeID )
+{
+  uint16_t parametersIndex = 0x1800 + pdoType - PDO01;
+  
+  if( divisor > 1 )
+  {
+    uint32_t pdoIdentifier = CAN_FRAME_IDENTIFIERS[ pdoType ][ 0 ] + ( nodeID & 0x7F );
+    CANCommands_WriteSingleValue( writeFrame, readFrame, 0x1019, 0x00, CAN_SCHEDULE_PERIOD, 0, NULL, NULL );
+    CANCommands_WriteSingleValue( writeFrame, readFrame, parametersIndex, 0x01, (int) ( pdoIdentifier | 0x80000000 ), 0, NULL, NULL );
+    CANCommands_WriteSingleValue( writeFrame, readFrame, parametersIndex, 0x06, (int) phase + 1, 0, NULL, NULL );
+    CANCommands_WriteSingleValue( writeFrame, readFrame, parametersIndex, 0x01, (int) pdoIdentifier, 0, NULL, NULL );
+  }
+  
+  CANCommands_WriteSingleValue( writeFrame, readFrame, parametersIndex, 0x02, (int) divisor, 0, NULL, NULL );
+}
+
+// Object mapped by default on the PDO position of an output channel
+uint32_t CANChannels_GetMappedEntry( CANChannelsMap* map, const CANChannel* channel )
+{
+  return map->entriesList[ CAN_CHANNELS_OUTPUT ][ channel->pdoType ][ channel->entryIndex ].mappingEntry;
+}
+
+// Get raw (sign extended) object value from PDO payload
+static inline int64_t CANChannel_Decode( const CANChannel* channel, const uint8_t payload[ 8 ] )
+{
+  uint32_t rawValue = 0;
+  for( size_t byteIndex = 0; byteIndex < channel->length; byteIndex++ )
+    rawValue |= (uint32_t) payload[ channel->offset + byteIndex ] << ( 8 * byteIndex );
+  
+  if( rawValue & channel->signBit ) return (int64_t) rawValue - ( (int64_t) channel->signBit << 1 );
+  
+  return (int64_t) rawValue;
+}
+
+// Set raw object value on PDO payload (little endian, two's complement)
+static inline void CANChannel_Encode( const CANChannel* channel, int64_t rawValue, uint8_t payload[ 8 ] )
+{
+  for( size_t byteIndex = 0; byteIndex < channel->length; byteIndex++ )
+    payload[ channel->offset + byteIndex ] = (uint8_t) ( ( (uint64_t) rawValue >> ( 8 * byteIndex ) ) & 0xFF );
+}
+
+#endif  /* CAN_CHANNELS_H */
@@ -0,0 +1,524 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                      //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>                 //
+//                                                                                      //
+//  This file is part of Signal-IO-NIXNET.                                              //
+//                                                                                      //
+//  Signal-IO-NIXNET is free software: you can redistribute it and/or modify            //
+//  it under the terms of the GNU Lesser General Public License as published            //
+//  by the Free Software Foundation, either version 3 of the License, or                //
+//  (at your option) any later version.                                                 //
+//                                                                                      //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,                 //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of                      //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                        //
+//  GNU Lesser General Public License for more details.                                 //
+//                                                                                      //
+//  You should have received a copy of the GNU Lesser General Public License            //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.            //
+//                                                                                      //
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+// Queue of SDO/NMT commands posted by any thread and executed by the thread driving
+// the network cycle (the one calling CANCommands_Process after each SYNC), so that
+// shared frames are only accessed from a single thread at a time. Commands of each
+// node keep their posting order, but don't wait for (e.g. delayed) ones of other nodes
+
+#ifndef CAN_COMMANDS_H
+#define CAN_COMMANDS_H
+
+#include "can_network.h"
+#include "can_timers.h"
+#include "can_dictionary.h"
+
+#include "timing/timing.h"
+
+#include "debug/data_logging.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <limits.h>
+#include <math.h>
+
+#define CAN_COMMANDS_QUEUE_LENGTH 256       // Must be a power of 2
+#define CAN_COMMANDS_PER_CYCLE 8            // Maximum commands started on each network cycle
+#ifndef CAN_SDO_TIMEOUT
+#define CAN_SDO_TIMEOUT 100                 // Time (in milliseconds) to wait for SDO responses, before any round trip is measured
+#endif
+#ifndef CAN_SDO_TIMEOUT_MIN
+#define CAN_SDO_TIMEOUT_MIN 10              // Bounds (in milliseconds) of adaptive SDO timeouts
+#endif
+#ifndef CAN_SDO_TIMEOUT_MAX
+#define CAN_SDO_TIMEOUT_MAX 1000
+#endif
+#define CAN_SDO_NODES_NUMBER 128
+
+enum CANCommandType { CAN_COMMAND_SDO_WRITE, CAN_COMMAND_SDO_READ, CAN_COMMAND_NMT };
+
+enum CANCommandState { CAN_COMMAND_PENDING, CAN_COMMAND_DONE, CAN_COMMAND_FAILED };
+
+// Completion state storage provided by the caller
+typedef struct _CANCommandFuture
+{
+  int state;
+  int value;
+}
+CANCommandFuture;
+
+typedef void (*CANCommandCallback)( void*, int );    // Value is INT_MIN for failed commands
+
+typedef struct _CANCommand
+{
+  enum CANCommandType type;
+  CANFrame requestFrame, responseFrame;    // SDO writes are not confirmed without response frame
+  uint16_t index;
+  uint8_t subIndex;                        // Node ID for NMT commands
+  int value;                               // Command specifier for NMT commands
+  unsigned long delay;                     // Time (in milliseconds) to wait after previous command completion
+  CANCommandCallback callback;             // Optional, called from the cycle thread on completion
+  void* callbackData;
+  CANCommandFuture* future;                // Optional
+}
+CANCommand;
+
+// Bounded multi-producer/multi-consumer queue (D. Vyukov). Slot sequences are stored
+// relative to their position, so that a zero-initialized queue is already valid
+typedef struct _CANCommandSlot
+{
+  size_t sequence;
+  CANCommand command;
+}
+CANCommandSlot;
+
+typedef struct _CANCommandsQueue
+{
+  CANCommandSlot slotsList[ CAN_COMMANDS_QUEUE_LENGTH ];
+  size_t enqueuePosition, dequeuePosition;
+}
+CANCommandsQueue;
+
+static CANCommandsQueue commandsQueue;
+
+// Commands posted and not completed yet (queued, waiting on their node or executing)
+static size_t activeCommandsNumber = 0;
+// Set while a dedicated thread drives the network cycle, so that waiting threads leave execution to it
+static bool hasCycleThread = false;
+
+enum CANCommandStep { COMMAND_IDLE, COMMAND_DELAYED, COMMAND_AWAITING_RESPONSE };
+
+// State owned by the command executor (only accessed while holding the execution flag)
+static bool isExecutingCommands = false;
+
+// Each node (lane 0 for broadcast NMT) runs one command at a time, so there is a single transaction to track
+// per node. Commands taken from the queue wait for their lane in a shared pool, linked by (1 based) indexes
+typedef struct _CANCommandsLane
+{
+  CANCommand command;
+  enum CANCommandStep step;
+  nxTimestamp_t requestTimestamp;          // Last response frame timestamp before request
+  double requestTime;                      // Request sending time (in seconds), for latency statistics
+  CANTimer timer;
+  size_t firstWaiting, lastWaiting;        // 0 for no waiting commands
+}
+CANCommandsLane;
+
+static CANCommandsLane commandLanesList[ CAN_SDO_NODES_NUMBER ];
+static CANCommand waitingCommandsList[ CAN_COMMANDS_QUEUE_LENGTH ];
+static size_t waitingNextsList[ CAN_COMMANDS_QUEUE_LENGTH ];
+static size_t freeWaitingIndex = 0, unusedWaitingIndex = 0;
+static size_t nextLaneIndex = 0;                   // Round robin start, so that busy nodes don't starve the others
+static bool isBroadcastWaiting = false;            // Broadcast commands wait for all nodes, and all later commands for them
+
+// Per node SDO round trip estimation (as TCP retransmission timeouts, RFC 6298): timeout is smoothed round
+// trip time plus 4 mean deviations, within bounds, and doubled after each expiration until next response
+typedef struct _SDOTiming
+{
+  double smoothedTime, deviationTime;      // In seconds
+  unsigned long timeout;                   // In milliseconds (0 until first measurement, for CAN_SDO_TIMEOUT)
+  bool isMeasured;
+}
+SDOTiming;
+
+static SDOTiming sdoTimingsList[ CAN_SDO_NODES_NUMBER ];
+
+static bool EnqueueCommand( CANCommandsQueue* queue, CANCommand* command )
+{
+  size_t position = __atomic_load_n( &(queue->enqueuePosition), __ATOMIC_RELAXED );
+  while( true )
+  {
+    CANCommandSlot* slot = &(queue->slotsList[ position & ( CAN_COMMANDS_QUEUE_LENGTH - 1 ) ]);
+    size_t sequence = __atomic_load_n( &(slot->sequence), __ATOMIC_ACQUIRE ) + ( position & ( CAN_COMMANDS_QUEUE_LENGTH - 1 ) );
+    intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+    if( difference == 0 )
+    {
+      if( __atomic_compare_exchange_n( &(queue->enqueuePosition), &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+      {
+        slot->command = *command;
+        __atomic_store_n( &(slot->sequence), position + 1 - ( position & ( CAN_COMMANDS_QUEUE_LENGTH - 1 ) ), __ATOMIC_RELEASE );
+        return true;
+      }
+    }
+    else if( difference < 0 )
+    {
+      DEBUG_PRINT( "commands queue full (%u entries)", CAN_COMMANDS_QUEUE_LENGTH );
+      return false;
+    }
+    else
+      position = __atomic_load_n( &(queue->enqueuePosition), __ATOMIC_RELAXED );
+  }
+}
+
+bool CANCommands_Enqueue( CANCommand* command )
+{
+  if( command->future != NULL ) __atomic_store_n( &(command->future->state), CAN_COMMAND_PENDING, __ATOMIC_RELAXED );
+  
+  // Counted before it can be executed (and completed)
+  __atomic_add_fetch( &activeCommandsNumber, 1, __ATOMIC_ACQ_REL );
+  
+  if( EnqueueCommand( &commandsQueue, command ) ) return true;
+  
+  __atomic_sub_fetch( &activeCommandsNumber, 1, __ATOMIC_ACQ_REL );
+  
+  if( command->future != NULL ) __atomic_store_n( &(command->future->state), CAN_COMMAND_FAILED, __ATOMIC_RELEASE );
+  
+  return false;
+}
+
+static bool DequeueCommand( CANCommandsQueue* queue, CANCommand* ref_command )
+{
+  size_t position = __atomic_load_n( &(queue->dequeuePosition), __ATOMIC_RELAXED );
+  while( true )
+  {
+    CANCommandSlot* slot = &(queue->slotsList[ position & ( CAN_COMMANDS_QUEUE_LENGTH - 1 ) ]);
+    size_t sequence = __atomic_load_n( &(slot->sequence), __ATOMIC_ACQUIRE ) + ( position & ( CAN_COMMANDS_QUEUE_LENGTH - 1 ) );
+    intptr_t difference = (intptr_t) sequence - (intptr_t) ( position + 1 );
+    if( difference == 0 )
+    {
+      if( __atomic_compare_exchange_n( &(queue->dequeuePosition), &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+      {
+        *ref_command = slot->command;
+        __atomic_store_n( &(slot->sequence), position + CAN_COMMANDS_QUEUE_LENGTH - ( position & ( CAN_COMMANDS_QUEUE_LENGTH - 1 ) ), __ATOMIC_RELEASE );
+        return true;
+      }
+    }
+    else if( difference < 0 ) 
+      return false;
+    else
+      position = __atomic_load_n( &(queue->dequeuePosition), __ATOMIC_RELAXED );
+  }
+}
+
+// Current SDO response timeout (in milliseconds) for given node
+unsigned long CANCommands_GetSDOTimeout( unsigned int nodeID )
+{
+  unsigned long timeout = __atomic_load_n( &(sdoTimingsList[ nodeID % CAN_SDO_NODES_NUMBER ].timeout), __ATOMIC_RELAXED );
+  
+  return ( timeout > 0 ) ? timeout : CAN_SDO_TIMEOUT;
+}
+
+static void SetSDOTimeout( SDOTiming* timing, double timeout )
+{
+  if( timeout < CAN_SDO_TIMEOUT_MIN ) timeout = CAN_SDO_TIMEOUT_MIN;
+  else if( timeout > CAN_SDO_TIMEOUT_MAX ) timeout = CAN_SDO_TIMEOUT_MAX;
+  
+  __atomic_store_n( &(timing->timeout), (unsigned long) ceil( timeout ), __ATOMIC_RELAXED );
+}
+
+static void UpdateSDOTimeout( unsigned int nodeID, double roundTripTime )
+{
+  SDOTiming* timing = &(sdoTimingsList[ nodeID % CAN_SDO_NODES_NUMBER ]);
+  
+  if( !timing->isMeasured )
+  {
+    timing->smoothedTime = roundTripTime;
+    timing->deviationTime = roundTripTime / 2.0;
+    timing->isMeasured = true;
+  }
+  else
+  {
+    timing->deviationTime += ( fabs( roundTripTime - timing->smoothedTime ) - timing->deviationTime ) / 4.0;
+    timing->smoothedTime += ( roundTripTime - timing->smoothedTime ) / 8.0;
+  }
+  
+  SetSDOTimeout( timing, ( timing->smoothedTime + 4.0 * timing->deviationTime ) * 1000.0 );
+}
+
+static void CompleteCommand( CANCommandsLane* lane, bool success, int value )
+{
+  CANCommand* command = &(lane->command);
+  unsigned int nodeID = (unsigned int) ( lane - commandLanesList );
+  
+  lane->step = COMMAND_IDLE;
+  
+  if( !success ) 
+  {
+    value = INT_MIN;
+    CANMetrics_AddNodeError( nodeID, METRICS_SDO_ERROR );
+  }
+  
+  if( command->type != CAN_COMMAND_NMT ) CAN_PROBE4( sdo_done, nodeID, command->index, command->subIndex, value );
+  
+  if( command->callback != NULL ) command->callback( command->callbackData, value );
+  
+  if( command->future != NULL )
+  {
+    command->future->value = value;
+    __atomic_store_n( &(command->future->state), success ? CAN_COMMAND_DONE : CAN_COMMAND_FAILED, __ATOMIC_RELEASE );
+  }
+  
+  __atomic_sub_fetch( &activeCommandsNumber, 1, __ATOMIC_ACQ_REL );
+}
+
+static void OnCommandTimeout( void* data )
+{
+  CANCommandsLane* lane = (CANCommandsLane*) data;
+  
+  DEBUG_PRINT( "SDO response timeout for object %04X:%02X on frame %s", lane->command.index, lane->command.subIndex, lane->command.requestFrame->id );
+  
+  // Back off, so that a loaded bus does not keep aborting transfers
+  unsigned int nodeID = (unsigned int) ( lane - commandLanesList );
+  SetSDOTimeout( &(sdoTimingsList[ nodeID ]), 2.0 * CANCommands_GetSDOTimeout( nodeID ) );
+  
+  CompleteCommand( lane, false, 0 );
+}
+
+static void ExecuteCommand( CANCommandsLane* lane )
+{
+  CANCommand* command = &(lane->command);
+  unsigned int nodeID = (unsigned int) ( lane - commandLanesList );
+  
+  if( command->type == CAN_COMMAND_NMT )
+  {
+    CANNetwork_WriteNMT( (uint8_t) command->value, command->subIndex );
+    CAN_PROBE2( nmt_sent, command->value, command->subIndex );
+    CompleteCommand( lane, true, command->value );
+    return;
+  }
+  
+  if( command->responseFrame != NULL )
+  {
+    // Responses are told apart from older frames by their reception time
+    u8 payload[ 8 ];
+    CANFrame_Read( command->responseFrame, payload );
+    lane->requestTimestamp = CANFrame_GetTimestamp( command->responseFrame );
+  }
+  
+  CAN_PROBE4( sdo_start, nodeID, command->index, command->subIndex, ( command->type == CAN_COMMAND_SDO_READ ) );
+  if( command->type == CAN_COMMAND_SDO_WRITE )
+    CANNetwork_WriteSingleValue( command->requestFrame, command->index, command->subIndex, command->value );
+  else
+    CANNetwork_RequestSingleValue( command->requestFrame, command->index, command->subIndex );
+  
+  if( command->responseFrame == NULL )
+  {
+    CompleteCommand( lane, true, command->value );
+    return;
+  }
+  
+  lane->requestTime = Time_GetExecSeconds();
+  lane->step = COMMAND_AWAITING_RESPONSE;
+  CANTimers_Start( &(lane->timer), CANCommands_GetSDOTimeout( nodeID ), OnCommandTimeout, lane );
+}
+
+static void OnCommandDelay( void* data )
+{
+  ExecuteCommand( (CANCommandsLane*) data );
+}
+
+// Check lane command response frame only (no pending transactions list to go through)
+static void CheckCommandResponse( CANCommandsLane* lane )
+{
+  static u8 payload[ 8 ];
+  
+  CANCommand* command = &(lane->command);
+  unsigned int nodeID = (unsigned int) ( lane - commandLanesList );
+  
+  CANFrame_Read( command->responseFrame, payload );
+  if( CANFrame_GetTimestamp( command->responseFrame ) == lane->requestTimestamp ) return;
+  lane->requestTimestamp = CANFrame_GetTimestamp( command->responseFrame );
+  
+  uint16_t index = payload[ 2 ] * 0x100 + payload[ 1 ];
+  if( index != command->index || payload[ 3 ] != command->subIndex ) return;
+  
+  CANTimers_Cancel( &(lane->timer) );
+  
+  double roundTripTime = Time_GetExecSeconds() - lane->requestTime;
+  CANMetrics_AddSDOLatency( nodeID, roundTripTime );
+  UpdateSDOTimeout( nodeID, roundTripTime );
+  
+  int value = payload[ 7 ] * 0x1000000 + payload[ 6 ] * 0x10000 + payload[ 5 ] * 0x100 + payload[ 4 ];
+  if( payload[ 0 ] == 0x80 )
+  {
+    DEBUG_PRINT( "SDO abort (code %08X) for object %04X:%02X on frame %s", value, index, payload[ 3 ], command->requestFrame->id );
+    CompleteCommand( lane, false, 0 );
+    return;
+  }
+  
+  if( command->type == CAN_COMMAND_SDO_WRITE ) value = command->value;
+  
+  CANDictionary_SetValue( nodeID, CANDictionary_GetSlot( index, payload[ 3 ] ), value );
+  
+  CompleteCommand( lane, true, value );
+}
+
+// Move queued commands behind earlier ones of their nodes, while there is room for them
+static void TakeQueuedCommands()
+{
+  while( !isBroadcastWaiting )
+  {
+    size_t waitingIndex = freeWaitingIndex;
+    if( waitingIndex == 0 && unusedWaitingIndex >= CAN_COMMANDS_QUEUE_LENGTH ) return;
+    
+    CANCommand* command = &(waitingCommandsList[ ( waitingIndex > 0 ) ? waitingIndex - 1 : unusedWaitingIndex ]);
+    if( !DequeueCommand( &commandsQueue, command ) ) return;
+    
+    if( waitingIndex > 0 ) freeWaitingIndex = waitingNextsList[ waitingIndex - 1 ];
+    else waitingIndex = ++unusedWaitingIndex;
+    
+    unsigned int nodeID = ( command->type == CAN_COMMAND_NMT ) ? command->subIndex : CANNetwork_GetFrameNode( command->requestFrame );
+    CANCommandsLane* lane = &(commandLanesList[ nodeID % CAN_SDO_NODES_NUMBER ]);
+    
+    waitingNextsList[ waitingIndex - 1 ] = 0;
+    if( lane->lastWaiting > 0 ) waitingNextsList[ lane->lastWaiting - 1 ] = waitingIndex;
+    else lane->firstWaiting = waitingIndex;
+    lane->lastWaiting = waitingIndex;
+    
+    if( nodeID == 0 ) isBroadcastWaiting = true;
+  }
+}
+
+// Start next waiting command of lane, after its delay if any
+static void StartCommand( CANCommandsLane* lane )
+{
+  size_t waitingIndex = lane->firstWaiting;
+  lane->command = waitingCommandsList[ waitingIndex - 1 ];
+  lane->firstWaiting = waitingNextsList[ waitingIndex - 1 ];
+  if( lane->firstWaiting == 0 ) lane->lastWaiting = 0;
+  
+  waitingNextsList[ waitingIndex - 1 ] = freeWaitingIndex;
+  freeWaitingIndex = waitingIndex;
+  
+  if( lane->command.delay > 0 )
+  {
+    lane->step = COMMAND_DELAYED;
+    CANTimers_Start( &(lane->timer), lane->command.delay, OnCommandDelay, lane );
+  }
+  else
+    ExecuteCommand( lane );
+}
+
+// Advance command timers and execute queued commands (returns immediately if another thread is doing it)
+void CANCommands_Process()
+{
+  if( __atomic_exchange_n( &isExecutingCommands, true, __ATOMIC_ACQUIRE ) ) return;
+  
+  if( __atomic_load_n( &activeCommandsNumber, __ATOMIC_ACQUIRE ) == 0 )
+  {
+    CANTimers_Update();
+    __atomic_store_n( &isExecutingCommands, false, __ATOMIC_RELEASE );
+    return;
+  }
+  
+  // Responses already received take precedence over their (possibly late checked) timeouts
+  for( size_t laneIndex = 0; laneIndex < CAN_SDO_NODES_NUMBER; laneIndex++ )
+  {
+    if( commandLanesList[ laneIndex ].step == COMMAND_AWAITING_RESPONSE ) CheckCommandResponse( &(commandLanesList[ laneIndex ]) );
+  }
+  
+  CANTimers_Update();
+  
+  TakeQueuedCommands();
+  
+  size_t commandsCount = 0;
+  bool isNodeBusy = false;
+  for( size_t laneCount = 0; laneCount < CAN_SDO_NODES_NUMBER - 1; laneCount++ )
+  {
+    size_t laneIndex = 1 + ( nextLaneIndex + laneCount ) % ( CAN_SDO_NODES_NUMBER - 1 );
+    CANCommandsLane* lane = &(commandLanesList[ laneIndex ]);
+    // Keep posting order: later commands of the node wait for the current one
+    while( lane->step == COMMAND_IDLE && lane->firstWaiting > 0 && commandsCount < CAN_COMMANDS_PER_CYCLE )
+    {
+      StartCommand( lane );
+      nextLaneIndex = laneIndex;
+      commandsCount++;
+      if( lane->step == COMMAND_AWAITING_RESPONSE ) CheckCommandResponse( lane );
+    }
+    if( lane->step != COMMAND_IDLE || lane->firstWaiting > 0 ) isNodeBusy = true;
+  }
+  
+  // Broadcast commands run alone
+  CANCommandsLane* broadcastLane = &(commandLanesList[ 0 ]);
+  if( !isNodeBusy && broadcastLane->step == COMMAND_IDLE && broadcastLane->firstWaiting > 0 ) StartCommand( broadcastLane );
+  if( broadcastLane->step == COMMAND_IDLE && broadcastLane->firstWaiting == 0 && isBroadcastWaiting ) 
+  {
+    isBroadcastWaiting = false;
+    TakeQueuedCommands();
+  }
+  
+  __atomic_store_n( &isExecutingCommands, false, __ATOMIC_RELEASE );
+}
+
+bool CANCommands_IsEmpty()
+{
+  return ( __atomic_load_n( &activeCommandsNumber, __ATOMIC_ACQUIRE ) == 0 );
+}
+
+// Tell whether a dedicated thread calls CANCommands_Process on each cycle. While it does, other
+// threads only wait for their commands, so that bus access doesn't leave it
+void CANCommands_SetCycleThread( bool isRunning )
+{
+  __atomic_store_n( &hasCycleThread, isRunning, __ATOMIC_RELEASE );
+}
+
+// Execute all queued commands (e.g. on shutdown, when no thread may be driving the network cycle)
+void CANCommands_Flush()
+{
+  while( !CANCommands_IsEmpty() )
+  {
+    if( !__atomic_load_n( &hasCycleThread, __ATOMIC_ACQUIRE ) ) CANCommands_Process();
+    if( !CANCommands_IsEmpty() ) Time_Delay( 1 );
+  }
+}
+
+// Wait for command completion, executing queued commands if no cycle thread does (timeout in milliseconds)
+bool CANCommands_Wait( CANCommandFuture* future, unsigned long timeout )
+{
+  unsigned long waitStartTime = Time_GetExecMilliseconds();
+  
+  while( __atomic_load_n( &(future->state), __ATOMIC_ACQUIRE ) == CAN_COMMAND_PENDING )
+  {
+    if( Time_GetExecMilliseconds() - waitStartTime >= timeout ) return false;
+    if( !__atomic_load_n( &hasCycleThread, __ATOMIC_ACQUIRE ) ) CANCommands_Process();
+    if( __atomic_load_n( &(future->state), __ATOMIC_ACQUIRE ) == CAN_COMMAND_PENDING ) Time_Delay( 1 );
+  }
+  
+  return ( future->state == CAN_COMMAND_DONE );
+}
+
+bool CANCommands_WriteSingleValue( CANFrame writeFrame, CANFrame readFrame, uint16_t index, uint8_t subIndex, int value, unsigned long delay, 
+                                   CANCommandCallback callback, void* callbackData )
+{
+  CANCommand command = { .type = CAN_COMMAND_SDO_WRITE, .requestFrame = writeFrame, .responseFrame = readFrame, .index = index, .subIndex = subIndex, .value = value, .delay = delay,
+                         .callback = callback, .callbackData = callbackData };
+  
+  return CANCommands_Enqueue( &command );
+}
+
+bool CANCommands_ReadSingleValue( CANFrame requestFrame, CANFrame readFrame, uint16_t index, uint8_t subIndex, CANCommandCallback callback, void* callbackData, CANCommandFuture* future )
+{
+  CANCommand command = { .type = CAN_COMMAND_SDO_READ, .requestFrame = requestFrame, .responseFrame = readFrame, .index = index, .subIndex = subIndex,
+                         .callback = callback, .callbackData = callbackData, .future = future };
+  
+  return CANCommands_Enqueue( &command );
+}
+
+bool CANCommands_WriteNMT( uint8_t commandSpecifier, uint8_t nodeID, unsigned long delay )
+{
+  CANCommand command = { .type = CAN_COMMAND_NMT, .subIndex = nodeID, .value = commandSpecifier, .delay = delay };
+  
+  return CANCommands_Enqueue( &command );
+}
+
+#endif  /* CAN_COMMANDS_H */
@@ -0,0 +1,121 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                      //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>                 //
+//                                                                                      //
+//  This file is part of Signal-IO-NIXNET.                                              //
+//                                                                                      //
+//  Signal-IO-NIXNET is free software: you can redistribute it and/or modify            //
+//  it under the terms of the GNU Lesser General Public License as published            //
+//  by the Free Software Foundation, either version 3 of the License, or                //
+//  (at your option) any later version.                                                 //
+//                                                                                      //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,                 //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of                      //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                        //
+//  GNU Lesser General Public License for more details.                                 //
+//                                                                                      //
+//  You should have received a copy of the GNU Lesser General Public License            //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.            //
+//                                                                                      //
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+// Per node cache of well known CANopen (CiA 301/402 and EPOS specific) object values, 
+// updated from SDO responses and decoded TPDO statuswords, so that other threads get
+// them without an SDO round trip. Objects are placed by a perfect hash computed at
+// compile time, so a lookup is one multiplication plus a key comparison
+
+#ifndef CAN_DICTIONARY_H
+#define CAN_DICTIONARY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// X( name, index, subIndex )
+#define CAN_DICTIONARY_OBJECTS( X ) \
+  X( CONTROL_WORD, 0x6040, 0x00 ) \
+  X( STATUS_WORD, 0x6041, 0x00 ) \
+  X( OPERATION_MODE, 0x6060, 0x00 ) \
+  X( OPERATION_MODE_DISPLAY, 0x6061, 0x00 ) \
+  X( POSITION_ACTUAL, 0x6064, 0x00 ) \
+  X( VELOCITY_ACTUAL, 0x606C, 0x00 ) \
+  X( CURRENT_ACTUAL, 0x6078, 0x00 ) \
+  X( TARGET_POSITION, 0x607A, 0x00 ) \
+  X( PROFILE_VELOCITY, 0x6081, 0x00 ) \
+  X( PROFILE_ACCELERATION, 0x6083, 0x00 ) \
+  X( PROFILE_DECELERATION, 0x6084, 0x00 ) \
+  X( POSITION_SETTING, 0x2062, 0x00 ) \
+  X( VELOCITY_SETTING, 0x206B, 0x00 ) \
+  X( CURRENT_SETTING, 0x2030, 0x00 ) \
+  X( ANALOG_INPUT, 0x207C, 0x01 ) \
+  X( DIGITAL_OUTPUTS, 0x2078, 0x01 )
+
+#define CAN_DICTIONARY_BITS 5
+#define CAN_DICTIONARY_SIZE ( 1 << CAN_DICTIONARY_BITS )
+// Found by search for the objects list above. If a new object collides with another,
+// compilation of CANDictionary_GetSlot fails (duplicate case value) and it must be replaced
+#define CAN_DICTIONARY_MULTIPLIER 0x9A9A80FDU
+
+#define CAN_DICTIONARY_NODES_NUMBER 128
+
+#define CAN_DICTIONARY_KEY( index, subIndex ) ( ( (uint32_t) (index) << 8 ) | (uint32_t) (subIndex) )
+#define CAN_DICTIONARY_HASH( key ) ( (uint32_t) ( (uint32_t) (key) * CAN_DICTIONARY_MULTIPLIER ) >> ( 32 - CAN_DICTIONARY_BITS ) )
+#define CAN_DICTIONARY_SLOT( index, subIndex ) CAN_DICTIONARY_HASH( CAN_DICTIONARY_KEY( index, subIndex ) )
+
+#define CAN_DICTIONARY_ENUM( name, index, subIndex ) OD_##name = CAN_DICTIONARY_SLOT( index, subIndex ),
+enum CANDictionaryObject { CAN_DICTIONARY_OBJECTS( CAN_DICTIONARY_ENUM ) };
+
+typedef struct _CANDictionaryCache
+{
+  int32_t valuesList[ CAN_DICTIONARY_SIZE ];
+  uint32_t validMask;
+}
+CANDictionaryCache;
+
+static CANDictionaryCache dictionaryCachesList[ CAN_DICTIONARY_NODES_NUMBER ];
+
+#define CAN_DICTIONARY_CASE( name, index, subIndex ) case OD_##name: return ( key == CAN_DICTIONARY_KEY( index, subIndex ) ) ? OD_##name : -1;
+// Get cache slot of given object (-1 if it is not a known object)
+int CANDictionary_GetSlot( uint16_t index, uint8_t subIndex )
+{
+  uint32_t key = CAN_DICTIONARY_KEY( index, subIndex );
+  
+  switch( CAN_DICTIONARY_HASH( key ) )
+  {
+    CAN_DICTIONARY_OBJECTS( CAN_DICTIONARY_CASE )
+    default: return -1;
+  }
+}
+
+// Store object value for node (objects are given by enum CANDictionaryObject)
+void CANDictionary_SetValue( unsigned int nodeID, int slot, int32_t value )
+{
+  if( nodeID >= CAN_DICTIONARY_NODES_NUMBER || slot < 0 ) return;
+  
+  __atomic_store_n( &(dictionaryCachesList[ nodeID ].valuesList[ slot ]), value, __ATOMIC_RELEASE );
+  // Values are mostly refreshed, so the read-modify-write is only needed for their first store
+  if( !( __atomic_load_n( &(dictionaryCachesList[ nodeID ].validMask), __ATOMIC_RELAXED ) & ( 1U << slot ) ) )
+    __atomic_or_fetch( &(dictionaryCachesList[ nodeID ].validMask), 1U << slot, __ATOMIC_RELEASE );
+}
+
+// Get last known object value for node (false if none was received or written yet)
+bool CANDictionary_GetValue( unsigned int nodeID, int slot, int32_t* ref_value )
+{
+  if( nodeID >= CAN_DICTIONARY_NODES_NUMBER || slot < 0 ) return false;
+  
+  if( !( __atomic_load_n( &(dictionaryCachesList[ nodeID ].validMask), __ATOMIC_ACQUIRE ) & ( 1U << slot ) ) ) return false;
+  
+  *ref_value = __atomic_load_n( &(dictionaryCachesList[ nodeID ].valuesList[ slot ]), __ATOMIC_RELAXED );
+  
+  return true;
+}
+
+// Forget cached values of node (e.g. after its reset)
+void CANDictionary_Clear( unsigned int nodeID )
+{
+  if( nodeID >= CAN_DICTIONARY_NODES_NUMBER ) return;
+  
+  __atomic_store_n( &(dictionaryCachesList[ nodeID ].validMask), 0, __ATOMIC_RELEASE );
+}
+
+#endif  /* CAN_DICTIONARY_H */
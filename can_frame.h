@@ -28,12 +28,20 @@
   #include <nixnet.h>
 #elif NIXNET
   #include "nixnet.h"
+#elif NIXNET_SHM
+  #include "nixnet_shm.h"
 #else
   #include "nixnet_stub.h"
 #endif
 
+#include "can_capture.h"
+#include "can_metrics.h"
+#include "can_probes.h"
+
 #include "debug/data_logging.h"
 
+#include <stdbool.h>
+
 #define CAN_FRAME_ID_MAX_SIZE 16
 
 enum CANFrameMode { FRAME_IN = nxMode_FrameInSinglePoint, FRAME_OUT = nxMode_FrameOutSinglePoint };
@@ -43,6 +51,9 @@ typedef struct _CANFrameData
 {
   nxSessionRef_t ref_session;
   char id[ CAN_FRAME_ID_MAX_SIZE ];
+  int key;
+  u32 identifier;                  // CANopen identifier (COB-ID), as written frames get theirs from the database
+  u8 length;                       // Written payload length
   u8 flags;
   u8 type;
   u8 buffer[ sizeof(nxFrameVar_t) ];
@@ -64,9 +75,14 @@ static void PrintFrameStatus( nxStatus_t statusCode, const char* frameID, const
 CANFrame CANFrame_Init( enum CANFrameMode mode, const char* interfaceName, const char* databaseName, const char* clusterName, const char* frameID )
 {
   CANFrame frame = (CANFrame) malloc( sizeof(CANFrameData) );
+  if( frame == NULL ) return NULL;
 
   frame->flags = 0;
+  frame->key = 0;
+  frame->identifier = 0;
+  frame->length = 8;
   frame->type = nxFrameType_CAN_Data;	//MACRO
+  memset( frame->buffer, 0, sizeof(frame->buffer) );
 
   strcpy( frame->id, frameID );
   
@@ -79,6 +95,7 @@ CANFrame CANFrame_Init( enum CANFrameMode mode, const char* interfaceName, const
     DEBUG_PRINT( "error: %x", statusCode );
     PrintFrameStatus( statusCode, frameID, "(nxCreateSession)" );
     nxClear( frame->ref_session );
+    free( frame );
     return NULL;
   }
   
@@ -103,12 +120,44 @@ void CANFrame_Read( CANFrame frame, u8 payload[8] )
   nxFrameVar_t* ptr_frame = (nxFrameVar_t*) frame->buffer;
 
   u32 temp;
+  
+  nxTimestamp_t lastTimestamp = ptr_frame->Timestamp;
     
+  CAN_PROBE1( frame_read_start, frame->key );
   nxStatus_t statusCode = nxReadFrame( frame->ref_session, frame->buffer, sizeof(frame->buffer), 0, &temp );   
+  CAN_PROBE3( frame_read_done, frame->key, statusCode, ptr_frame->Timestamp );
   if( statusCode != nxSuccess )
+  {
     PrintFrameStatus( statusCode, frame->id, "(nxReadFrame)" );
+    CANMetrics_AddNodeError( frame->key & 0xFF, METRICS_FRAME_ERROR );
+  }
   else
+  {
     memcpy( payload, ptr_frame->Payload, sizeof(u8) * ptr_frame->PayloadLength );
+    // Capture and count only newly received frames
+    if( ptr_frame->Timestamp != lastTimestamp ) 
+    {
+      CANCapture_Append( ptr_frame->Timestamp, ptr_frame->Identifier, CAPTURE_RX, ptr_frame->Payload, ptr_frame->PayloadLength );
+      CANMetrics_AddFrame( frame->key & 0xFF, false );
+    }
+  }
+}
+
+// Reception time (in 100 ns units) of last frame read from CAN frame (0 if nothing was received yet)
+nxTimestamp_t CANFrame_GetTimestamp( CANFrame frame )
+{
+  return ((nxFrameVar_t*) frame->buffer)->Timestamp;
+}
+
+// Current interface time (in the same 100 ns units and base of frame timestamps)
+nxTimestamp_t CANFrame_GetCurrentTime( CANFrame frame )
+{
+  nxTimestamp_t currentTime = 0;
+  
+  nxStatus_t statusCode = nxReadState( frame->ref_session, nxState_TimeCurrent, sizeof(nxTimestamp_t), &currentTime, NULL );
+  if( statusCode != nxSuccess ) PrintFrameStatus( statusCode, frame->id, "(nxReadState)" );
+  
+  return currentTime;
 }
 
 // Write data from payload to CAN frame
@@ -118,17 +167,43 @@ void CANFrame_Write( CANFrame frame, u8 payload[8] )
   
   ptr_frame->Timestamp = 0;
   ptr_frame->Flags = frame->flags;
-  ptr_frame->Identifier = 66; 
+  ptr_frame->Identifier = frame->identifier;
   ptr_frame->Type = frame->type;
-  ptr_frame->PayloadLength= 8;
+  ptr_frame->PayloadLength= frame->length;
 
   memcpy( ptr_frame->Payload, payload, sizeof(u8) * ptr_frame->PayloadLength );
 
   //DEBUG_EVENT( 1,  "trying to write with session %u", frame->ref_session );
   
+  CAN_PROBE1( frame_write_start, frame->key );
   nxStatus_t statusCode = nxWriteFrame( frame->ref_session, &(frame->buffer), sizeof(nxFrameVar_t), 0.0 );
+  CAN_PROBE2( frame_write_done, frame->key, statusCode );
   if( statusCode != nxSuccess )
+  {
     PrintFrameStatus( statusCode, frame->id, "(nxWriteFrame)" );
+    CANMetrics_AddNodeError( frame->key & 0xFF, METRICS_FRAME_ERROR );
+  }
+  else
+  {
+    // Written frames have no reception timestamp: take interface time when they are queued
+    if( CANCapture_IsActive() ) CANCapture_Append( CANFrame_GetCurrentTime( frame ), frame->identifier, CAPTURE_TX, ptr_frame->Payload, ptr_frame->PayloadLength );
+    CANMetrics_AddFrame( frame->key & 0xFF, true );
+  }
+}
+
+// Wait (up to timeout seconds) for frames written to CAN frame to be transmitted on the bus
+bool CANFrame_WaitTransmit( CANFrame frame, double timeout )
+{
+  u32 temp;
+  
+  nxStatus_t statusCode = nxWait( frame->ref_session, nxCondition_TransmitComplete, 0, timeout, &temp );
+  if( statusCode != nxSuccess )
+  {
+    PrintFrameStatus( statusCode, frame->id, "(nxWait)" );
+    return false;
+  }
+  
+  return true;
 }
 
 #endif	/* CAN_FRAME_H */
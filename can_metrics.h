@@ -0,0 +1,447 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                      //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>                 //
+//                                                                                      //
+//  This file is part of Signal-IO-NIXNET.                                              //
+//                                                                                      //
+//  Signal-IO-NIXNET is free software: you can redistribute it and/or modify            //
+//  it under the terms of the GNU Lesser General Public License as published            //
+//  by the Free Software Foundation, either version 3 of the License, or                //
+//  (at your option) any later version.                                                 //
+//                                                                                      //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,                 //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of                      //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                        //
+//  GNU Lesser General Public License for more details.                                 //
+//                                                                                      //
+//  You should have received a copy of the GNU Lesser General Public License            //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.            //
+//                                                                                      //
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+// Health counters updated with relaxed atomic operations only (no locks on the control
+// loop), and an optional exporter thread serving them in Prometheus text exposition format:
+// on a Unix domain socket (NIXNET_METRICS_SOCKET, one snapshot per connection) or on a text
+// file rewritten every CAN_METRICS_FILE_CYCLES network cycles (NIXNET_METRICS_FILE)
+
+#ifndef CAN_METRICS_H
+#define CAN_METRICS_H
+
+#include "timing/timing.h"
+#include "threads/threading.h"
+#include "threads/semaphores.h"
+
+#include "debug/data_logging.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __unix__
+  #include <unistd.h>
+  #include <sys/socket.h>
+  #include <sys/un.h>
+  #include <sys/resource.h>
+#endif
+
+#define CAN_METRICS_NODES_NUMBER 128
+#define CAN_METRICS_LATENCY_BUCKETS 32          // Log2 buckets of microseconds
+#define CAN_METRICS_FILE_CYCLES 1000
+#define CAN_METRICS_BUFFER_LENGTH 32768
+#ifndef CAN_METRICS_OVERRUN_TIME
+#define CAN_METRICS_OVERRUN_TIME 0.002          // Cycles (time between SYNCs, in seconds) longer than this are overruns
+#endif
+#ifndef CAN_METRICS_BIT_RATE
+#define CAN_METRICS_BIT_RATE 1000000.0
+#endif
+#define CAN_METRICS_FRAME_BITS 135              // Worst case (stuffed) length of 8 bytes data frames
+
+#define CAN_METRICS_ALL_NODES CAN_METRICS_NODES_NUMBER   // Node ID for network wide totals
+
+#define CAN_METRICS_TPDOS_NUMBER 2              // Response times are kept for first TPDOs of each node only
+
+enum CANMetricsNodeError { METRICS_FRAME_ERROR, METRICS_SDO_ERROR, METRICS_NODE_ERRORS_NUMBER };
+
+// Count, total, minimum and maximum of durations (in microseconds), updated by a single thread
+typedef struct _CANMetricsTimes
+{
+  uint64_t count, totalTime, minTime, maxTime;
+}
+CANMetricsTimes;
+
+static struct
+{
+  uint64_t cyclesCount;
+  uint64_t overrunsCount;
+  uint64_t barrierTimeoutsCount;
+  uint64_t staleSamplesCount;                                          // Measures updates without new TPDO data, of all devices
+  uint64_t cycleTimesList[ CAN_METRICS_LATENCY_BUCKETS ];
+  CANMetricsTimes cycleTimes;
+  uint64_t framesCount[ 2 ];                                           // Received and transmitted
+  uint64_t nodeFramesCount[ CAN_METRICS_NODES_NUMBER ][ 2 ];
+  uint64_t nodeErrorsCount[ CAN_METRICS_NODES_NUMBER ][ METRICS_NODE_ERRORS_NUMBER ];
+  CANMetricsTimes nodeSDOTimes[ CAN_METRICS_NODES_NUMBER + 1 ];       // Last one for all nodes
+  CANMetricsTimes nodeResponseTimes[ CAN_METRICS_NODES_NUMBER ][ CAN_METRICS_TPDOS_NUMBER ];   // From SYNC to TPDO reception
+}
+metrics;
+
+static double metricsLastCycleTime = -1.0;       // Only accessed by the thread driving the network cycle
+
+static bool isExportingMetrics = false;
+static Thread metricsThread = THREAD_INVALID_HANDLE;
+static Semaphore metricsEvent = NULL;
+static const char* metricsFilePath = NULL;
+static int metricsSocket = -1;
+static double lastExportTime = -1.0;
+
+#define METRICS_ADD( counter ) __atomic_add_fetch( &(counter), 1, __ATOMIC_RELAXED )
+#define METRICS_GET( counter ) __atomic_load_n( &(counter), __ATOMIC_RELAXED )
+
+void CANMetrics_AddTime( CANMetricsTimes* times, double duration )
+{
+  uint64_t durationUS = (uint64_t) ( duration * 1000000.0 );
+  
+  if( times->count == 0 || durationUS < times->minTime ) __atomic_store_n( &(times->minTime), durationUS, __ATOMIC_RELAXED );
+  if( durationUS > times->maxTime ) __atomic_store_n( &(times->maxTime), durationUS, __ATOMIC_RELAXED );
+  __atomic_add_fetch( &(times->totalTime), durationUS, __ATOMIC_RELAXED );
+  METRICS_ADD( times->count );
+}
+
+// Get durations count and minimum, average and maximum durations (in seconds)
+uint64_t CANMetrics_GetTimes( CANMetricsTimes* times, double* ref_minTime, double* ref_averageTime, double* ref_maxTime )
+{
+  uint64_t count = METRICS_GET( times->count );
+  
+  *ref_minTime = METRICS_GET( times->minTime ) / 1000000.0;
+  *ref_averageTime = ( count > 0 ) ? METRICS_GET( times->totalTime ) / 1000000.0 / count : 0.0;
+  *ref_maxTime = METRICS_GET( times->maxTime ) / 1000000.0;
+  
+  return count;
+}
+
+// Register start of a network cycle (SYNC)
+void CANMetrics_AddCycle()
+{
+  double cycleTime = Time_GetExecSeconds();
+
+  if( metricsLastCycleTime >= 0.0 )
+  {
+    double cycleLength = cycleTime - metricsLastCycleTime;
+    uint64_t cycleLengthUS = (uint64_t) ( cycleLength * 1000000.0 );
+    size_t bucketIndex = ( cycleLengthUS > 0 ) ? 63 - __builtin_clzll( cycleLengthUS ) : 0;
+    if( bucketIndex >= CAN_METRICS_LATENCY_BUCKETS ) bucketIndex = CAN_METRICS_LATENCY_BUCKETS - 1;
+    METRICS_ADD( metrics.cycleTimesList[ bucketIndex ] );
+    if( cycleLength > CAN_METRICS_OVERRUN_TIME ) METRICS_ADD( metrics.overrunsCount );
+    CANMetrics_AddTime( &(metrics.cycleTimes), cycleLength );
+  }
+  metricsLastCycleTime = cycleTime;
+
+  uint64_t cyclesCount = METRICS_ADD( metrics.cyclesCount );
+
+  if( metricsFilePath != NULL && cyclesCount % CAN_METRICS_FILE_CYCLES == 0 ) Semaphores.Increment( metricsEvent );
+}
+
+void CANMetrics_AddBarrierTimeout()
+{
+  METRICS_ADD( metrics.barrierTimeoutsCount );
+}
+
+void CANMetrics_AddStaleSample()
+{
+  METRICS_ADD( metrics.staleSamplesCount );
+}
+
+uint64_t CANMetrics_GetStaleSamplesCount()
+{
+  return METRICS_GET( metrics.staleSamplesCount );
+}
+
+void CANMetrics_AddFrame( unsigned int nodeID, bool isTransmitted )
+{
+  METRICS_ADD( metrics.framesCount[ isTransmitted ? 1 : 0 ] );
+  if( nodeID < CAN_METRICS_NODES_NUMBER ) METRICS_ADD( metrics.nodeFramesCount[ nodeID ][ isTransmitted ? 1 : 0 ] );
+}
+
+void CANMetrics_AddNodeError( unsigned int nodeID, enum CANMetricsNodeError error )
+{
+  if( nodeID < CAN_METRICS_NODES_NUMBER && error < METRICS_NODE_ERRORS_NUMBER ) METRICS_ADD( metrics.nodeErrorsCount[ nodeID ][ error ] );
+}
+
+// Register time (in seconds) between SDO request and response (called from commands executor only)
+void CANMetrics_AddSDOLatency( unsigned int nodeID, double latency )
+{
+  if( nodeID < CAN_METRICS_NODES_NUMBER ) CANMetrics_AddTime( &(metrics.nodeSDOTimes[ nodeID ]), latency );
+  CANMetrics_AddTime( &(metrics.nodeSDOTimes[ CAN_METRICS_ALL_NODES ]), latency );
+}
+
+// Register time (in seconds) between SYNC transmission and reception of the TPDO answering it (called from the node reader only)
+void CANMetrics_AddResponseTime( unsigned int nodeID, unsigned int pdoIndex, double responseTime )
+{
+  if( nodeID < CAN_METRICS_NODES_NUMBER && pdoIndex < CAN_METRICS_TPDOS_NUMBER ) CANMetrics_AddTime( &(metrics.nodeResponseTimes[ nodeID ][ pdoIndex ]), responseTime );
+}
+
+// Get responses count and minimum, average and maximum response times (in seconds) of given node TPDO
+uint64_t CANMetrics_GetTPDOResponseTimes( unsigned int nodeID, unsigned int pdoIndex, double* ref_minTime, double* ref_averageTime, double* ref_maxTime )
+{
+  if( nodeID >= CAN_METRICS_NODES_NUMBER || pdoIndex >= CAN_METRICS_TPDOS_NUMBER ) return 0;
+  
+  return CANMetrics_GetTimes( &(metrics.nodeResponseTimes[ nodeID ][ pdoIndex ]), ref_minTime, ref_averageTime, ref_maxTime );
+}
+
+// Get TPDO responses count and minimum, average and maximum response times (in seconds) of given node (or all of them, for CAN_METRICS_ALL_NODES)
+uint64_t CANMetrics_GetResponseTimes( unsigned int nodeID, double* ref_minTime, double* ref_averageTime, double* ref_maxTime )
+{
+  CANMetricsTimes responseTimes = { 0 };
+  for( size_t responseNodeID = 0; responseNodeID < CAN_METRICS_NODES_NUMBER; responseNodeID++ )
+  {
+    if( nodeID < CAN_METRICS_NODES_NUMBER && responseNodeID != nodeID ) continue;
+    for( size_t pdoIndex = 0; pdoIndex < CAN_METRICS_TPDOS_NUMBER; pdoIndex++ )
+    {
+      CANMetricsTimes* times = &(metrics.nodeResponseTimes[ responseNodeID ][ pdoIndex ]);
+      uint64_t count = METRICS_GET( times->count );
+      if( count == 0 ) continue;
+      uint64_t minTime = METRICS_GET( times->minTime ), maxTime = METRICS_GET( times->maxTime );
+      if( responseTimes.count == 0 || minTime < responseTimes.minTime ) responseTimes.minTime = minTime;
+      if( maxTime > responseTimes.maxTime ) responseTimes.maxTime = maxTime;
+      responseTimes.totalTime += METRICS_GET( times->totalTime );
+      responseTimes.count += count;
+    }
+  }
+  
+  return CANMetrics_GetTimes( &responseTimes, ref_minTime, ref_averageTime, ref_maxTime );
+}
+
+uint64_t CANMetrics_GetFramesCount( unsigned int nodeID, bool isTransmitted )
+{
+  if( nodeID >= CAN_METRICS_NODES_NUMBER ) return METRICS_GET( metrics.framesCount[ isTransmitted ? 1 : 0 ] );
+  
+  return METRICS_GET( metrics.nodeFramesCount[ nodeID ][ isTransmitted ? 1 : 0 ] );
+}
+
+// Frame and SDO errors of given node (or all of them, for CAN_METRICS_ALL_NODES)
+uint64_t CANMetrics_GetErrorsCount( unsigned int nodeID )
+{
+  uint64_t errorsCount = 0;
+  for( size_t errorNodeID = 0; errorNodeID < CAN_METRICS_NODES_NUMBER; errorNodeID++ )
+  {
+    if( nodeID < CAN_METRICS_NODES_NUMBER && errorNodeID != nodeID ) continue;
+    for( size_t errorIndex = 0; errorIndex < METRICS_NODE_ERRORS_NUMBER; errorIndex++ )
+      errorsCount += METRICS_GET( metrics.nodeErrorsCount[ errorNodeID ][ errorIndex ] );
+  }
+  
+  return errorsCount;
+}
+
+// Cycle length (in seconds) below which the given fraction of cycles is (upper limit of log2 bucket)
+static double GetCycleTimeQuantile( const uint64_t* bucketsList, uint64_t totalCount, double quantile )
+{
+  uint64_t targetCount = (uint64_t) ( quantile * totalCount );
+  uint64_t cumulativeCount = 0;
+  for( size_t bucketIndex = 0; bucketIndex < CAN_METRICS_LATENCY_BUCKETS; bucketIndex++ )
+  {
+    cumulativeCount += bucketsList[ bucketIndex ];
+    if( cumulativeCount > targetCount ) return ( 2ULL << bucketIndex ) / 1000000.0;
+  }
+
+  return 0.0;
+}
+
+// Write counters snapshot in Prometheus text format (returns text length)
+size_t CANMetrics_Print( char* buffer, size_t bufferLength )
+{
+  static uint64_t lastCyclesCount = 0, lastFramesCount = 0;
+
+  size_t textLength = 0;
+  #define METRICS_PRINT( ... ) if( textLength < bufferLength ) textLength += snprintf( buffer + textLength, bufferLength - textLength, __VA_ARGS__ )
+
+  uint64_t cyclesCount = METRICS_GET( metrics.cyclesCount );
+  uint64_t framesCount[ 2 ] = { METRICS_GET( metrics.framesCount[ 0 ] ), METRICS_GET( metrics.framesCount[ 1 ] ) };
+  uint64_t cycleTimesList[ CAN_METRICS_LATENCY_BUCKETS ], cycleTimesCount = 0;
+  for( size_t bucketIndex = 0; bucketIndex < CAN_METRICS_LATENCY_BUCKETS; bucketIndex++ )
+    cycleTimesCount += ( cycleTimesList[ bucketIndex ] = METRICS_GET( metrics.cycleTimesList[ bucketIndex ] ) );
+
+  // Rates since previous snapshot
+  double exportTime = Time_GetExecSeconds();
+  double cycleRate = 0.0, busLoad = 0.0;
+  if( lastExportTime >= 0.0 && exportTime > lastExportTime )
+  {
+    cycleRate = ( cyclesCount - lastCyclesCount ) / ( exportTime - lastExportTime );
+    busLoad = ( framesCount[ 0 ] + framesCount[ 1 ] - lastFramesCount ) * CAN_METRICS_FRAME_BITS / CAN_METRICS_BIT_RATE / ( exportTime - lastExportTime );
+  }
+  lastExportTime = exportTime;
+  lastCyclesCount = cyclesCount;
+  lastFramesCount = framesCount[ 0 ] + framesCount[ 1 ];
+
+  METRICS_PRINT( "# HELP nixnet_cycles_total Network cycles (SYNC frames sent).\n# TYPE nixnet_cycles_total counter\n" );
+  METRICS_PRINT( "nixnet_cycles_total %llu\n", (unsigned long long) cyclesCount );
+  METRICS_PRINT( "# HELP nixnet_cycle_rate_hertz Network cycles per second since previous snapshot.\n# TYPE nixnet_cycle_rate_hertz gauge\n" );
+  METRICS_PRINT( "nixnet_cycle_rate_hertz %g\n", cycleRate );
+  METRICS_PRINT( "# HELP nixnet_cycle_overruns_total Cycles longer than %g s.\n# TYPE nixnet_cycle_overruns_total counter\n", CAN_METRICS_OVERRUN_TIME );
+  METRICS_PRINT( "nixnet_cycle_overruns_total %llu\n", (unsigned long long) METRICS_GET( metrics.overrunsCount ) );
+  METRICS_PRINT( "# HELP nixnet_sync_barrier_timeouts_total Output frames not transmitted before SYNC.\n# TYPE nixnet_sync_barrier_timeouts_total counter\n" );
+  METRICS_PRINT( "nixnet_sync_barrier_timeouts_total %llu\n", (unsigned long long) METRICS_GET( metrics.barrierTimeoutsCount ) );
+  METRICS_PRINT( "# HELP nixnet_stale_samples_total Measures updates without new TPDO data.\n# TYPE nixnet_stale_samples_total counter\n" );
+  METRICS_PRINT( "nixnet_stale_samples_total %llu\n", (unsigned long long) METRICS_GET( metrics.staleSamplesCount ) );
+  METRICS_PRINT( "# HELP nixnet_cycle_seconds Time between consecutive SYNC frames.\n# TYPE nixnet_cycle_seconds summary\n" );
+  const double QUANTILES_LIST[] = { 0.5, 0.9, 0.99, 0.999 };
+  for( size_t quantileIndex = 0; quantileIndex < sizeof(QUANTILES_LIST) / sizeof(double); quantileIndex++ )
+    METRICS_PRINT( "nixnet_cycle_seconds{quantile=\"%g\"} %g\n", QUANTILES_LIST[ quantileIndex ], GetCycleTimeQuantile( cycleTimesList, cycleTimesCount, QUANTILES_LIST[ quantileIndex ] ) );
+  METRICS_PRINT( "nixnet_cycle_seconds_sum %g\n", METRICS_GET( metrics.cycleTimes.totalTime ) / 1000000.0 );
+  METRICS_PRINT( "nixnet_cycle_seconds_count %llu\n", (unsigned long long) cycleTimesCount );
+  METRICS_PRINT( "# HELP nixnet_frames_total Frames read (new) and written by the plug-in.\n# TYPE nixnet_frames_total counter\n" );
+  METRICS_PRINT( "nixnet_frames_total{direction=\"rx\"} %llu\n", (unsigned long long) framesCount[ 0 ] );
+  METRICS_PRINT( "nixnet_frames_total{direction=\"tx\"} %llu\n", (unsigned long long) framesCount[ 1 ] );
+  METRICS_PRINT( "# HELP nixnet_bus_load_ratio Bus load estimated from plug-in frames since previous snapshot.\n# TYPE nixnet_bus_load_ratio gauge\n" );
+  METRICS_PRINT( "nixnet_bus_load_ratio %g\n", busLoad );
+
+  const char* NODE_ERROR_NAMES[ METRICS_NODE_ERRORS_NUMBER ] = { "frame", "sdo" };
+  METRICS_PRINT( "# HELP nixnet_node_frames_total Frames read and written per node (0 for network frames).\n# TYPE nixnet_node_frames_total counter\n" );
+  for( size_t nodeID = 0; nodeID < CAN_METRICS_NODES_NUMBER; nodeID++ )
+  {
+    uint64_t nodeFramesCount[ 2 ] = { METRICS_GET( metrics.nodeFramesCount[ nodeID ][ 0 ] ), METRICS_GET( metrics.nodeFramesCount[ nodeID ][ 1 ] ) };
+    if( nodeFramesCount[ 0 ] + nodeFramesCount[ 1 ] == 0 ) continue;
+    METRICS_PRINT( "nixnet_node_frames_total{node=\"%lu\",direction=\"rx\"} %llu\n", (unsigned long) nodeID, (unsigned long long) nodeFramesCount[ 0 ] );
+    METRICS_PRINT( "nixnet_node_frames_total{node=\"%lu\",direction=\"tx\"} %llu\n", (unsigned long) nodeID, (unsigned long long) nodeFramesCount[ 1 ] );
+  }
+  METRICS_PRINT( "# HELP nixnet_node_errors_total Driver frame errors and failed SDO transfers per node.\n# TYPE nixnet_node_errors_total counter\n" );
+  for( size_t nodeID = 0; nodeID < CAN_METRICS_NODES_NUMBER; nodeID++ )
+  {
+    if( CANMetrics_GetFramesCount( nodeID, false ) + CANMetrics_GetFramesCount( nodeID, true ) + CANMetrics_GetErrorsCount( nodeID ) == 0 ) continue;
+    for( size_t errorIndex = 0; errorIndex < METRICS_NODE_ERRORS_NUMBER; errorIndex++ )
+      METRICS_PRINT( "nixnet_node_errors_total{node=\"%lu\",type=\"%s\"} %llu\n", (unsigned long) nodeID, NODE_ERROR_NAMES[ errorIndex ],
+                     (unsigned long long) METRICS_GET( metrics.nodeErrorsCount[ nodeID ][ errorIndex ] ) );
+  }
+  METRICS_PRINT( "# HELP nixnet_tpdo_response_seconds Time from SYNC transmission to TPDO reception per node.\n# TYPE nixnet_tpdo_response_seconds summary\n" );
+  for( size_t nodeID = 0; nodeID < CAN_METRICS_NODES_NUMBER; nodeID++ )
+  {
+    for( size_t pdoIndex = 0; pdoIndex < CAN_METRICS_TPDOS_NUMBER; pdoIndex++ )
+    {
+      double minTime, averageTime, maxTime;
+      uint64_t responsesCount = CANMetrics_GetTimes( &(metrics.nodeResponseTimes[ nodeID ][ pdoIndex ]), &minTime, &averageTime, &maxTime );
+      if( responsesCount == 0 ) continue;
+      METRICS_PRINT( "nixnet_tpdo_response_seconds_sum{node=\"%lu\",pdo=\"%lu\"} %g\n", (unsigned long) nodeID, (unsigned long) pdoIndex + 1, averageTime * responsesCount );
+      METRICS_PRINT( "nixnet_tpdo_response_seconds_count{node=\"%lu\",pdo=\"%lu\"} %llu\n", (unsigned long) nodeID, (unsigned long) pdoIndex + 1, (unsigned long long) responsesCount );
+    }
+  }
+  // Extremes go to their own gauge families, as summaries only carry quantiles, sum and count
+  const char* EXTREME_NAMES[ 2 ] = { "min", "max" };
+  for( size_t extremeIndex = 0; extremeIndex < 2; extremeIndex++ )
+  {
+    METRICS_PRINT( "# HELP nixnet_tpdo_response_%s_seconds %s time from SYNC transmission to TPDO reception per node.\n# TYPE nixnet_tpdo_response_%s_seconds gauge\n",
+                   EXTREME_NAMES[ extremeIndex ], ( extremeIndex == 0 ) ? "Minimum" : "Maximum", EXTREME_NAMES[ extremeIndex ] );
+    for( size_t nodeID = 0; nodeID < CAN_METRICS_NODES_NUMBER; nodeID++ )
+    {
+      for( size_t pdoIndex = 0; pdoIndex < CAN_METRICS_TPDOS_NUMBER; pdoIndex++ )
+      {
+        double minTime, averageTime, maxTime;
+        if( CANMetrics_GetTimes( &(metrics.nodeResponseTimes[ nodeID ][ pdoIndex ]), &minTime, &averageTime, &maxTime ) == 0 ) continue;
+        METRICS_PRINT( "nixnet_tpdo_response_%s_seconds{node=\"%lu\",pdo=\"%lu\"} %g\n", EXTREME_NAMES[ extremeIndex ],
+                       (unsigned long) nodeID, (unsigned long) pdoIndex + 1, ( extremeIndex == 0 ) ? minTime : maxTime );
+      }
+    }
+  }
+
+  #undef METRICS_PRINT
+
+  return ( textLength < bufferLength ) ? textLength : bufferLength - 1;
+}
+
+static void* AsyncExportMetrics( void* data )
+{
+  static char metricsText[ CAN_METRICS_BUFFER_LENGTH ];
+
+  #ifdef __linux__
+  setpriority( PRIO_PROCESS, 0, 19 ); // Lowest priority (Linux applies it to the calling thread only)
+  #endif
+
+  while( __atomic_load_n( &isExportingMetrics, __ATOMIC_ACQUIRE ) )
+  {
+    #ifdef __unix__
+    if( metricsSocket >= 0 )
+    {
+      int clientSocket = accept( metricsSocket, NULL, NULL );
+      if( clientSocket < 0 ) continue;
+      size_t textLength = CANMetrics_Print( metricsText, CAN_METRICS_BUFFER_LENGTH );
+      if( write( clientSocket, metricsText, textLength ) < 0 ) DEBUG_PRINT( "error sending metrics to %s", getenv( "NIXNET_METRICS_SOCKET" ) );
+      close( clientSocket );
+      continue;
+    }
+    #endif
+
+    Semaphores.Decrement( metricsEvent );
+    if( !__atomic_load_n( &isExportingMetrics, __ATOMIC_ACQUIRE ) ) break;
+
+    // Write to temporary file first, so that readers never get a partial snapshot
+    char temporaryFilePath[ 256 ];
+    snprintf( temporaryFilePath, sizeof(temporaryFilePath), "%s.tmp", metricsFilePath );
+    FILE* metricsFile = fopen( temporaryFilePath, "w" );
+    if( metricsFile == NULL ) continue;
+    fwrite( metricsText, 1, CANMetrics_Print( metricsText, CAN_METRICS_BUFFER_LENGTH ), metricsFile );
+    fclose( metricsFile );
+    remove( metricsFilePath );
+    rename( temporaryFilePath, metricsFilePath );
+  }
+
+  return NULL;
+}
+
+// Start exporter thread if configured (NIXNET_METRICS_SOCKET or NIXNET_METRICS_FILE environment variables)
+void CANMetrics_StartExporter()
+{
+  if( isExportingMetrics ) return;
+
+  const char* socketPath = getenv( "NIXNET_METRICS_SOCKET" );
+  metricsFilePath = getenv( "NIXNET_METRICS_FILE" );
+
+  #ifdef __unix__
+  if( socketPath != NULL )
+  {
+    struct sockaddr_un socketAddress = { .sun_family = AF_UNIX };
+    strncpy( socketAddress.sun_path, socketPath, sizeof(socketAddress.sun_path) - 1 );
+    unlink( socketPath );
+    metricsSocket = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( metricsSocket < 0 || bind( metricsSocket, (struct sockaddr*) &socketAddress, sizeof(socketAddress) ) < 0 || listen( metricsSocket, 4 ) < 0 )
+    {
+      DEBUG_PRINT( "error opening metrics socket %s", socketPath );
+      if( metricsSocket >= 0 ) close( metricsSocket );
+      metricsSocket = -1;
+    }
+    metricsFilePath = NULL;
+  }
+  #endif
+
+  if( metricsSocket < 0 && metricsFilePath == NULL ) return;
+
+  lastExportTime = Time_GetExecSeconds();
+
+  metricsEvent = Semaphores.Create( 0, 1 );
+  __atomic_store_n( &isExportingMetrics, true, __ATOMIC_RELEASE );
+  metricsThread = Threading.StartThread( AsyncExportMetrics, NULL, THREAD_JOINABLE );
+}
+
+void CANMetrics_StopExporter()
+{
+  if( !isExportingMetrics ) return;
+
+  __atomic_store_n( &isExportingMetrics, false, __ATOMIC_RELEASE );
+
+  #ifdef __unix__
+  // Wake up thread blocked on accept
+  if( metricsSocket >= 0 ) shutdown( metricsSocket, SHUT_RDWR );
+  #endif
+  Semaphores.Increment( metricsEvent );
+
+  Threading.WaitExit( metricsThread, 5000 );
+
+  #ifdef __unix__
+  if( metricsSocket >= 0 ) close( metricsSocket );
+  metricsSocket = -1;
+  #endif
+  Semaphores.Discard( metricsEvent );
+  metricsFilePath = NULL;
+}
+
+#endif  /* CAN_METRICS_H */
@@ -27,6 +27,16 @@
 #include "can_frame.h"
 
 #include "timing/timing.h" 
+#ifdef NIXNET_STUB_VIRTUAL_TIME
+#include "timing_virtual.h"
+#elif defined( TIMING_LINUX )
+#include "timing_linux.h"
+#elif defined( __unix__ )
+#include <time.h>
+#endif
+
+#include "startup_profile.h"
+#include "can_trace.h"
 
 #include "khash.h"
 
@@ -34,6 +44,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <limits.h>
 
 enum CANFrameTypes { SDO, PDO01, PDO02, CAN_FRAME_TYPES_NUMBER };
 
@@ -45,21 +56,114 @@ const char* CAN_CLUSTER_NAME = "NETCAN";
 static CANFrame NMT = NULL;
 static CANFrame SYNC = NULL;
 
+// Maximum time (in seconds) to wait for output frames transmission before SYNC (negative disables the barrier)
+#ifndef CAN_SYNC_BARRIER_TIMEOUT
+#define CAN_SYNC_BARRIER_TIMEOUT -1.0
+#endif
+
+static double syncBarrierTimeout = CAN_SYNC_BARRIER_TIMEOUT;
+
+// Ways of waiting for input frames (TPDOs) newer than last read: none (take latest received values), busy polling
+// (lowest latency, takes a whole core), polling then sleeping (hybrid) or sleeping between polls (least CPU usage).
+// Hybrid waits poll while the frame is usually received (between its shortest and longest measured response times
+// after SYNC) and sleep otherwise. Single point input sessions have no blocking read or reception wait condition, so sleeps are
+// CAN_INPUT_SLEEP_TIME delays (1 ms timing delays on platforms without POSIX nanosleep)
+enum CANInputWait { CAN_INPUT_WAIT_NONE, CAN_INPUT_WAIT_SPIN, CAN_INPUT_WAIT_HYBRID, CAN_INPUT_WAIT_SLEEP, CAN_INPUT_WAITS_NUMBER };
+
+const char* CAN_INPUT_WAIT_NAMES[ CAN_INPUT_WAITS_NUMBER ] = { "none", "spin", "hybrid", "sleep" };
+
+#ifndef CAN_INPUT_WAIT
+#define CAN_INPUT_WAIT CAN_INPUT_WAIT_NONE
+#endif
+#ifndef CAN_INPUT_WAIT_TIMEOUT
+#define CAN_INPUT_WAIT_TIMEOUT 0.002      // Maximum time (in seconds) to wait for a new input frame
+#endif
+#ifndef CAN_INPUT_SPIN_TIME
+#define CAN_INPUT_SPIN_TIME 0.0002        // Busy polling time (in seconds) before sleeping, for hybrid wait of frames without measured responses
+#endif
+#ifndef CAN_INPUT_SLEEP_TIME
+#define CAN_INPUT_SLEEP_TIME 0.00005      // Time (in seconds) between polls of sleeping waits
+#endif
+
+#if defined( NIXNET_STUB_VIRTUAL_TIME )
+#define CAN_INPUT_SLEEP() TimeVirtual_Advance( (uint64_t) ( CAN_INPUT_SLEEP_TIME * 1000000000.0 ) )
+#elif defined( TIMING_LINUX )
+#define CAN_INPUT_SLEEP() TimeLinux_Sleep( (uint64_t) ( CAN_INPUT_SLEEP_TIME * 1000000000.0 ) )
+#elif defined( __unix__ )
+#define CAN_INPUT_SLEEP() nanosleep( &(struct timespec) { 0, (long) ( CAN_INPUT_SLEEP_TIME * 1000000000.0 ) }, NULL )
+#else
+#define CAN_INPUT_SLEEP() Time_Delay( 1 )
+#endif
+
+static enum CANInputWait inputWait = CAN_INPUT_WAIT;
+static nxTimestamp_t syncTimestamp = 0;      // Interface time right before last SYNC
+static double syncTime = 0.0;                // Execution time (in seconds) of last SYNC
+static double inputWaitTimeout = CAN_INPUT_WAIT_TIMEOUT;
+static double inputSpinTime = CAN_INPUT_SPIN_TIME;
+
+// Output frames written since last SYNC (2 RPDOs for each of up to 127 nodes). Not synchronized: only
+// the thread driving the network cycle (the one calling CANNetwork_Sync) may add frames
+#define CAN_PENDING_OUTPUTS_MAX 256
+static CANFrame pendingOutputsList[ CAN_PENDING_OUTPUTS_MAX ];
+static size_t pendingOutputsNumber = 0;
+
+// Number of SYNC frames sent, identifying the current network cycle
+static unsigned long syncCount = 0;
+
+// Frames sent every N cycles get the phase (cycle offset) with least frames already scheduled, so that
+// bus load is spread evenly. Loads are counted over the SYNC counter period (also the highest synchronous
+// transmission type), and divisors are restricted to its divisors, so that phases repeat on every period
+#define CAN_SCHEDULE_PERIOD 240
+static unsigned int scheduleLoadsList[ CAN_SCHEDULE_PERIOD ];
+static unsigned int scheduledFramesNumber = 0;   // SYNC carries its counter while any frame is scheduled
+
 KHASH_MAP_INIT_INT( FrameInt, CANFrame )
 static khash_t( FrameInt )* framesList = NULL;
 
 void CANNetwork_Reset();
 
-void CANNetwork_Start()
+bool CANNetwork_Start()
 {
+  double phaseStartTime = StartupProfile_GetTime();
   // Address and initialize NMT (Network Master) frame
   NMT = CANFrame_Init( FRAME_OUT, "CAN2", CAN_DATABASE_NAME, CAN_CLUSTER_NAME, "NMT" );
   // Address and initialize SYNC (Syncronization) frame
   SYNC = CANFrame_Init( FRAME_OUT, "CAN2", CAN_DATABASE_NAME, CAN_CLUSTER_NAME, "SYNC" );
+  StartupProfile_Add( STARTUP_SESSIONS, 0, phaseStartTime );
+  
+  // Interface or simulator not available
+  if( NMT == NULL || SYNC == NULL )
+  {
+    DEBUG_PRINT( "error creating network control frames (NMT: %p, SYNC: %p)", NMT, SYNC );
+    CANFrame_End( NMT );
+    CANFrame_End( SYNC );
+    NMT = SYNC = NULL;
+    return false;
+  }
+  
+  // Network frames keys, with types following node frames ones
+  NMT->key = ( CAN_FRAME_TYPES_NUMBER << 16 ) + ( FRAME_OUT << 8 );
+  SYNC->key = ( ( CAN_FRAME_TYPES_NUMBER + 1 ) << 16 ) + ( FRAME_OUT << 8 );
+  NMT->identifier = 0x000;
+  SYNC->identifier = 0x080;
+  
+  const char* captureFilePath = getenv( "NIXNET_CAPTURE_FILE" );
+  if( captureFilePath != NULL ) CANCapture_Start( captureFilePath );
+  
+  CANMetrics_StartExporter();
+  CAN_TRACE_START();
+  
+  const char* inputWaitName = getenv( "NIXNET_INPUT_WAIT" );
+  for( size_t waitIndex = 0; inputWaitName != NULL && waitIndex < CAN_INPUT_WAITS_NUMBER; waitIndex++ )
+  {
+    if( strcmp( inputWaitName, CAN_INPUT_WAIT_NAMES[ waitIndex ] ) == 0 ) inputWait = (enum CANInputWait) waitIndex;
+  }
   
   framesList = kh_init( FrameInt );
 
   CANNetwork_Reset();
+  
+  return true;
 }
 
 // Stop CAN network communications
@@ -72,12 +176,20 @@ void CANNetwork_Stop()
   kh_destroy( FrameInt, framesList );
   framesList = NULL;
   
+  pendingOutputsNumber = 0;
+  
   CANFrame_End( NMT );
   CANFrame_End( SYNC );
+  
+  CANCapture_Stop();
+  CANMetrics_StopExporter();
+  CAN_TRACE_STOP();
 }
 
 void CANNetwork_Reset()
 {
+  double phaseStartTime = StartupProfile_GetTime();
+  
   u8 payload[8] = { 0x82 }; // Rest of the array as 0x0
   CANFrame_Write( NMT, payload );
   
@@ -85,6 +197,15 @@ void CANNetwork_Reset()
   
   payload[0] = 0x01; // Rest of the array as 0x0
   CANFrame_Write( NMT, payload );
+  
+  StartupProfile_Add( STARTUP_NETWORK_RESET, 0, phaseStartTime );
+}
+
+// Send NMT command to given node (0 for all nodes)
+void CANNetwork_WriteNMT( uint8_t commandSpecifier, uint8_t nodeID )
+{
+  u8 payload[8] = { commandSpecifier, nodeID }; // Rest of the array as 0x0
+  CANFrame_Write( NMT, payload );
 }
 
 void CANNetwork_InitNode( uint8_t nodeID )
@@ -109,6 +230,8 @@ void CANNetwork_ResetNodes()
 
 const size_t ADDRESS_MAX_LENGTH = 16;
 const char* CAN_FRAME_NAMES[ CAN_FRAME_TYPES_NUMBER ] = { "SDO", "PDO01", "PDO02" };
+// CANopen identifiers of node 0 frames (received, written) for each type
+const uint32_t CAN_FRAME_IDENTIFIERS[ CAN_FRAME_TYPES_NUMBER ][ 2 ] = { { 0x580, 0x600 }, { 0x180, 0x200 }, { 0x280, 0x300 } };
 CANFrame CANNetwork_InitFrame( enum CANFrameTypes type, enum CANFrameMode mode, unsigned int nodeID )
 {
   char frameAddress[ ADDRESS_MAX_LENGTH ];
@@ -126,19 +249,23 @@ CANFrame CANNetwork_InitFrame( enum CANFrameTypes type, enum CANFrameMode mode,
   
   //DEBUG_PRINT( "creating frame %s on mode %d (key: %d)", frameAddress, mode, frameKey );
   
-  if( framesList == NULL ) CANNetwork_Start();
+  if( framesList == NULL && !CANNetwork_Start() ) return NULL;
   
   int insertionStatus;
   khint_t newFrameID = kh_put( FrameInt, framesList, frameKey, &insertionStatus );
   if( insertionStatus > 0 )
   {
+    double phaseStartTime = StartupProfile_GetTime();
     kh_value( framesList, newFrameID ) = CANFrame_Init( mode, interfaceName, CAN_DATABASE_NAME, CAN_CLUSTER_NAME, frameAddress );
+    StartupProfile_Add( STARTUP_SESSIONS, nodeID, phaseStartTime );
     if( kh_value( framesList, newFrameID ) == NULL )
     {
       DEBUG_PRINT( "error creating frame %s for CAN interface %s", frameAddress, interfaceName );
       kh_del( FrameInt, framesList, newFrameID );
       return NULL;
     }
+    kh_value( framesList, newFrameID )->key = frameKey;
+    kh_value( framesList, newFrameID )->identifier = CAN_FRAME_IDENTIFIERS[ type ][ ( mode == FRAME_OUT ) ? 1 : 0 ] + ( nodeID & 0x7F );
   }
   
   //CANNetwork_ResetNodes();
@@ -148,30 +275,215 @@ CANFrame CANNetwork_InitFrame( enum CANFrameTypes type, enum CANFrameMode mode,
 
 void CANNetwork_EndFrame( CANFrame frame )
 {
-  for( khint_t frameID = 0; frameID != kh_end( framesList ); frameID++ )
+  if( frame == NULL || framesList == NULL ) return;
+  
+  // Find frame by its stored key instead of scanning the whole table
+  khint_t frameID = kh_get( FrameInt, framesList, frame->key );
+  if( frameID == kh_end( framesList ) || kh_value( framesList, frameID ) != frame ) return;
+  
+  CANFrame_End( frame );
+  kh_del( FrameInt, framesList, frameID );
+  
+  if( kh_size( framesList ) == 0 ) CANNetwork_Stop();
+}
+
+// Node ID of frame created with CANNetwork_InitFrame
+unsigned int CANNetwork_GetFrameNode( CANFrame frame )
+{
+  return (unsigned int) ( frame->key & 0xFF );
+}
+
+// Enable (timeout >= 0) or disable (timeout < 0) waiting for output frames transmission before SYNC
+void CANNetwork_SetSyncBarrier( double timeout )
+{
+  syncBarrierTimeout = timeout;
+}
+
+// Largest divisor of the schedule period not above the given one
+unsigned int CANNetwork_GetScheduleDivisor( unsigned long divisor )
+{
+  if( divisor < 1 ) return 1;
+  if( divisor > CAN_SCHEDULE_PERIOD ) divisor = CAN_SCHEDULE_PERIOD;
+  
+  while( CAN_SCHEDULE_PERIOD % divisor != 0 ) divisor--;
+  
+  return (unsigned int) divisor;
+}
+
+// Reserve least loaded phase for a frame sent every <divisor> cycles (a divisor of the schedule period)
+unsigned int CANNetwork_AddScheduledFrame( unsigned int divisor )
+{
+  if( divisor <= 1 ) return 0;
+  
+  unsigned int bestPhase = 0, bestLoad = UINT_MAX;
+  for( unsigned int phase = 0; phase < divisor; phase++ )
   {
-    if( !kh_exist( framesList, frameID ) ) continue;
-    
-    if( kh_value( framesList, frameID ) == frame )
+    unsigned int phaseLoad = 0;
+    for( unsigned int slot = phase; slot < CAN_SCHEDULE_PERIOD; slot += divisor )
+      phaseLoad += scheduleLoadsList[ slot ];
+    if( phaseLoad < bestLoad )
     {
-      CANFrame_End( frame );
-      kh_del( FrameInt, framesList, frameID );
-      
-      if( kh_size( framesList ) == 0 ) CANNetwork_Stop();
-      
-      break;
+      bestPhase = phase;
+      bestLoad = phaseLoad;
     }
   }
+  
+  for( unsigned int slot = bestPhase; slot < CAN_SCHEDULE_PERIOD; slot += divisor )
+    scheduleLoadsList[ slot ]++;
+  scheduledFramesNumber++;
+  
+  return bestPhase;
+}
+
+void CANNetwork_RemoveScheduledFrame( unsigned int divisor, unsigned int phase )
+{
+  if( divisor <= 1 ) return;
+  
+  for( unsigned int slot = phase; slot < CAN_SCHEDULE_PERIOD; slot += divisor )
+  {
+    if( scheduleLoadsList[ slot ] > 0 ) scheduleLoadsList[ slot ]--;
+  }
+  if( scheduledFramesNumber > 0 ) scheduledFramesNumber--;
+}
+
+// Check if frame with given divisor and phase should be sent on current network cycle
+bool CANNetwork_IsScheduled( unsigned int divisor, unsigned int phase )
+{
+  return ( divisor <= 1 || syncCount % divisor == phase );
+}
+
+// Check if frame with given divisor and phase answered last SYNC (for inputs read after it)
+bool CANNetwork_IsInputScheduled( unsigned int divisor, unsigned int phase )
+{
+  return ( divisor <= 1 || ( syncCount - 1 ) % divisor == phase );
 }
 
+// Set wait strategy for CANNetwork_ReadInput, with busy polling (hybrid strategy) and total wait times in seconds
+void CANNetwork_SetInputWait( enum CANInputWait strategy, double spinTime, double timeout )
+{
+  if( strategy >= CAN_INPUT_WAITS_NUMBER ) return;
+  
+  inputWait = strategy;
+  inputSpinTime = spinTime;
+  inputWaitTimeout = timeout;
+}
+
+// Check if last value read from input frame was received after last SYNC
+bool CANNetwork_IsInputFresh( CANFrame frame )
+{
+  return ( CANFrame_GetTimestamp( frame ) >= syncTimestamp );
+}
+
+// Register response time of input frame (TPDO) if a new one answering last SYNC was read since given timestamp
+void CANNetwork_AddInputResponse( CANFrame frame, nxTimestamp_t lastTimestamp )
+{
+  nxTimestamp_t timestamp = CANFrame_GetTimestamp( frame );
+  if( syncTimestamp == 0 || timestamp == lastTimestamp || timestamp < syncTimestamp ) return;
+  
+  unsigned int frameType = (unsigned int) ( frame->key >> 16 );
+  if( frameType < PDO01 || frameType >= CAN_FRAME_TYPES_NUMBER ) return;
+  
+  // Interface time read right before SYNC write stands for its transmission (100 ns units)
+  CANMetrics_AddResponseTime( CANNetwork_GetFrameNode( frame ), frameType - PDO01, ( timestamp - syncTimestamp ) / 10000000.0 );
+}
+
+// Execution times between which hybrid waits for input frame poll: its measured responses window after last SYNC
+// (shortened by a sleep, which may end late), or configured spin time from given wait start before any is measured
+static void GetInputSpinTimes( CANFrame frame, double waitStartTime, double* ref_spinStartTime, double* ref_spinEndTime )
+{
+  unsigned int frameType = (unsigned int) ( frame->key >> 16 );
+  double minResponseTime, averageResponseTime, maxResponseTime;
+  if( frameType >= PDO01 && frameType < CAN_FRAME_TYPES_NUMBER &&
+      CANMetrics_GetTPDOResponseTimes( CANNetwork_GetFrameNode( frame ), frameType - PDO01, &minResponseTime, &averageResponseTime, &maxResponseTime ) > 0 )
+  {
+    *ref_spinStartTime = syncTime + minResponseTime - CAN_INPUT_SLEEP_TIME;
+    *ref_spinEndTime = syncTime + maxResponseTime;
+    return;
+  }
+  
+  *ref_spinStartTime = waitStartTime;
+  *ref_spinEndTime = waitStartTime + inputSpinTime;
+}
+
+// Read input frame, waiting (with configured strategy) for one received after last SYNC. Returns false for stale values
+bool CANNetwork_ReadInput( CANFrame frame, u8 payload[8] )
+{
+  nxTimestamp_t lastTimestamp = CANFrame_GetTimestamp( frame );
+  
+  CANFrame_Read( frame, payload );
+  
+  double waitStartTime = Time_GetExecSeconds();
+  double spinStartTime = 0.0, spinEndTime = 0.0;
+  if( inputWait == CAN_INPUT_WAIT_HYBRID ) GetInputSpinTimes( frame, waitStartTime, &spinStartTime, &spinEndTime );
+  while( inputWait != CAN_INPUT_WAIT_NONE && !CANNetwork_IsInputFresh( frame ) )
+  {
+    double currentTime = Time_GetExecSeconds();
+    if( currentTime - waitStartTime >= inputWaitTimeout ) return false;
+    
+    if( inputWait == CAN_INPUT_WAIT_SLEEP || ( inputWait == CAN_INPUT_WAIT_HYBRID && ( currentTime < spinStartTime || currentTime >= spinEndTime ) ) ) CAN_INPUT_SLEEP();
+    
+    CANFrame_Read( frame, payload );
+  }
+  
+  CANNetwork_AddInputResponse( frame, lastTimestamp );
+  
+  return CANNetwork_IsInputFresh( frame );
+}
+
+// Register output frames (e.g. RPDOs) whose values should be applied on next SYNC
+void CANNetwork_AddPendingOutputs( CANFrame* outputFramesList, size_t outputFramesNumber )
+{
+  for( size_t frameIndex = 0; frameIndex < outputFramesNumber; frameIndex++ )
+  {
+    if( pendingOutputsNumber >= CAN_PENDING_OUTPUTS_MAX ) break;
+    pendingOutputsList[ pendingOutputsNumber++ ] = outputFramesList[ frameIndex ];
+  }
+}
+
+// Start a new network cycle: send SYNC once pending output frames reached the bus (if barrier is enabled)
 void CANNetwork_Sync()
 {
-  // Build Sync payload (all 0x0) 
+  // Build Sync payload (all 0x0), with SYNC counter (1 to schedule period) while any frame is scheduled,
+  // which TPDOs count their start value from
   static u8 payload[ 8 ];
+  payload[ 0 ] = ( scheduledFramesNumber > 0 ) ? (u8) ( syncCount % CAN_SCHEDULE_PERIOD + 1 ) : 0;
+  SYNC->length = ( scheduledFramesNumber > 0 ) ? 1 : 8;
+  
+  CAN_PROBE1( sync_start, syncCount );
+  
+  CAN_TRACE_BEGIN( sync_barrier );
+  if( syncBarrierTimeout >= 0.0 )
+  {
+    for( size_t frameIndex = 0; frameIndex < pendingOutputsNumber; frameIndex++ )
+    {
+      if( !CANFrame_WaitTransmit( pendingOutputsList[ frameIndex ], syncBarrierTimeout ) )
+      {
+        DEBUG_PRINT( "frame %s not transmitted before SYNC", pendingOutputsList[ frameIndex ]->id );
+        CANMetrics_AddBarrierTimeout();
+      }
+    }
+  }
+  pendingOutputsNumber = 0;
+  CAN_TRACE_END( sync_barrier );
+  
+  CAN_TRACE_BEGIN( sync_send );
+  syncTimestamp = CANFrame_GetCurrentTime( SYNC );
+  syncTime = Time_GetExecSeconds();
   CANFrame_Write( SYNC, payload );
+  CAN_TRACE_END( sync_send );
+  CAN_PROBE1( sync_sent, syncCount );
+  CANMetrics_AddCycle();
+  
+  syncCount++;
 }
 
-int CANNetwork_ReadSingleValue( CANFrame requestFrame, CANFrame readFrame, uint16_t index, uint8_t subIndex )
+unsigned long CANNetwork_GetSyncCount()
+{
+  return syncCount;
+}
+
+// Send SDO upload requisition for defined value (response arrives on node SDO input frame)
+void CANNetwork_RequestSingleValue( CANFrame requestFrame, uint16_t index, uint8_t subIndex )
 {
   // Build read requisition buffer for defined value
   static u8 payload[ 8 ];
@@ -187,6 +499,13 @@ int CANNetwork_ReadSingleValue( CANFrame requestFrame, CANFrame readFrame, uint1
 
   // Write value requisition to SDO frame 
   CANFrame_Write( requestFrame, payload );
+}
+
+int CANNetwork_ReadSingleValue( CANFrame requestFrame, CANFrame readFrame, uint16_t index, uint8_t subIndex )
+{
+  static u8 payload[ 8 ];
+  
+  CANNetwork_RequestSingleValue( requestFrame, index, subIndex );
 
   //Timing.Delay( 100 );
 
@@ -0,0 +1,57 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                      //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>                 //
+//                                                                                      //
+//  This file is part of Signal-IO-NIXNET.                                              //
+//                                                                                      //
+//  Signal-IO-NIXNET is free software: you can redistribute it and/or modify            //
+//  it under the terms of the GNU Lesser General Public License as published            //
+//  by the Free Software Foundation, either version 3 of the License, or                //
+//  (at your option) any later version.                                                 //
+//                                                                                      //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,                 //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of                      //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                        //
+//  GNU Lesser General Public License for more details.                                 //
+//                                                                                      //
+//  You should have received a copy of the GNU Lesser General Public License            //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.            //
+//                                                                                      //
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+
+// Static (USDT) tracepoints for bpftrace/perf/SystemTap ("nixnet" provider), built when sys/sdt.h is
+// available (HAVE_SYS_SDT_H). Each probe compiles to a single nop, so there is no overhead when nothing
+// is attached, and no rebuild is needed to trace. Without sys/sdt.h, probes expand to nothing
+//
+// Probes (arguments):
+//   frame_read_start( key ), frame_read_done( key, status, timestamp )
+//   frame_write_start( key ), frame_write_done( key, status )
+//   sync_start( cycle ), sync_sent( cycle )
+//   sdo_start( node, index, subindex, is_read ), sdo_done( node, index, subindex, value )   [value INT_MIN on failure]
+//   nmt_sent( command, node )
+//   cycle_start( cycle ), cycle_end( cycle )
+
+#ifndef CAN_PROBES_H
+#define CAN_PROBES_H
+
+#ifdef HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+#define CAN_PROBE1( name, arg1 ) DTRACE_PROBE1( nixnet, name, arg1 )
+#define CAN_PROBE2( name, arg1, arg2 ) DTRACE_PROBE2( nixnet, name, arg1, arg2 )
+#define CAN_PROBE3( name, arg1, arg2, arg3 ) DTRACE_PROBE3( nixnet, name, arg1, arg2, arg3 )
+#define CAN_PROBE4( name, arg1, arg2, arg3, arg4 ) DTRACE_PROBE4( nixnet, name, arg1, arg2, arg3, arg4 )
+
+#else
+
+#define CAN_PROBE1( name, arg1 ) do {} while( 0 )
+#define CAN_PROBE2( name, arg1, arg2 ) do {} while( 0 )
+#define CAN_PROBE3( name, arg1, arg2, arg3 ) do {} while( 0 )
+#define CAN_PROBE4( name, arg1, arg2, arg3, arg4 ) do {} while( 0 )
+
+#endif
+
+#endif  /* CAN_PROBES_H */
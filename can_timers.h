@@ -0,0 +1,172 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                      //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>                 //
+//                                                                                      //
+//  This file is part of Signal-IO-NIXNET.                                              //
+//                                                                                      //
+//  Signal-IO-NIXNET is free software: you can redistribute it and/or modify            //
+//  it under the terms of the GNU Lesser General Public License as published            //
+//  by the Free Software Foundation, either version 3 of the License, or                //
+//  (at your option) any later version.                                                 //
+//                                                                                      //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,                 //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of                      //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                        //
+//  GNU Lesser General Public License for more details.                                 //
+//                                                                                      //
+//  You should have received a copy of the GNU Lesser General Public License            //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.            //
+//                                                                                      //
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+// Hierarchical timer wheel (1 ms ticks) for protocol timeouts. Starting, cancelling and
+// expiring timers is O(1) (apart from cascading between levels), and timers storage is 
+// provided by their users, so nothing is allocated. Not thread safe: timers are meant
+// to be handled only from the thread driving the network cycle (see can_commands.h)
+
+#ifndef CAN_TIMERS_H
+#define CAN_TIMERS_H
+
+#include "timing/timing.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define CAN_TIMER_WHEEL_LEVELS 4
+#define CAN_TIMER_WHEEL_BITS 6
+#define CAN_TIMER_WHEEL_SLOTS ( 1 << CAN_TIMER_WHEEL_BITS )
+#define CAN_TIMER_DELAY_MAX ( ( 1UL << ( CAN_TIMER_WHEEL_LEVELS * CAN_TIMER_WHEEL_BITS ) ) - 1 )
+
+typedef void (*CANTimerCallback)( void* );
+
+typedef struct _CANTimer
+{
+  unsigned long expirationTick;
+  CANTimerCallback callback;
+  void* callbackData;
+  struct _CANTimer* previous;
+  struct _CANTimer* next;
+  bool isActive;
+}
+CANTimer;
+
+static CANTimer* timerSlotsList[ CAN_TIMER_WHEEL_LEVELS ][ CAN_TIMER_WHEEL_SLOTS ];
+static unsigned long timerCurrentTick = 0;
+static bool isTimerWheelStarted = false;
+
+static void InsertTimer( CANTimer* timer )
+{
+  unsigned long remainingTicks = timer->expirationTick - timerCurrentTick;
+  
+  size_t level = 0;
+  while( level < CAN_TIMER_WHEEL_LEVELS - 1 && remainingTicks >= ( 1UL << ( ( level + 1 ) * CAN_TIMER_WHEEL_BITS ) ) ) level++;
+  
+  size_t slot = ( timer->expirationTick >> ( level * CAN_TIMER_WHEEL_BITS ) ) & ( CAN_TIMER_WHEEL_SLOTS - 1 );
+  
+  timer->previous = NULL;
+  timer->next = timerSlotsList[ level ][ slot ];
+  if( timer->next != NULL ) timer->next->previous = timer;
+  timerSlotsList[ level ][ slot ] = timer;
+}
+
+static void RemoveTimer( CANTimer* timer )
+{
+  if( timer->next != NULL ) timer->next->previous = timer->previous;
+  if( timer->previous != NULL ) timer->previous->next = timer->next;
+  else
+  {
+    // Timer is a slot list head: find its slot from expiration tick
+    for( size_t level = 0; level < CAN_TIMER_WHEEL_LEVELS; level++ )
+    {
+      size_t slot = ( timer->expirationTick >> ( level * CAN_TIMER_WHEEL_BITS ) ) & ( CAN_TIMER_WHEEL_SLOTS - 1 );
+      if( timerSlotsList[ level ][ slot ] == timer )
+      {
+        timerSlotsList[ level ][ slot ] = timer->next;
+        break;
+      }
+    }
+  }
+  
+  timer->previous = timer->next = NULL;
+}
+
+static void StartTimerWheel()
+{
+  if( isTimerWheelStarted ) return;
+  
+  timerCurrentTick = Time_GetExecMilliseconds();
+  isTimerWheelStarted = true;
+}
+
+// Call callback (with given data) after delay milliseconds (at least 1), restarting timer if active
+void CANTimers_Start( CANTimer* timer, unsigned long delay, CANTimerCallback callback, void* callbackData )
+{
+  StartTimerWheel();
+  
+  if( timer->isActive ) RemoveTimer( timer );
+  
+  if( delay < 1 ) delay = 1;
+  if( delay > CAN_TIMER_DELAY_MAX ) delay = CAN_TIMER_DELAY_MAX;
+  
+  timer->expirationTick = timerCurrentTick + delay;
+  timer->callback = callback;
+  timer->callbackData = callbackData;
+  timer->isActive = true;
+  
+  InsertTimer( timer );
+}
+
+void CANTimers_Cancel( CANTimer* timer )
+{
+  if( !timer->isActive ) return;
+  
+  RemoveTimer( timer );
+  timer->isActive = false;
+}
+
+bool CANTimers_IsActive( CANTimer* timer )
+{
+  return timer->isActive;
+}
+
+// Advance wheel up to current time, calling callbacks of expired timers
+void CANTimers_Update()
+{
+  StartTimerWheel();
+  
+  unsigned long currentTime = Time_GetExecMilliseconds();
+  
+  while( (long) ( currentTime - timerCurrentTick ) > 0 )
+  {
+    timerCurrentTick++;
+    
+    // Move timers from higher levels down when lower level wheels complete a turn
+    for( size_t level = 1; level < CAN_TIMER_WHEEL_LEVELS; level++ )
+    {
+      if( ( timerCurrentTick & ( ( 1UL << ( level * CAN_TIMER_WHEEL_BITS ) ) - 1 ) ) != 0 ) break;
+      
+      size_t slot = ( timerCurrentTick >> ( level * CAN_TIMER_WHEEL_BITS ) ) & ( CAN_TIMER_WHEEL_SLOTS - 1 );
+      CANTimer* timer = timerSlotsList[ level ][ slot ];
+      timerSlotsList[ level ][ slot ] = NULL;
+      while( timer != NULL )
+      {
+        CANTimer* nextTimer = timer->next;
+        InsertTimer( timer );
+        timer = nextTimer;
+      }
+    }
+    
+    CANTimer** ref_slotTimer = &(timerSlotsList[ 0 ][ timerCurrentTick & ( CAN_TIMER_WHEEL_SLOTS - 1 ) ]);
+    while( *ref_slotTimer != NULL )
+    {
+      // Callbacks might start or cancel timers (even on this same slot)
+      CANTimer* timer = *ref_slotTimer;
+      RemoveTimer( timer );
+      timer->isActive = false;
+      timer->callback( timer->callbackData );
+    }
+  }
+}
+
+#endif  /* CAN_TIMERS_H */
@@ -0,0 +1,148 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                      //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>                 //
+//                                                                                      //
+//  This file is part of Signal-IO-NIXNET.                                              //
+//                                                                                      //
+//  Signal-IO-NIXNET is free software: you can redistribute it and/or modify            //
+//  it under the terms of the GNU Lesser General Public License as published            //
+//  by the Free Software Foundation, either version 3 of the License, or                //
+//  (at your option) any later version.                                                 //
+//                                                                                      //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,                 //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of                      //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                        //
+//  GNU Lesser General Public License for more details.                                 //
+//                                                                                      //
+//  You should have received a copy of the GNU Lesser General Public License            //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.            //
+//                                                                                      //
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+
+// Cycle phases span tracing (CYCLE_TRACING builds) into per-thread ring buffers, dumped as
+// Chrome trace JSON (chrome://tracing or Perfetto) to NIXNET_TRACE_FILE when the network stops.
+// With tracing compiled in but not enabled, each span costs a single (predictable) branch
+
+#ifndef CAN_TRACE_H
+#define CAN_TRACE_H
+
+#ifdef CYCLE_TRACING
+
+#include "timing/timing.h"
+
+#include "debug/data_logging.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#define CAN_TRACE_THREADS_NUMBER 8
+#define CAN_TRACE_BUFFER_LENGTH 16384       // Spans kept per thread (power of 2)
+
+typedef struct _CANTraceSpan
+{
+  const char* name;
+  double startTime, endTime;
+}
+CANTraceSpan;
+
+typedef struct _CANTraceBuffer
+{
+  CANTraceSpan spansList[ CAN_TRACE_BUFFER_LENGTH ];
+  size_t spansCount;
+}
+CANTraceBuffer;
+
+// Statically allocated, so that tracing does not add heap allocations to the cycle
+static CANTraceBuffer traceBuffersList[ CAN_TRACE_THREADS_NUMBER ];
+static size_t traceBuffersNumber = 0;
+static __thread CANTraceBuffer* threadTraceBuffer = NULL;
+static __thread bool isThreadTraceFull = false;
+
+static bool isTracing = false;
+static const char* traceFilePath = NULL;
+
+void CANTrace_AddSpan( const char* name, double startTime )
+{
+  double endTime = Time_GetExecSeconds();
+  
+  if( threadTraceBuffer == NULL )
+  {
+    if( isThreadTraceFull ) return;
+    size_t bufferIndex = __atomic_fetch_add( &traceBuffersNumber, 1, __ATOMIC_RELAXED );
+    if( bufferIndex >= CAN_TRACE_THREADS_NUMBER )
+    {
+      isThreadTraceFull = true;
+      return;
+    }
+    threadTraceBuffer = &(traceBuffersList[ bufferIndex ]);
+  }
+  
+  CANTraceSpan* span = &(threadTraceBuffer->spansList[ threadTraceBuffer->spansCount & ( CAN_TRACE_BUFFER_LENGTH - 1 ) ]);
+  span->name = name;
+  span->startTime = startTime;
+  span->endTime = endTime;
+  __atomic_store_n( &(threadTraceBuffer->spansCount), threadTraceBuffer->spansCount + 1, __ATOMIC_RELEASE );
+}
+
+// Enable tracing if NIXNET_TRACE_FILE environment variable is set
+void CANTrace_Start()
+{
+  traceFilePath = getenv( "NIXNET_TRACE_FILE" );
+  isTracing = ( traceFilePath != NULL );
+}
+
+// Disable tracing and dump last spans of each thread (call only when traced threads are idle)
+void CANTrace_Stop()
+{
+  if( !isTracing ) return;
+  
+  isTracing = false;
+  
+  FILE* traceFile = fopen( traceFilePath, "w" );
+  if( traceFile == NULL )
+  {
+    DEBUG_PRINT( "error opening trace file %s", traceFilePath );
+    return;
+  }
+  
+  fprintf( traceFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+  fprintf( traceFile, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"NI-XNET EPOS\"}}" );
+  size_t buffersNumber = __atomic_load_n( &traceBuffersNumber, __ATOMIC_RELAXED );
+  if( buffersNumber > CAN_TRACE_THREADS_NUMBER ) buffersNumber = CAN_TRACE_THREADS_NUMBER;
+  for( size_t bufferIndex = 0; bufferIndex < buffersNumber; bufferIndex++ )
+  {
+    CANTraceBuffer* buffer = &(traceBuffersList[ bufferIndex ]);
+    size_t spansCount = __atomic_load_n( &(buffer->spansCount), __ATOMIC_ACQUIRE );
+    size_t firstSpanIndex = ( spansCount > CAN_TRACE_BUFFER_LENGTH ) ? spansCount - CAN_TRACE_BUFFER_LENGTH : 0;
+    for( size_t spanIndex = firstSpanIndex; spanIndex < spansCount; spanIndex++ )
+    {
+      CANTraceSpan* span = &(buffer->spansList[ spanIndex & ( CAN_TRACE_BUFFER_LENGTH - 1 ) ]);
+      fprintf( traceFile, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f}", span->name, (unsigned long) bufferIndex, 
+               span->startTime * 1000000.0, ( span->endTime - span->startTime ) * 1000000.0 );
+    }
+    buffer->spansCount = 0;
+  }
+  fprintf( traceFile, "\n]}\n" );
+  
+  fclose( traceFile );
+}
+
+// Spans are identified by a plain name, used both for the start time variable and the trace
+#define CAN_TRACE_BEGIN( span ) double span##TraceStart = __builtin_expect( isTracing, false ) ? Time_GetExecSeconds() : 0.0
+#define CAN_TRACE_END( span ) if( __builtin_expect( isTracing, false ) ) CANTrace_AddSpan( #span, span##TraceStart )
+#define CAN_TRACE_START() CANTrace_Start()
+#define CAN_TRACE_STOP() CANTrace_Stop()
+
+#else
+
+#define CAN_TRACE_BEGIN( span )
+#define CAN_TRACE_END( span )
+#define CAN_TRACE_START()
+#define CAN_TRACE_STOP()
+
+#endif
+
+#endif  /* CAN_TRACE_H */
@@ -22,14 +22,17 @@
 
 #include "signal_io/signal_io.h"
 #include "can_network.h"
+#include "can_commands.h"
+#include "can_channels.h"
 
 #include "debug/data_logging.h"
 #include "timing/timing.h"
 
 #include "khash.h"
 
-enum { INPUT_POSITION, INPUT_VELOCITY, INPUT_CURRENT, INPUT_ANALOG, INPUT_CHANNELS_NUMBER };
-enum { OUTPUT_POSITION, OUTPUT_VELOCITY, OUTPUT_CURRENT, OUTPUT_CHANNELS_NUMBER };
+#include "alloc_tracking.h"
+#include "signal_io_statistics.h"
+#include "timed_event.h"
 
 enum States { READY_2_SWITCH_ON = 1, SWITCHED_ON = 2, OPERATION_ENABLED = 4, FAULT = 8, VOLTAGE_ENABLED = 16, 
               QUICK_STOPPED = 32, SWITCH_ON_DISABLE = 64, REMOTE_NMT = 512, TARGET_REACHED = 1024, SETPOINT_ACK = 4096 };
@@ -37,14 +40,61 @@ enum States { READY_2_SWITCH_ON = 1, SWITCHED_ON = 2, OPERATION_ENABLED = 4, FAU
 enum Controls { SWITCH_ON = 1, ENABLE_VOLTAGE = 2, QUICK_STOP = 4, ENABLE_OPERATION = 8, 
                 NEW_SETPOINT = 16, CHANGE_IMMEDIATEDLY = 32, ABS_REL = 64, FAULT_RESET = 128, HALT = 256 };
 
+// Statusword bits with edge detection (reported to status callback and WaitStatusEvent)
+const uint16_t STATUS_EVENTS_MASK = TARGET_REACHED | SETPOINT_ACK | FAULT | OPERATION_ENABLED;
+
+// Called from the network cycle with current statusword and bits that went up or down since last update
+typedef void (*StatusCallback)( uint16_t, uint16_t, uint16_t, void* );
+
+// Callback and its data, published together (double buffered: a binding is only rewritten once the network cycle left it)
+typedef struct _StatusCallbackBinding
+{
+  StatusCallback callback;
+  void* callbackData;
+}
+StatusCallbackBinding;
+
+enum StatusWaitState { STATUS_WAIT_NONE, STATUS_WAIT_ARMING, STATUS_WAIT_PENDING, STATUS_WAIT_EVENT, STATUS_WAIT_TIMEOUT };
+
+#define PROFILE_TARGETS_MAX 16
+
+const int PROFILE_POSITION_MODE = 0x01;
+
 typedef struct _SignalIOTaskData
 {
   CANFrame readFramesList[ CAN_FRAME_TYPES_NUMBER ];
   CANFrame writeFramesList[ CAN_FRAME_TYPES_NUMBER ];
+  uint8_t nodeID;
+  double startupPhaseTime;               // Start time of currently profiled startup phase
   uint16_t statusWord, controlWord;
-  double measuresList[ INPUT_CHANNELS_NUMBER ];
-  bool isReading, isOutputChannelUsed; 
-  uint8_t readPayload[ 8 ], writePayload[ 8 ];
+  CANChannelsMap channels;
+  double measuresList[ CAN_CHANNELS_MAX ];
+  unsigned long readSync, writeSync;     // Network cycles of last measures update and setpoints write
+  uint32_t readChannelsMask;             // Channels already read since last measures update
+  uint32_t outputChannelsMask;           // Acquired output channels, to be written on every network cycle
+  uint32_t writtenChannelsMask;          // Output channels written since last SYNC
+  bool isReading, isOutputChannelUsed, isOutputReady; 
+  uint8_t readPayload[ 8 ];
+  uint8_t writePayloadsList[ CAN_FRAME_TYPES_NUMBER ][ 8 ];  // Last values of every RPDO object
+  StatusCallbackBinding statusCallbacksList[ 2 ];
+  int statusCallbackIndex;               // Current binding
+  int callingStatusCallback;             // Binding being called by the network cycle (-1 for none)
+  bool isSettingStatusCallback;
+  uint16_t waitedStatusBits, waitedStatusValue;
+  int statusWaitState;
+  TimedEvent statusEvent;
+  bool hasStatusEvent;
+  unsigned int outputChannel;
+  int32_t targetsList[ PROFILE_TARGETS_MAX ];  // Profile position targets not yet sent to the drive
+  size_t targetsStart, targetsNumber;
+  int32_t currentTarget, lastQueuedTarget;
+  bool hasQueuedTarget;
+  unsigned int pdoDivisorsList[ CAN_FRAME_TYPES_NUMBER ];   // PDOs are exchanged every <divisor> network cycles
+  unsigned int pdoPhasesList[ CAN_FRAME_TYPES_NUMBER ];     // Scheduled SYNCs offset (RPDOs written before them, TPDOs answering them)
+  int inputPhasesList[ CAN_FRAME_TYPES_NUMBER ];            // Answered SYNCs offset of TPDOs (-1 if unknown, until observed)
+  double lastMeasuresTime;               // For measures update period statistics
+  CANMetricsTimes cycleTimes;
+  unsigned long overrunsCount, staleSamplesCount;
 }
 SignalIOTaskData;
 
@@ -53,6 +103,11 @@ typedef SignalIOTaskData* SignalIOTask;
 KHASH_MAP_INIT_INT( TaskInt, SignalIOTask )
 static khash_t( TaskInt )* tasksList = NULL;
 
+// The SYNC of each network cycle goes out as soon as every task with acquired outputs wrote all of them, 
+// so that setpoints are applied on the cycle they were written for (unless the host calls StartNetworkCycle)
+static size_t outputTasksNumber = 0, writtenTasksNumber = 0;
+static bool isCycleExplicit = false;
+
 DECLARE_MODULE_INTERFACE( SIGNAL_IO_INTERFACE ); 
 
 static SignalIOTask LoadTaskData( const char* );
@@ -60,9 +115,22 @@ static void UnloadTaskData( SignalIOTask );
 
 static void* AsyncReadBuffer( void* );
 static void EnableOutput( SignalIOTask, bool );
+static void ReadMeasures( SignalIOTask );
+static void SyncNetwork();
+static bool IsTaskWritten( SignalIOTask );
+static void SetOutputChannels( SignalIOTask, uint32_t );
+static void WriteOutputs( SignalIOTask );
+static void EndConfigurationPhase( void*, int );
+static void EndEnablePhase( void*, int );
+static void UpdateStatusEvents( SignalIOTask, uint16_t );
+static void UpdateProfileSetpoint( SignalIOTask, int64_t );
+static bool ReadInput( SignalIOTask, enum CANFrameTypes );
+static void UpdateMeasures( SignalIOTask, enum CANFrameTypes );
 
 int InitDevice( const char* taskConfig )
 {
+  ALLOCATION_PHASE( INIT );
+  
   if( tasksList == NULL ) tasksList = kh_init( TaskInt );
   
   int taskKey = (int) kh_str_hash_func( taskConfig );
@@ -77,7 +145,8 @@ int InitDevice( const char* taskConfig )
     if( kh_value( tasksList, newTaskIndex ) == NULL )
     {
       DEBUG_PRINT( "loading task %s failed", taskConfig );
-      EndDevice( taskKey ); 
+      // No task data to release
+      kh_del( TaskInt, tasksList, newTaskIndex );
       return -1;
     }
         
@@ -90,6 +159,8 @@ int InitDevice( const char* taskConfig )
 
 void EndDevice( int taskID )
 {
+  ALLOCATION_PHASE( SHUTDOWN );
+  
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return;
   
@@ -99,9 +170,21 @@ void EndDevice( int taskID )
   
   EnableOutput( task, false );
   
+  SetOutputChannels( task, 0 );
+  
+  // Back to TPDOs sent on every SYNC
+  for( size_t pdoType = PDO01; pdoType < CAN_FRAME_TYPES_NUMBER; pdoType++ )
+  {
+    if( task->pdoDivisorsList[ pdoType ] > 1 ) 
+      CANChannels_WriteSchedule( pdoType, 1, 0, task->writeFramesList[ SDO ], task->readFramesList[ SDO ], task->nodeID );
+  }
+  
+  // Frames are released below, so no queued command may still refer to them
+  CANCommands_Flush();
+  
   UnloadTaskData( task );
   
-  kh_del( TaskInt, tasksList, (khint_t) taskID );
+  kh_del( TaskInt, tasksList, taskIndex );
   
   if( kh_size( tasksList ) == 0 )
   {
@@ -120,33 +203,23 @@ size_t GetMaxInputSamplesNumber( int taskID )
 
 size_t Read( int taskID, unsigned int channel, double* ref_value )
 {
+  ALLOCATION_PHASE( CYCLE );
+  
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return 0;
   
   SignalIOTask task = kh_value( tasksList, taskIndex );
   
-  if( channel >= INPUT_CHANNELS_NUMBER ) return 0;
-  
-  CANNetwork_Sync();
+  if( channel >= task->channels.inputsNumber ) return 0;
   
-  // Read values from PDO01 (Position, Current and Status Word) to buffer
-  CANFrame_Read( task->readFramesList[ PDO01 ], task->readPayload );  
-  // Update values from PDO01
-  task->measuresList[ INPUT_POSITION ] = task->readPayload[ 3 ] * 0x1000000 + task->readPayload[ 2 ] * 0x10000 + task->readPayload[ 1 ] * 0x100 + task->readPayload[ 0 ];
-  int currentHEX = task->readPayload[ 5 ] * 0x100 + task->readPayload[ 4 ];
-  double currentMA = currentHEX - ( ( currentHEX >= 0x8000 ) ? 0xFFFF : 0 );
-  task->measuresList[ INPUT_CURRENT ] = currentMA / 1000.0;
+  // Without outputs in use (or explicit cycles), setpoint writes can't mark cycles: reading a channel twice starts a new one
+  if( outputTasksNumber == 0 && !isCycleExplicit && task->readSync == CANNetwork_GetSyncCount() && ( task->readChannelsMask & ( 1 << channel ) ) ) 
+    SyncNetwork();
   
-  //DEBUG_PRINT( "current: hex=%d, mA=%d, A=%g", currentHEX, currentHEX - ( ( currentHEX >= 0x8000 ) ? 0xFFFF : 0 ), task->measuresList[ INPUT_CURRENT ] );
+  if( task->readSync != CANNetwork_GetSyncCount() ) ReadMeasures( task );
   
-  task->statusWord = task->readPayload[ 7 ] * 0x100 + task->readPayload[ 6 ];
+  task->readChannelsMask |= ( 1 << channel );
   
-  // Read values from PDO02 (Velocity and Tension) to buffer
-  CANFrame_Read( task->readFramesList[ PDO02 ], task->readPayload );  
-  // Update values from PDO02
-  task->measuresList[ INPUT_VELOCITY ] = task->readPayload[ 3 ] * 0x1000000 + task->readPayload[ 2 ] * 0x10000 + task->readPayload[ 1 ] * 0x100 + task->readPayload[ 0 ];
-  task->measuresList[ INPUT_ANALOG ] = task->readPayload[ 5 ] * 0x100 + task->readPayload[ 4 ];
-    
   *ref_value = task->measuresList[ channel ];
   
   return 1;
@@ -154,6 +227,8 @@ size_t Read( int taskID, unsigned int channel, double* ref_value )
 
 bool HasError( int taskID )
 {
+  ALLOCATION_PHASE( CYCLE );
+  
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return false;
   
@@ -166,18 +241,18 @@ bool HasError( int taskID )
 
 void Reset( int taskID )
 {
+  ALLOCATION_PHASE( CYCLE );
+  
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return;
   
   SignalIOTask task = kh_value( tasksList, taskIndex );
   
   task->controlWord |= FAULT_RESET;
-  CANNetwork_WriteSingleValue( task->writeFramesList[ SDO ], 0x6040, 0x00, task->controlWord );
-  
-  Time_Delay( 200 );
+  CANCommands_WriteSingleValue( task->writeFramesList[ SDO ], task->readFramesList[ SDO ], 0x6040, 0x00, task->controlWord, 0, NULL, NULL );
   
   task->controlWord &= (~FAULT_RESET);
-  CANNetwork_WriteSingleValue( task->writeFramesList[ SDO ], 0x6040, 0x00, task->controlWord );
+  CANCommands_WriteSingleValue( task->writeFramesList[ SDO ], task->readFramesList[ SDO ], 0x6040, 0x00, task->controlWord, 200, NULL, NULL );
 }
 
 bool CheckInputChannel( int taskID, unsigned int channel )
@@ -185,70 +260,79 @@ bool CheckInputChannel( int taskID, unsigned int channel )
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return false;
   
-  if( channel >= INPUT_CHANNELS_NUMBER ) return false;
+  SignalIOTask task = kh_value( tasksList, taskIndex );
+  
+  if( channel >= task->channels.inputsNumber ) return false;
   
   return true;
 }
 
 bool Write( int taskID, unsigned int channel, double value )
 {
+  ALLOCATION_PHASE( CYCLE );
+  
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return false;
   
   SignalIOTask task = kh_value( tasksList, taskIndex );
   
-  int encoderSetpoint = (int) value;
-  
-  double currentSetpointMA = value * 1000.0;
-  int16_t currentSetpointHEX = (int16_t) currentSetpointMA + ( ( currentSetpointMA < 0.0 ) ? 0xFFFF : 0 );
-  //DEBUG_PRINT( "current setpoint: %d (hex: %d)", (int16_t) currentSetpointMA, currentSetpointHEX );
-  
-  // Set values for PDO01 (Position Setpoint and Control Word)
-  task->writePayload[ 0 ] = (uint8_t) ( encoderSetpoint & 0x000000FF );
-  task->writePayload[ 1 ] = (uint8_t) ( ( encoderSetpoint & 0x0000FF00 ) / 0x100 );
-  task->writePayload[ 2 ] = (uint8_t) ( ( encoderSetpoint & 0x00FF0000 ) / 0x10000 );
-  task->writePayload[ 3 ] = (uint8_t) ( ( encoderSetpoint & 0xFF000000 ) / 0x1000000 );
-  task->writePayload[ 4 ] = (uint8_t) ( currentSetpointHEX & 0x000000FF );
-  task->writePayload[ 5 ] = (uint8_t) ( ( currentSetpointHEX & 0x0000FF00 ) / 0x100 ); 
-  task->writePayload[ 6 ] = (uint8_t) ( task->controlWord & 0x000000FF );
-  task->writePayload[ 7 ] = (uint8_t) ( ( task->controlWord & 0x0000FF00 ) / 0x100 ); 
-  
-  // Write values from buffer to PDO01 
-  CANFrame_Write( task->writeFramesList[ PDO01 ], task->writePayload );
-  
-  int velocitySetpointRPM = (int) value;
-  int16_t digitalOutput = (int16_t) value;
-  
-  // Set values for PDO02 (Velocity Setpoint and Digital Output)
-  task->writePayload[ 0 ] = (uint8_t) ( velocitySetpointRPM & 0x000000FF );
-  task->writePayload[ 1 ] = (uint8_t) ( ( velocitySetpointRPM & 0x0000FF00 ) / 0x100 );
-  task->writePayload[ 2 ] = (uint8_t) ( ( velocitySetpointRPM & 0x00FF0000 ) / 0x10000 );
-  task->writePayload[ 3 ] = (uint8_t) ( ( velocitySetpointRPM & 0xFF000000 ) / 0x1000000 );
-  task->writePayload[ 4 ] = (uint8_t) ( digitalOutput & 0x000000FF );
-  task->writePayload[ 5 ] = (uint8_t) ( ( digitalOutput & 0x0000FF00 ) / 0x100 ); 
-  task->writePayload[ 6 ] = ( 0 & 0x000000FF );
-  task->writePayload[ 7 ] = ( 0 & 0x0000FF00 ) / 0x100; 
-  
-  // Write values from buffer to PDO01
-  CANFrame_Write( task->writeFramesList[ PDO02 ], task->writePayload );
+  if( channel >= task->channels.outputsNumber ) return false;
   
-  CANNetwork_Sync();
+  CAN_TRACE_BEGIN( setpoints_update );
+  
+  CANChannel* outputChannel = &(task->channels.outputsList[ channel ]);
+  int64_t rawSetpoint = (int64_t) ( value * outputChannel->rawScale );
+  
+  if( outputChannel->operationMode == PROFILE_POSITION_MODE && task->isOutputChannelUsed && task->outputChannel == channel )
+  {
+    UpdateProfileSetpoint( task, rawSetpoint );
+    rawSetpoint = task->currentTarget;
+  }
+  
+  // Update channel object and Control Word on RPDO buffers
+  CANChannel_Encode( outputChannel, rawSetpoint, task->writePayloadsList[ outputChannel->pdoType ] );
+  if( task->channels.controlWord.pdoType < CAN_FRAME_TYPES_NUMBER )
+    CANChannel_Encode( &(task->channels.controlWord), task->controlWord, task->writePayloadsList[ task->channels.controlWord.pdoType ] );
+  
+  if( task->writeSync != CANNetwork_GetSyncCount() ) task->writtenChannelsMask = 0;
+  task->writeSync = CANNetwork_GetSyncCount();
+  
+  bool wasTaskWritten = IsTaskWritten( task );
+  task->writtenChannelsMask |= ( 1 << channel );
+  
+  // RPDOs are sent once all acquired outputs have their setpoints (or on every write to a task without them)
+  if( task->outputChannelsMask == 0 || IsTaskWritten( task ) ) WriteOutputs( task );
+  
+  CAN_TRACE_END( setpoints_update );
+  
+  // Last task with outputs written for this cycle: send its SYNC right away
+  if( !wasTaskWritten && IsTaskWritten( task ) ) writtenTasksNumber++;
+  if( outputTasksNumber > 0 && writtenTasksNumber >= outputTasksNumber && !isCycleExplicit ) SyncNetwork();
   
   return true;
 }
 
+// Start a new network cycle (SYNC and queued commands) explicitly, e.g. for devices without outputs in use. 
+// Once called, the plug-in stops sending SYNC by itself when all outputs are written
+void StartNetworkCycle()
+{
+  ALLOCATION_PHASE( CYCLE );
+  
+  isCycleExplicit = true;
+  
+  SyncNetwork();
+}
+
 void EnableOutput( SignalIOTask task, bool enable )
 {
   task->controlWord |= SWITCH_ON;
   task->controlWord &= (~ENABLE_OPERATION);
-  CANNetwork_WriteSingleValue( task->writeFramesList[ SDO ], 0x6040, 0x00, task->controlWord );
-  
-  Time_Delay( 200 );
+  CANCommands_WriteSingleValue( task->writeFramesList[ SDO ], task->readFramesList[ SDO ], 0x6040, 0x00, task->controlWord, 0, NULL, NULL );
   
   if( enable ) task->controlWord |= ENABLE_OPERATION;
   else task->controlWord &= (~SWITCH_ON);
     
-  CANNetwork_WriteSingleValue( task->writeFramesList[ SDO ], 0x6040, 0x00, task->controlWord );
+  CANCommands_WriteSingleValue( task->writeFramesList[ SDO ], task->readFramesList[ SDO ], 0x6040, 0x00, task->controlWord, 200, enable ? EndEnablePhase : NULL, task );
 }
 
 //bool IsOutputEnabled( int taskID )
@@ -265,41 +349,86 @@ void EnableOutput( SignalIOTask task, bool enable )
 
 bool AcquireOutputChannel( int taskID, unsigned int channel )
 {
-  const int OPERATION_MODES[ OUTPUT_CHANNELS_NUMBER ] = { 0xFF, 0xFE, 0xFD };
+  ALLOCATION_PHASE( INIT );
   
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return false;
   
   SignalIOTask task = kh_value( tasksList, taskIndex );
   
-  if( channel >= OUTPUT_CHANNELS_NUMBER ) return false;
+  if( channel >= task->channels.outputsNumber ) return false;
+  
+  // Outputs that don't select an operation mode (e.g. digital outputs) may be written along with the active one
+  CANChannel* outputChannel = &(task->channels.outputsList[ channel ]);
+  if( outputChannel->operationMode == 0 ) 
+  {
+    SetOutputChannels( task, task->outputChannelsMask | ( 1 << channel ) );
+    return true;
+  }
   
   if( task->isOutputChannelUsed ) return false;
   
-  DEBUG_PRINT( "setting operation mode %X", OPERATION_MODES[ channel ] );
+  DEBUG_PRINT( "setting operation mode %X", outputChannel->operationMode );
+  
+  // Commands are executed by the network cycle, so the call returns before the output is enabled
+  task->startupPhaseTime = StartupProfile_GetTime();
+  CANCommands_WriteSingleValue( task->writeFramesList[ SDO ], task->readFramesList[ SDO ], 0x6060, 0x00, outputChannel->operationMode, 0, EndConfigurationPhase, task );
+  
+  task->isOutputReady = false;
+  if( outputChannel->operationMode == PROFILE_POSITION_MODE )
+  {
+    task->targetsNumber = 0;
+    task->hasQueuedTarget = false;
+    // Absolute targets, each one started after the previous is reached
+    task->controlWord &= (~( NEW_SETPOINT | CHANGE_IMMEDIATEDLY | ABS_REL ));
+  }
   
-  CANNetwork_WriteSingleValue( task->writeFramesList[ SDO ], 0x6060, 0x00, OPERATION_MODES[ channel ] );
+  // Channel object may share its RPDO position with another one (e.g. profile target and position setting)
+  if( outputChannel->mappingEntry != CANChannels_GetMappedEntry( &(task->channels), outputChannel ) )
+    CANChannels_WriteOutputEntry( &(task->channels), outputChannel, outputChannel->mappingEntry, task->writeFramesList[ SDO ], task->readFramesList[ SDO ], task->nodeID );
   
   EnableOutput( task, true );
   
+  task->outputChannel = channel;
   task->isOutputChannelUsed = true;
   
+  SetOutputChannels( task, task->outputChannelsMask | ( 1 << channel ) );
+  
   return true;
 }
 
 void ReleaseOutputChannel( int taskID, unsigned int channel )
 {
+  ALLOCATION_PHASE( INIT );
+  
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return;
   
   SignalIOTask task = kh_value( tasksList, taskIndex );
   
-  if( channel >= OUTPUT_CHANNELS_NUMBER ) return;
+  if( channel >= task->channels.outputsNumber ) return;
+  
+  if( !( task->outputChannelsMask & ( 1 << channel ) ) ) return;
+  
+  SetOutputChannels( task, task->outputChannelsMask & ~( 1 << channel ) );
   
-  CANNetwork_WriteSingleValue( task->writeFramesList[ SDO ], 0x6060, 0x00, 0x00 );
+  if( task->channels.outputsList[ channel ].operationMode == 0 || !task->isOutputChannelUsed ) return;
+  
+  // Releasing another output (not the one in use) must not reset its operation mode
+  if( channel != task->outputChannel ) return;
+  
+  CANCommands_WriteSingleValue( task->writeFramesList[ SDO ], task->readFramesList[ SDO ], 0x6060, 0x00, 0x00, 0, NULL, NULL );
   
   EnableOutput( task, false );
   
+  CANChannel* outputChannel = &(task->channels.outputsList[ task->outputChannel ]);
+  if( outputChannel->operationMode == PROFILE_POSITION_MODE ) task->controlWord &= (~NEW_SETPOINT);
+  
+  uint32_t mappedEntry = CANChannels_GetMappedEntry( &(task->channels), outputChannel );
+  if( outputChannel->mappingEntry != mappedEntry )
+    CANChannels_WriteOutputEntry( &(task->channels), outputChannel, mappedEntry, task->writeFramesList[ SDO ], task->readFramesList[ SDO ], task->nodeID );
+  
+  task->outputChannel = 0;
   task->isOutputChannelUsed = false;
 }
 
@@ -310,7 +439,16 @@ SignalIOTask LoadTaskData( const char* taskConfig )
   SignalIOTask newTask = (SignalIOTask) malloc( sizeof(SignalIOTaskData) );
   memset( newTask, 0, sizeof(SignalIOTaskData) );
   
-  unsigned int nodeID = (unsigned int) strtoul( taskConfig, NULL, 0 );
+  char* configEnd;
+  unsigned int nodeID = (unsigned int) strtoul( taskConfig, &configEnd, 0 );
+  newTask->nodeID = (uint8_t) nodeID;
+  
+  // Optional PDO mapping tokens follow node configuration, after a space
+  if( !CANChannels_Load( &(newTask->channels), strpbrk( taskConfig, " \t" ) ) )
+  {
+    DEBUG_PRINT( "invalid PDO mapping configuration: %s", taskConfig );
+    loadError = true;
+  }
   
   //DEBUG_PRINT( "trying to load CAN interface for node %u", nodeID );
   
@@ -322,18 +460,363 @@ SignalIOTask LoadTaskData( const char* taskConfig )
   
   newTask->isOutputChannelUsed = false;
   
+  newTask->callingStatusCallback = -1;
+  if( !(newTask->hasStatusEvent = TimedEvent_Init( &(newTask->statusEvent) )) ) loadError = true;
+  
   if( loadError )
   {
     UnloadTaskData( newTask );
     return NULL;
   }
   
+  // No measures or setpoints for current network cycle yet
+  newTask->readSync = newTask->writeSync = CANNetwork_GetSyncCount() - 1;
+  newTask->lastMeasuresTime = -1.0;
+  
+  // Optional rate divisors (from "<node>:<node divisor>:<PDO01 divisor>:<PDO02 divisor>" configuration), 
+  // applied to both RPDOs (written on their scheduled cycles) and TPDOs (by their transmission type and start value)
+  CANChannels_LoadSchedule( configEnd, newTask->pdoDivisorsList, newTask->pdoPhasesList );
+  for( size_t pdoType = PDO01; pdoType < CAN_FRAME_TYPES_NUMBER; pdoType++ )
+  {
+    newTask->inputPhasesList[ pdoType ] = (int) newTask->pdoPhasesList[ pdoType ];
+    if( newTask->pdoDivisorsList[ pdoType ] > 1 ) 
+      CANChannels_WriteSchedule( pdoType, newTask->pdoDivisorsList[ pdoType ], newTask->pdoPhasesList[ pdoType ], newTask->writeFramesList[ SDO ], newTask->readFramesList[ SDO ], nodeID );
+  }
+  
+  CANChannels_WriteMapping( &(newTask->channels), newTask->writeFramesList[ SDO ], newTask->readFramesList[ SDO ], nodeID );
+  
+  newTask->startupPhaseTime = StartupProfile_GetTime();
   newTask->controlWord = ENABLE_VOLTAGE | QUICK_STOP;
-  CANNetwork_WriteSingleValue( newTask->writeFramesList[ SDO ], 0x6040, 0x00, newTask->controlWord );
+  CANCommands_WriteSingleValue( newTask->writeFramesList[ SDO ], newTask->readFramesList[ SDO ], 0x6040, 0x00, newTask->controlWord, 0, EndConfigurationPhase, newTask );
   
   return newTask;
 }
 
+// Set function called from the network cycle (Read/Write calls) on statusword edges (NULL to disable).
+// Not to be called from the status callback itself
+void SetStatusCallback( int taskID, StatusCallback callback, void* callbackData )
+{
+  ALLOCATION_PHASE( INIT );
+  
+  khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
+  if( taskIndex == kh_end( tasksList ) ) return;
+  
+  SignalIOTask task = kh_value( tasksList, taskIndex );
+  
+  while( __atomic_test_and_set( &(task->isSettingStatusCallback), __ATOMIC_ACQUIRE ) );
+  
+  // Rewrite the binding replaced on last call, once the network cycle is no longer calling it
+  int spareIndex = 1 - __atomic_load_n( &(task->statusCallbackIndex), __ATOMIC_SEQ_CST );
+  while( __atomic_load_n( &(task->callingStatusCallback), __ATOMIC_SEQ_CST ) == spareIndex );
+  
+  task->statusCallbacksList[ spareIndex ].callback = callback;
+  task->statusCallbacksList[ spareIndex ].callbackData = callbackData;
+  __atomic_store_n( &(task->statusCallbackIndex), spareIndex, __ATOMIC_SEQ_CST );
+  
+  __atomic_clear( &(task->isSettingStatusCallback), __ATOMIC_RELEASE );
+}
+
+// Block until given statusword bits change to set or cleared state, or timeout (in milliseconds) expires.
+// Edges are detected by the network cycle, so another thread must keep calling Read/Write meanwhile
+// (otherwise the wait times out). Only one thread may wait on each device at a time
+bool WaitStatusEvent( int taskID, uint16_t statusBits, bool isSet, unsigned long timeout )
+{
+  khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
+  if( taskIndex == kh_end( tasksList ) ) return false;
+  
+  SignalIOTask task = kh_value( tasksList, taskIndex );
+  
+  if( ( statusBits & STATUS_EVENTS_MASK ) == 0 ) return false;
+  
+  int waitState = STATUS_WAIT_NONE;
+  if( !__atomic_compare_exchange_n( &(task->statusWaitState), &waitState, STATUS_WAIT_ARMING, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) ) return false;
+  
+  task->waitedStatusBits = statusBits & STATUS_EVENTS_MASK;
+  task->waitedStatusValue = isSet ? task->waitedStatusBits : 0;
+  TimedEvent_Reset( &(task->statusEvent) );
+  __atomic_store_n( &(task->statusWaitState), STATUS_WAIT_PENDING, __ATOMIC_RELEASE );
+  
+  // Woken by the network cycle on the event
+  if( !TimedEvent_Wait( &(task->statusEvent), timeout ) )
+  {
+    // Unless the event came meanwhile
+    waitState = STATUS_WAIT_PENDING;
+    __atomic_compare_exchange_n( &(task->statusWaitState), &waitState, STATUS_WAIT_TIMEOUT, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE );
+  }
+  
+  bool hasEvent = ( __atomic_load_n( &(task->statusWaitState), __ATOMIC_ACQUIRE ) == STATUS_WAIT_EVENT );
+  __atomic_store_n( &(task->statusWaitState), STATUS_WAIT_NONE, __ATOMIC_RELEASE );
+  
+  return hasEvent;
+}
+
+// Fill statistics for given device (returns false for unknown task)
+bool GetStatistics( int taskID, SignalIOStatistics* ref_statistics )
+{
+  SignalIOStatistics statistics;
+  
+  khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
+  if( taskIndex == kh_end( tasksList ) ) return false;
+  
+  SignalIOTask task = kh_value( tasksList, taskIndex );
+  
+  statistics.cyclesCount = (unsigned long) CANMetrics_GetTimes( &(task->cycleTimes), &(statistics.minCycleTime), &(statistics.averageCycleTime), &(statistics.maxCycleTime) );
+  statistics.overrunsCount = __atomic_load_n( &(task->overrunsCount), __ATOMIC_RELAXED );
+  statistics.framesReceivedCount = (unsigned long) CANMetrics_GetFramesCount( task->nodeID, false );
+  statistics.framesSentCount = (unsigned long) CANMetrics_GetFramesCount( task->nodeID, true );
+  statistics.errorsCount = (unsigned long) CANMetrics_GetErrorsCount( task->nodeID );
+  statistics.staleSamplesCount = __atomic_load_n( &(task->staleSamplesCount), __ATOMIC_RELAXED );
+  statistics.sdoTransfersCount = (unsigned long) CANMetrics_GetTimes( &(metrics.nodeSDOTimes[ task->nodeID ]), &(statistics.minSDOLatency), 
+                                                                     &(statistics.averageSDOLatency), &(statistics.maxSDOLatency) );
+  statistics.responsesCount = (unsigned long) CANMetrics_GetResponseTimes( task->nodeID, &(statistics.minResponseTime), 
+                                                                         &(statistics.averageResponseTime), &(statistics.maxResponseTime) );
+  
+  return SignalIOStatistics_Copy( &statistics, ref_statistics );
+}
+
+// Fill statistics for the whole CAN network (stale samples counted over all devices, without going through them)
+bool GetBusStatistics( SignalIOStatistics* ref_statistics )
+{
+  SignalIOStatistics statistics;
+  
+  statistics.cyclesCount = (unsigned long) CANMetrics_GetTimes( &(metrics.cycleTimes), &(statistics.minCycleTime), &(statistics.averageCycleTime), &(statistics.maxCycleTime) );
+  statistics.overrunsCount = (unsigned long) __atomic_load_n( &(metrics.overrunsCount), __ATOMIC_RELAXED );
+  statistics.framesReceivedCount = (unsigned long) CANMetrics_GetFramesCount( CAN_METRICS_ALL_NODES, false );
+  statistics.framesSentCount = (unsigned long) CANMetrics_GetFramesCount( CAN_METRICS_ALL_NODES, true );
+  statistics.errorsCount = (unsigned long) CANMetrics_GetErrorsCount( CAN_METRICS_ALL_NODES );
+  statistics.staleSamplesCount = (unsigned long) CANMetrics_GetStaleSamplesCount();
+  statistics.sdoTransfersCount = (unsigned long) CANMetrics_GetTimes( &(metrics.nodeSDOTimes[ CAN_METRICS_ALL_NODES ]), &(statistics.minSDOLatency), 
+                                                                     &(statistics.averageSDOLatency), &(statistics.maxSDOLatency) );
+  statistics.responsesCount = (unsigned long) CANMetrics_GetResponseTimes( CAN_METRICS_ALL_NODES, &(statistics.minResponseTime), 
+                                                                         &(statistics.averageResponseTime), &(statistics.maxResponseTime) );
+  
+  return SignalIOStatistics_Copy( &statistics, ref_statistics );
+}
+
+// Profile position handshake, one step per network cycle: a queued target is sent with NEW_SETPOINT,
+// which is cleared once the drive acknowledges it (SETPOINT_ACK), so the next target can follow
+// while the drive is still moving to the previous one (targets in raw units, after channel scaling)
+void UpdateProfileSetpoint( SignalIOTask task, int64_t rawSetpoint )
+{
+  int32_t target = (int32_t) rawSetpoint;
+  
+  // Queue only new targets, as the same value is usually written on every cycle
+  if( !task->hasQueuedTarget || target != task->lastQueuedTarget )
+  {
+    if( task->targetsNumber < PROFILE_TARGETS_MAX )
+    {
+      task->targetsList[ ( task->targetsStart + task->targetsNumber ) % PROFILE_TARGETS_MAX ] = target;
+      task->targetsNumber++;
+      task->lastQueuedTarget = target;
+      task->hasQueuedTarget = true;
+    }
+    else DEBUG_PRINT( "profile targets queue full (%u targets)", PROFILE_TARGETS_MAX );
+  }
+  
+  if( task->controlWord & NEW_SETPOINT )
+  {
+    if( task->statusWord & SETPOINT_ACK ) task->controlWord &= (~NEW_SETPOINT);
+  }
+  // Targets wait for operation mode and mapping changes to be done, so that the drive doesn't take them for another object
+  else if( task->isOutputReady && !( task->statusWord & SETPOINT_ACK ) && task->targetsNumber > 0 )
+  {
+    task->currentTarget = task->targetsList[ task->targetsStart ];
+    task->targetsStart = ( task->targetsStart + 1 ) % PROFILE_TARGETS_MAX;
+    task->targetsNumber--;
+    task->controlWord |= NEW_SETPOINT;
+  }
+}
+
+// Report statusword edges to callback and waiting thread (called from the network cycle)
+void UpdateStatusEvents( SignalIOTask task, uint16_t lastStatusWord )
+{
+  uint16_t changedBits = ( lastStatusWord ^ task->statusWord ) & STATUS_EVENTS_MASK;
+  
+  // Mark binding as in use before calling it (checking that it wasn't replaced meanwhile)
+  int bindingIndex;
+  do
+  {
+    bindingIndex = __atomic_load_n( &(task->statusCallbackIndex), __ATOMIC_SEQ_CST );
+    __atomic_store_n( &(task->callingStatusCallback), bindingIndex, __ATOMIC_SEQ_CST );
+  }
+  while( __atomic_load_n( &(task->statusCallbackIndex), __ATOMIC_SEQ_CST ) != bindingIndex );
+  
+  StatusCallbackBinding* binding = &(task->statusCallbacksList[ bindingIndex ]);
+  if( binding->callback != NULL ) 
+    binding->callback( task->statusWord, changedBits & task->statusWord, changedBits & lastStatusWord, binding->callbackData );
+  
+  __atomic_store_n( &(task->callingStatusCallback), -1, __ATOMIC_SEQ_CST );
+  
+  if( __atomic_load_n( &(task->statusWaitState), __ATOMIC_ACQUIRE ) != STATUS_WAIT_PENDING ) return;
+  
+  if( !( changedBits & task->waitedStatusBits ) || ( task->statusWord & task->waitedStatusBits ) != task->waitedStatusValue ) return;
+  
+  int waitState = STATUS_WAIT_PENDING;
+  if( __atomic_compare_exchange_n( &(task->statusWaitState), &waitState, STATUS_WAIT_EVENT, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) )
+    TimedEvent_Signal( &(task->statusEvent) );
+}
+
+// Check if all acquired outputs of task were written on current network cycle
+bool IsTaskWritten( SignalIOTask task )
+{
+  if( task->outputChannelsMask == 0 || task->writeSync != CANNetwork_GetSyncCount() ) return false;
+  
+  return ( ( task->outputChannelsMask & ~task->writtenChannelsMask ) == 0 );
+}
+
+// Update acquired output channels of task, and the tasks (written or not) the network cycle waits for
+void SetOutputChannels( SignalIOTask task, uint32_t channelsMask )
+{
+  bool wasOutputTask = ( task->outputChannelsMask != 0 );
+  bool wasTaskWritten = IsTaskWritten( task );
+  
+  task->outputChannelsMask = channelsMask;
+  
+  if( wasOutputTask != ( channelsMask != 0 ) ) outputTasksNumber += wasOutputTask ? -1 : 1;
+  if( wasTaskWritten != IsTaskWritten( task ) ) writtenTasksNumber += wasTaskWritten ? -1 : 1;
+}
+
+// Write values from buffers to RPDOs (on their scheduled cycles), to be applied on next SYNC
+void WriteOutputs( SignalIOTask task )
+{
+  if( CANNetwork_IsScheduled( task->pdoDivisorsList[ PDO01 ], task->pdoPhasesList[ PDO01 ] ) )
+  {
+    CAN_TRACE_BEGIN( rpdo01_write );
+    CANFrame_Write( task->writeFramesList[ PDO01 ], task->writePayloadsList[ PDO01 ] );
+    CAN_TRACE_END( rpdo01_write );
+    CANNetwork_AddPendingOutputs( task->writeFramesList + PDO01, 1 );
+  }
+  
+  if( CANNetwork_IsScheduled( task->pdoDivisorsList[ PDO02 ], task->pdoPhasesList[ PDO02 ] ) )
+  {
+    CAN_TRACE_BEGIN( rpdo02_write );
+    CANFrame_Write( task->writeFramesList[ PDO02 ], task->writePayloadsList[ PDO02 ] );
+    CAN_TRACE_END( rpdo02_write );
+    CANNetwork_AddPendingOutputs( task->writeFramesList + PDO02, 1 );
+  }
+}
+
+// Start new network cycle and execute queued SDO/NMT commands on it
+void SyncNetwork()
+{
+  CAN_PROBE1( cycle_end, CANNetwork_GetSyncCount() );
+  
+  CANNetwork_Sync();
+  
+  writtenTasksNumber = 0;
+  
+  CAN_TRACE_BEGIN( commands );
+  CANCommands_Process();
+  CAN_TRACE_END( commands );
+  
+  CAN_PROBE1( cycle_start, CANNetwork_GetSyncCount() );
+}
+
+// Command completion callbacks for startup profiling and output readiness (called from the network cycle)
+void EndConfigurationPhase( void* taskData, int value )
+{
+  SignalIOTask task = (SignalIOTask) taskData;
+  StartupProfile_Add( STARTUP_SDO_CONFIGURATION, task->nodeID, task->startupPhaseTime );
+  task->startupPhaseTime = StartupProfile_GetTime();
+}
+
+void EndEnablePhase( void* taskData, int value )
+{
+  SignalIOTask task = (SignalIOTask) taskData;
+  StartupProfile_Add( STARTUP_OUTPUT_ENABLE, task->nodeID, task->startupPhaseTime );
+  task->isOutputReady = true;
+}
+
+// Update measures from last received TPDOs
+void ReadMeasures( SignalIOTask task )
+{
+  CAN_TRACE_BEGIN( measures_update );
+  
+  double measuresTime = Time_GetExecSeconds();
+  if( task->lastMeasuresTime >= 0.0 )
+  {
+    CANMetrics_AddTime( &(task->cycleTimes), measuresTime - task->lastMeasuresTime );
+    if( measuresTime - task->lastMeasuresTime > CAN_METRICS_OVERRUN_TIME ) __atomic_add_fetch( &(task->overrunsCount), 1, __ATOMIC_RELAXED );
+  }
+  task->lastMeasuresTime = measuresTime;
+  
+  // Read values from PDO01 to buffer, waiting for the one answering last SYNC
+  CAN_TRACE_BEGIN( tpdo01_read );
+  bool isMeasureNew = ReadInput( task, PDO01 );  
+  CAN_TRACE_END( tpdo01_read );
+  
+  // Expected TPDO not received: measures are repeated
+  if( !isMeasureNew )
+  {
+    __atomic_add_fetch( &(task->staleSamplesCount), 1, __ATOMIC_RELAXED );
+    CANMetrics_AddStaleSample();
+  }
+  UpdateMeasures( task, PDO01 );
+  
+  // Read values from PDO02 to buffer
+  CAN_TRACE_BEGIN( tpdo02_read );
+  ReadInput( task, PDO02 );  
+  CAN_TRACE_END( tpdo02_read );
+  UpdateMeasures( task, PDO02 );
+  
+  task->readSync = CANNetwork_GetSyncCount();
+  task->readChannelsMask = 0;
+  
+  CAN_TRACE_END( measures_update );
+}
+
+// Decode input channels (and statusword, reporting its edges) mapped on last read TPDO
+void UpdateMeasures( SignalIOTask task, enum CANFrameTypes pdoType )
+{
+  for( size_t channel = 0; channel < task->channels.inputsNumber; channel++ )
+  {
+    CANChannel* inputChannel = &(task->channels.inputsList[ channel ]);
+    if( inputChannel->pdoType != pdoType ) continue;
+    task->measuresList[ channel ] = CANChannel_Decode( inputChannel, task->readPayload ) * inputChannel->valueScale;
+  }
+  
+  if( task->channels.statusWord.pdoType != pdoType ) return;
+  
+  uint16_t lastStatusWord = task->statusWord;
+  task->statusWord = (uint16_t) CANChannel_Decode( &(task->channels.statusWord), task->readPayload );
+  if( ( lastStatusWord ^ task->statusWord ) & STATUS_EVENTS_MASK ) 
+  {
+    CAN_TRACE_BEGIN( status_events );
+    UpdateStatusEvents( task, lastStatusWord );
+    CAN_TRACE_END( status_events );
+  }
+}
+
+// Read TPDO to buffer, waiting for it only on cycles it is expected (returns false if expected TPDO is missing)
+bool ReadInput( SignalIOTask task, enum CANFrameTypes pdoType )
+{
+  CANFrame frame = task->readFramesList[ pdoType ];
+  unsigned int divisor = task->pdoDivisorsList[ pdoType ];
+  int phase = task->inputPhasesList[ pdoType ];
+  
+  if( divisor <= 1 ) return CANNetwork_ReadInput( frame, task->readPayload );
+  
+  if( phase >= 0 && CANNetwork_IsInputScheduled( divisor, (unsigned int) phase ) )
+  {
+    if( CANNetwork_ReadInput( frame, task->readPayload ) ) return true;
+    // Drive may not support TPDO start values, or its transmission type was changed
+    task->inputPhasesList[ pdoType ] = -1;
+    return false;
+  }
+  
+  // Otherwise learn transmission cycles from new TPDOs, answering last SYNC or (if not read since then) the previous one
+  nxTimestamp_t lastTimestamp = CANFrame_GetTimestamp( frame );
+  CANFrame_Read( frame, task->readPayload );
+  CANNetwork_AddInputResponse( frame, lastTimestamp );
+  if( phase < 0 && CANFrame_GetTimestamp( frame ) != lastTimestamp )
+  {
+    unsigned long inputSync = CANNetwork_GetSyncCount() - ( CANNetwork_IsInputFresh( frame ) ? 1 : 2 );
+    task->inputPhasesList[ pdoType ] = (int) ( inputSync % divisor );
+  }
+  
+  return true;
+}
+
 void UnloadTaskData( SignalIOTask task )
 {
   if( task == NULL ) return;
@@ -346,5 +829,10 @@ void UnloadTaskData( SignalIOTask task )
     CANNetwork_EndFrame( task->writeFramesList[ frameID ] );
   }
   
+  if( task->hasStatusEvent ) TimedEvent_Discard( &(task->statusEvent) );
+  
+  for( size_t pdoType = PDO01; pdoType < CAN_FRAME_TYPES_NUMBER; pdoType++ )
+    CANNetwork_RemoveScheduledFrame( task->pdoDivisorsList[ pdoType ], task->pdoPhasesList[ pdoType ] );
+  
   free( task );
 }
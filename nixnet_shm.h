@@ -0,0 +1,395 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>       //
+//                                                                            //
+//  This file is part of Signal-IO-NIXNET.                                    //
+//                                                                            //
+//  Signal-IO-NIXNETs free software: you can redistribute it and/or modify    //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,       //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.  //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Shared memory transport to the out-of-process bus simulator (can_bus_simulator.c).
+// Each controller process attaches to a client slot with one frame ring per direction.
+// Included by can_frame.h (NIXNET_SHM builds) it implements the NI-XNET calls used by the plug-in.
+
+#ifndef NIXNET_SHM_H
+#define NIXNET_SHM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NIXNET_SHM_DEFAULT_NAME "/nixnet_simulator"
+#define NIXNET_SHM_MAGIC 0x4E58534D
+#define NIXNET_SHM_CLIENTS_MAX 8
+#define NIXNET_SHM_SESSIONS_MAX 1024
+#define NIXNET_SHM_RING_SIZE 1024 // Power of 2
+
+enum nxShmRecordType { NXSHM_SESSION_CREATE, NXSHM_SESSION_CLEAR, NXSHM_FRAME };
+
+enum nxShmClientState { NXSHM_CLIENT_FREE, NXSHM_CLIENT_ATTACHED, NXSHM_CLIENT_DETACHING };
+
+// Fixed size layout, independent of the NI-XNET types width on each side
+typedef struct _nxShmRecord
+{
+  uint32_t type;
+  uint32_t session;
+  uint64_t timestamp;
+  uint32_t identifier;
+  uint32_t mode;
+  uint8_t payloadLength;
+  uint8_t payload[ 8 ];
+  char name[ 32 ];
+}
+nxShmRecord;
+
+// Single producer, single consumer frame ring
+typedef struct _nxShmRing
+{
+  uint32_t head;
+  uint8_t headPadding[ 60 ];
+  uint32_t tail;
+  uint8_t tailPadding[ 60 ];
+  nxShmRecord recordsList[ NIXNET_SHM_RING_SIZE ];
+}
+nxShmRing;
+
+typedef struct _nxShmClient
+{
+  uint32_t state;
+  int32_t processID;
+  nxShmRing txRing;      // Controller to simulator
+  nxShmRing rxRing;      // Simulator to controller
+}
+nxShmClient;
+
+typedef struct _nxShmBus
+{
+  uint32_t magic;
+  int32_t processID;     // Simulator process (0 after it ends)
+  uint64_t time;         // Simulator bus time (in 100 ns units)
+  nxShmClient clientsList[ NIXNET_SHM_CLIENTS_MAX ];
+}
+nxShmBus;
+
+static bool nxShmRing_Push( nxShmRing* ring, const nxShmRecord* record )
+{
+  uint32_t head = __atomic_load_n( &(ring->head), __ATOMIC_RELAXED );
+  if( head - __atomic_load_n( &(ring->tail), __ATOMIC_ACQUIRE ) >= NIXNET_SHM_RING_SIZE ) return false;
+  
+  ring->recordsList[ head % NIXNET_SHM_RING_SIZE ] = *record;
+  __atomic_store_n( &(ring->head), head + 1, __ATOMIC_RELEASE );
+  
+  return true;
+}
+
+static bool nxShmRing_Pop( nxShmRing* ring, nxShmRecord* ref_record )
+{
+  uint32_t tail = __atomic_load_n( &(ring->tail), __ATOMIC_RELAXED );
+  if( tail == __atomic_load_n( &(ring->head), __ATOMIC_ACQUIRE ) ) return false;
+  
+  *ref_record = ring->recordsList[ tail % NIXNET_SHM_RING_SIZE ];
+  __atomic_store_n( &(ring->tail), tail + 1, __ATOMIC_RELEASE );
+  
+  return true;
+}
+
+static const char* nxShm_GetName()
+{
+  const char* sharedMemoryName = getenv( "NIXNET_SHM_NAME" );
+  return ( sharedMemoryName != NULL ) ? sharedMemoryName : NIXNET_SHM_DEFAULT_NAME;
+}
+
+
+#ifndef NIXNET_SHM_SERVER
+
+#define _NX_NOT_API_LIBRARY_
+#include "nixnet.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#define NIXNET_SHM_CLEAR_TIMEOUT 1.0      // Time (in seconds) to wait for the simulator to take records when clearing sessions
+#define NIXNET_SHM_POLL_TIME 50000        // Ring polling interval (in nanoseconds) while waiting for the simulator
+
+static struct
+{
+  nxShmBus* bus;
+  nxShmClient* client;
+  size_t sessionsNumber, openSessionsNumber;
+  struct { bool isUsed; nxFrameCAN_t frame; } sessionsList[ NIXNET_SHM_SESSIONS_MAX ];
+}
+shmClient;
+
+// Driver calls may come from several threads (e.g. bus thread and task creation), but rings have a single producer
+static pthread_mutex_t shmClientLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Simulator may end or crash while controllers are attached
+static bool nxShm_IsSimulatorAlive()
+{
+  int32_t processID = __atomic_load_n( &(shmClient.bus->processID), __ATOMIC_ACQUIRE );
+  
+  return ( processID > 0 && !( kill( processID, 0 ) == -1 && errno == ESRCH ) );
+}
+
+static bool nxShm_Attach()
+{
+  int sharedMemoryFD = shm_open( nxShm_GetName(), O_RDWR, 0 );
+  if( sharedMemoryFD == -1 ) return false;
+  
+  shmClient.bus = (nxShmBus*) mmap( NULL, sizeof(nxShmBus), PROT_READ | PROT_WRITE, MAP_SHARED, sharedMemoryFD, 0 );
+  close( sharedMemoryFD );
+  if( shmClient.bus == MAP_FAILED || shmClient.bus->magic != NIXNET_SHM_MAGIC || !nxShm_IsSimulatorAlive() )
+  {
+    if( shmClient.bus != MAP_FAILED ) munmap( shmClient.bus, sizeof(nxShmBus) );
+    shmClient.bus = NULL;
+    return false;
+  }
+  
+  for( size_t clientIndex = 0; clientIndex < NIXNET_SHM_CLIENTS_MAX; clientIndex++ )
+  {
+    nxShmClient* client = &(shmClient.bus->clientsList[ clientIndex ]);
+    uint32_t freeState = NXSHM_CLIENT_FREE;
+    if( __atomic_compare_exchange_n( &(client->state), &freeState, NXSHM_CLIENT_ATTACHED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) )
+    {
+      client->processID = (int32_t) getpid();
+      shmClient.client = client;
+      shmClient.sessionsNumber = 0;
+      return true;
+    }
+  }
+  
+  munmap( shmClient.bus, sizeof(nxShmBus) );
+  shmClient.bus = NULL;
+  
+  return false;
+}
+
+static void nxShm_Detach()
+{
+  __atomic_store_n( &(shmClient.client->state), NXSHM_CLIENT_DETACHING, __ATOMIC_RELEASE );
+  munmap( shmClient.bus, sizeof(nxShmBus) );
+  shmClient.bus = NULL;
+  shmClient.client = NULL;
+}
+
+// Keep last frame received for each session (single point)
+static void nxShm_ReceiveFrames()
+{
+  nxShmRecord record;
+  while( nxShmRing_Pop( &(shmClient.client->rxRing), &record ) )
+  {
+    if( record.session >= shmClient.sessionsNumber || record.type != NXSHM_FRAME ) continue;
+    
+    nxFrameCAN_t* frame = &(shmClient.sessionsList[ record.session ].frame);
+    frame->Timestamp = record.timestamp;
+    frame->Identifier = record.identifier;
+    frame->PayloadLength = record.payloadLength;
+    memcpy( frame->Payload, record.payload, sizeof(record.payload) );
+  }
+}
+
+static bool nxShm_IsValidSession( nxSessionRef_t SessionRef )
+{
+  return ( shmClient.client != NULL && SessionRef < shmClient.sessionsNumber && shmClient.sessionsList[ SessionRef ].isUsed );
+}
+
+// Wait for the simulator to take written records, until no more than given number remains on the ring 
+// (false on timeout, in seconds and negative for none, or if the simulator is gone)
+static bool nxShm_WaitTransmission( uint32_t recordsNumber, double timeout )
+{
+  nxShmRing* ring = &(shmClient.client->txRing);
+  
+  struct timespec startTime, currentTime;
+  clock_gettime( CLOCK_MONOTONIC, &startTime );
+  while( __atomic_load_n( &(ring->head), __ATOMIC_RELAXED ) - __atomic_load_n( &(ring->tail), __ATOMIC_ACQUIRE ) > recordsNumber )
+  {
+    if( !nxShm_IsSimulatorAlive() ) return false;
+    
+    clock_gettime( CLOCK_MONOTONIC, &currentTime );
+    double elapsedTime = ( currentTime.tv_sec - startTime.tv_sec ) + ( currentTime.tv_nsec - startTime.tv_nsec ) / 1e9;
+    if( timeout >= 0.0 && elapsedTime > timeout ) return false;
+    
+    struct timespec pollTime = { 0, NIXNET_SHM_POLL_TIME };
+    nanosleep( &pollTime, NULL );
+  }
+  
+  return true;
+}
+
+static nxStatus_t nxShm_CreateSession( const char* DatabaseName, const char* ClusterName, const char* List, const char* Interface, u32 Mode, nxSessionRef_t* SessionRef )
+{
+  if( shmClient.client == NULL && !nxShm_Attach() ) return nxErrInvalidInterface;
+  
+  // Reuse slots of cleared sessions (the simulator handles records in order)
+  size_t sessionIndex = 0;
+  while( sessionIndex < shmClient.sessionsNumber && shmClient.sessionsList[ sessionIndex ].isUsed ) sessionIndex++;
+  if( sessionIndex >= NIXNET_SHM_SESSIONS_MAX ) return nxErrMaxSessions;
+  
+  nxShmRecord record = { .type = NXSHM_SESSION_CREATE, .session = (uint32_t) sessionIndex, .mode = (uint32_t) Mode };
+  strncpy( record.name, List, sizeof(record.name) - 1 );
+  if( !nxShmRing_Push( &(shmClient.client->txRing), &record ) ) return nxErrMemoryFull;
+  
+  if( sessionIndex == shmClient.sessionsNumber ) shmClient.sessionsNumber++;
+  *SessionRef = (nxSessionRef_t) sessionIndex;
+  memset( &(shmClient.sessionsList[ *SessionRef ]), 0, sizeof(shmClient.sessionsList[ 0 ]) );
+  shmClient.sessionsList[ *SessionRef ].isUsed = true;
+  shmClient.sessionsList[ *SessionRef ].frame.PayloadLength = 8;
+  shmClient.openSessionsNumber++;
+  
+  return nxSuccess;
+}
+
+nxStatus_t _NXFUNC nxCreateSession( const char* DatabaseName, const char* ClusterName, const char* List, const char* Interface, u32 Mode, nxSessionRef_t* SessionRef )
+{
+  pthread_mutex_lock( &shmClientLock );
+  nxStatus_t status = nxShm_CreateSession( DatabaseName, ClusterName, List, Interface, Mode, SessionRef );
+  pthread_mutex_unlock( &shmClientLock );
+  
+  return status;
+}
+
+static nxStatus_t nxShm_WriteFrame( nxSessionRef_t SessionRef, void* Buffer, u32 NumberOfBytesForFrames, f64 Timeout )
+{
+  if( !nxShm_IsValidSession( SessionRef ) ) return nxErrInvalidSessionHandle;
+  
+  nxFrameVar_t* frame = (nxFrameVar_t*) Buffer;
+  nxShmRecord record = { .type = NXSHM_FRAME, .session = (uint32_t) SessionRef, .identifier = (uint32_t) frame->Identifier };
+  record.payloadLength = ( frame->PayloadLength > 8 ) ? 8 : frame->PayloadLength;
+  memcpy( record.payload, frame->Payload, record.payloadLength );
+  
+  if( !nxShmRing_Push( &(shmClient.client->txRing), &record ) ) return nxErrOutputQueueOverflow;
+  
+  return nxSuccess;
+}
+
+nxStatus_t _NXFUNC nxWriteFrame( nxSessionRef_t SessionRef, void* Buffer, u32 NumberOfBytesForFrames, f64 Timeout )
+{
+  pthread_mutex_lock( &shmClientLock );
+  nxStatus_t status = nxShm_WriteFrame( SessionRef, Buffer, NumberOfBytesForFrames, Timeout );
+  pthread_mutex_unlock( &shmClientLock );
+  
+  return status;
+}
+
+static nxStatus_t nxShm_ReadFrame( nxSessionRef_t SessionRef, void* Buffer, u32 SizeOfBuffer, f64 Timeout, u32* NumberOfBytesReturned )
+{
+  if( !nxShm_IsValidSession( SessionRef ) ) return nxErrInvalidSessionHandle;
+  
+  if( SizeOfBuffer < sizeof(nxFrameCAN_t) ) return nxErrBufferTooSmall;
+  
+  nxShm_ReceiveFrames();
+  
+  memcpy( Buffer, &(shmClient.sessionsList[ SessionRef ].frame), sizeof(nxFrameCAN_t) );
+  *NumberOfBytesReturned = sizeof(nxFrameCAN_t);
+  
+  return nxSuccess;
+}
+
+nxStatus_t _NXFUNC nxReadFrame( nxSessionRef_t SessionRef, void* Buffer, u32 SizeOfBuffer, f64 Timeout, u32* NumberOfBytesReturned )
+{
+  pthread_mutex_lock( &shmClientLock );
+  nxStatus_t status = nxShm_ReadFrame( SessionRef, Buffer, SizeOfBuffer, Timeout, NumberOfBytesReturned );
+  pthread_mutex_unlock( &shmClientLock );
+  
+  return status;
+}
+
+static nxStatus_t nxShm_ReadState( nxSessionRef_t SessionRef, u32 StateID, u32 StateSize, void* StateValue, nxStatus_t* Fault )
+{
+  if( !nxShm_IsValidSession( SessionRef ) ) return nxErrInvalidSessionHandle;
+  
+  if( Fault != NULL ) *Fault = nxSuccess;
+  
+  if( StateID == nxState_TimeCurrent && StateSize >= sizeof(nxTimestamp_t) ) *((nxTimestamp_t*) StateValue) = __atomic_load_n( &(shmClient.bus->time), __ATOMIC_ACQUIRE );
+  else if( StateID == nxState_CANComm && StateSize >= sizeof(u32) ) *((u32*) StateValue) = nxCANCommState_ErrorActive;
+  else return nxErrInvalidPropertyId;
+  
+  return nxSuccess;
+}
+
+nxStatus_t _NXFUNC nxReadState( nxSessionRef_t SessionRef, u32 StateID, u32 StateSize, void* StateValue, nxStatus_t* Fault )
+{
+  pthread_mutex_lock( &shmClientLock );
+  nxStatus_t status = nxShm_ReadState( SessionRef, StateID, StateSize, StateValue, Fault );
+  pthread_mutex_unlock( &shmClientLock );
+  
+  return status;
+}
+
+// Transmission is only known to be complete from the controller side once the simulator consumed the written frames
+static nxStatus_t nxShm_Wait( nxSessionRef_t SessionRef, u32 Condition, u32 ParamIn, f64 Timeout, u32* ParamOut )
+{
+  if( !nxShm_IsValidSession( SessionRef ) ) return nxErrInvalidSessionHandle;
+  
+  if( Condition != nxCondition_TransmitComplete ) return nxSuccess;
+  
+  if( !nxShm_WaitTransmission( 0, Timeout ) ) return nxShm_IsSimulatorAlive() ? nxErrEventTimeout : nxErrFirmwareNoResponse;
+  
+  return nxSuccess;
+}
+
+nxStatus_t _NXFUNC nxWait( nxSessionRef_t SessionRef, u32 Condition, u32 ParamIn, f64 Timeout, u32* ParamOut )
+{
+  pthread_mutex_lock( &shmClientLock );
+  nxStatus_t status = nxShm_Wait( SessionRef, Condition, ParamIn, Timeout, ParamOut );
+  pthread_mutex_unlock( &shmClientLock );
+  
+  return status;
+}
+
+void _NXFUNC nxStatusToString( nxStatus_t Status, u32 SizeofString, char* StatusDescription )
+{
+  snprintf( StatusDescription, SizeofString, "shared memory transport status 0x%08X", (unsigned int) Status );
+}
+
+static nxStatus_t nxShm_Clear( nxSessionRef_t SessionRef )
+{
+  if( !nxShm_IsValidSession( SessionRef ) ) return nxErrInvalidSessionHandle;
+  
+  // Without a simulator to take it, the clear record is dropped (its sessions are gone anyway)
+  nxShmRecord record = { .type = NXSHM_SESSION_CLEAR, .session = (uint32_t) SessionRef };
+  if( nxShm_WaitTransmission( NIXNET_SHM_RING_SIZE - 1, NIXNET_SHM_CLEAR_TIMEOUT ) ) nxShmRing_Push( &(shmClient.client->txRing), &record );
+  
+  shmClient.sessionsList[ SessionRef ].isUsed = false;
+  if( --shmClient.openSessionsNumber == 0 )
+  {
+    nxShm_WaitTransmission( 0, NIXNET_SHM_CLEAR_TIMEOUT );
+    nxShm_Detach();
+  }
+  
+  return nxSuccess;
+}
+
+nxStatus_t _NXFUNC nxClear( nxSessionRef_t SessionRef )
+{
+  pthread_mutex_lock( &shmClientLock );
+  nxStatus_t status = nxShm_Clear( SessionRef );
+  pthread_mutex_unlock( &shmClientLock );
+  
+  return status;
+}
+
+#endif // NIXNET_SHM_SERVER
+
+#endif // NIXNET_SHM_H
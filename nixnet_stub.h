@@ -26,51 +26,8 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
-
-#ifndef WIN32
-#include <sys/time.h>
-#include <sys/types.h>
-#include <unistd.h>
-
-#include <termios.h>
-#include <assert.h>
-
-#include <stdlib.h>
 #include <string.h>
-
-#define STDIN 0
-
-int getch(void) 
-{
-    static fd_set read_fds;
-    static struct timeval timeout = { 0, 0 };
-    
-    FD_ZERO( &read_fds );
-    FD_SET( STDIN, &read_fds );
-      
-      int c = 0;
-
-      struct termios org_opts, new_opts;
-      int res=0;
-          //-----  store old settings -----------
-      res=tcgetattr(STDIN_FILENO, &org_opts);
-      //assert(res==0);
-          //---- set new terminal parms --------
-      memcpy(&new_opts, &org_opts, sizeof(new_opts));
-      new_opts.c_lflag &= ~(ICANON | ECHO | ECHOE | ECHOK | ECHONL | ECHOPRT | ECHOKE | ICRNL);
-      tcsetattr(STDIN_FILENO, TCSANOW, &new_opts);
-      
-      select( STDIN + 1, &read_fds, NULL, NULL, &timeout);
-  
-      if( FD_ISSET( STDIN, &read_fds ) )
-        c = getchar();
-      
-          //------  restore old settings ---------
-      res=tcsetattr(STDIN_FILENO, TCSANOW, &org_opts);
-      //assert(res==0);
-      return(c);
-}
-#endif
+#include <math.h>
 
 #define nxMode_SignalInSinglePoint           0  // SignalInSinglePoint
 #define nxMode_SignalInWaveform              1  // SignalInWaveform
@@ -89,6 +46,8 @@ typedef uint8_t u8;
 typedef uint16_t u16;
 typedef uint32_t u32;
 typedef uint64_t u64;
+typedef int8_t i8;
+typedef int16_t i16;
 typedef int32_t i32;
 typedef double f64; 
 
@@ -105,6 +64,8 @@ typedef i32 nxStatus_t;
 
 #define nxSuccess                            0
 
+#define nxCondition_TransmitComplete         0x8001
+
 typedef struct {
                    nxTimestamp_t       Timestamp; 
                    u32                 Identifier; 
@@ -116,84 +77,1102 @@ typedef struct {
                }
         nxFrameVar_t;
             
+#define NX_STATUS_ERROR                      (nxStatus_t)(0x80000000)
+#define NX_ERROR_BASE                        ((nxStatus_t)(0x3FF63000) | NX_STATUS_ERROR)
+
+#define nxErrMaxSessions                     (NX_ERROR_BASE | 0x011)
+#define nxErrEventTimeout                    (NX_ERROR_BASE | 0x00A)
+#define nxErrInvalidSessionHandle            (NX_ERROR_BASE | 0x020)
+#define nxErrInvalidPropertyId               (NX_ERROR_BASE | 0x08D)
+
+#define nxState_TimeCurrent                  ((u32)0x00130001 | (u32)0x07000000)
+#define nxState_CANComm                      ((u32)0x00130010)
+
+#define nxCANCommState_ErrorActive           0
+#define nxCANCommState_BusOff                2
+
+///////////////////////////////////////////////////////////////////////////////
+/////                        Simulated CAN bus                            /////
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef NIXNET_STUB_VIRTUAL_TIME
+#include "timing_virtual.h"
+#endif
+
+#define STUB_SESSIONS_MAX 1024
+#define STUB_NODES_MAX 128
+#define STUB_EVENTS_MAX 4096
+#define STUB_IDENTIFIERS_NUMBER 2048
+#define STUB_DICTIONARY_SIZE 32
+#define STUB_PDO_ENTRIES_MAX 8
+#define STUB_DEFAULT_BIT_RATE 1000000
+#define STUB_CALL_TIME 5000 // Simulated host time spent (in nanoseconds) on each driver call
+#define STUB_PROFILE_VELOCITY 100000 // Default profile position mode velocity (in counts per second)
+
+// Distributions for the injected per-frame delay
+enum nxStubDelayType { STUB_DELAY_NONE, STUB_DELAY_CONSTANT, STUB_DELAY_UNIFORM, STUB_DELAY_EXPONENTIAL };
+
+// Fault injection configuration (times in seconds, probabilities per transmitted frame)
+typedef struct {
+                   u64                   Seed;
+                   enum nxStubDelayType  DelayType;
+                   f64                   DelayMin;
+                   f64                   DelayMax;              // Upper bound for uniform delays
+                   f64                   DelayMean;             // Mean added to DelayMin for exponential delays
+                   f64                   DropProbability;
+                   f64                   CorruptProbability;
+                   f64                   BusOffProbability;
+                   f64                   BusOffDuration;
+                   f64                   DropoutProbability;    // Checked per node on each SYNC
+                   f64                   DropoutDuration;
+               }
+        nxStubFaults_t;
+
+typedef struct {
+                   char                name[ 32 ];
+                   u32                 mode;
+                   u32                 identifier;
+                   bool                isInput;
+                   bool                isUsed;
+                   int                 nextInput;                // Next input session listening to the same identifier
+                   nxFrameVar_t        frame;
+               }
+        StubSession;
+
+typedef struct {
+                   u64                 time;
+                   u64                 sequence;
+                   nxFrameVar_t        frame;
+               }
+        StubEvent;
+
+typedef struct {
+                   StubEvent           list[ STUB_EVENTS_MAX ];
+                   size_t              number;
+                   bool                isByIdentifier;           // Order by ( identifier, sequence ) instead of ( time, sequence )
+               }
+        StubEventHeap;
+
+// Bus usage measurements (times in nanoseconds)
+typedef struct {
+                   u64                 FramesNumber;
+                   u64                 BitsNumber;
+                   u64                 BusyTime;
+                   u64                 TotalQueueTime;           // Time frames waited from being ready until won arbitration
+                   u64                 MaxQueueTime;
+                   u64                 ElapsedTime;
+               }
+        nxStubBusStats_t;
+
+typedef struct {
+                   u16                 index;
+                   u8                  subIndex;
+                   i32                 value;
+               }
+        StubEntry;
+
+// Simulated EPOS drive answering NMT, SYNC, SDO and RPDO frames
+typedef struct {
+                   bool                isPresent;
+                   bool                isOperational;
+                   u64                 dropoutEnd;
+                   u64                 lastSyncTime;
+                   u16                 controlWord, statusWord;
+                   bool                hasFault;
+                   i8                  operationMode;
+                   i32                 position, velocity;
+                   i16                 current, analog;
+                   i32                 positionSetpoint, velocitySetpoint;
+                   i16                 currentSetpoint, digitalOutput;
+                   i32                 targetSetpoint;                      // Profile position mode
+                   i32                 targetPosition, bufferedTarget;
+                   bool                hasBufferedTarget, isTargetReached, isSetpointAcknowledged;
+                   u8                  transmissionTypes[ 2 ];              // TPDOs sent every n-th SYNC (0 as 1)
+                   u8                  syncCounters[ 2 ];                   // SYNCs since last TPDO transmission
+                   u8                  syncStartValues[ 2 ];                // SYNC counter of first TPDO transmission (0 for none)
+                   bool                isSyncStarted[ 2 ];
+                   u32                 pdoMappings[ 4 ][ STUB_PDO_ENTRIES_MAX ];  // RPDO1, RPDO2, TPDO1 and TPDO2 mapped objects
+                   u8                  pdoEntriesNumbers[ 4 ];
+                   StubEntry           dictionary[ STUB_DICTIONARY_SIZE ];  // Other (written) objects
+                   size_t              entriesNumber;
+               }
+        StubNode;
+
+static struct {
+                   bool                isInitialized;
+                   u64                 startTime;
+                   StubSession         sessionsList[ STUB_SESSIONS_MAX ];
+                   size_t              sessionsNumber;
+                   int                 inputsByID[ STUB_IDENTIFIERS_NUMBER ];
+                   StubEventHeap       pendingFrames;                     // Frames waiting to be ready for transmission
+                   StubEventHeap       arbitratingFrames;                 // Ready frames competing for the bus
+                   u64                 eventsCount;
+                   bool                isTransmitting;
+                   StubEvent           transmittedFrame;                  // Frame on the bus, with its end of transmission time
+                   u64                 busFreeTime;
+                   u32                 bitRate;
+                   nxStubBusStats_t    busStats;
+                   StubNode            nodesList[ STUB_NODES_MAX ];
+                   nxStubFaults_t      faults;
+                   u64                 randomState;
+                   u64                 busOffStart, busOffEnd;
+                   void                (*DeliverFrame)( nxSessionRef_t, const nxFrameVar_t* );
+               }
+        stubBus;
+
+// Driver calls may come from several threads (e.g. bus thread and task creation)
+static pthread_mutex_t stubLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void StubBus_Transmit( nxFrameVar_t* frame, u64 time );
+
+// Time (in nanoseconds) since the simulation start: simulated clock shared with timing module or wall clock
+static u64 StubClock_GetTime()
+{
+    #ifdef NIXNET_STUB_VIRTUAL_TIME
+    return TimeVirtual_GetNanoseconds();
+    #endif
+
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (u64) now.tv_sec * 1000000000ULL + (u64) now.tv_nsec - stubBus.startTime;
+}
+
+// Host execution time is not measured in virtual time mode: account for it on each driver call
+static u64 StubClock_SpendCallTime()
+{
+    #ifdef NIXNET_STUB_VIRTUAL_TIME
+    TimeVirtual_Advance( STUB_CALL_TIME );
+    #endif
+
+    return StubClock_GetTime();
+}
+
+static u64 StubClock_FromSeconds( f64 seconds )
+{
+    return ( seconds > 0.0 ) ? (u64) ( seconds * 1e9 ) : 0;
+}
+
+// Deterministic pseudo-random generator (splitmix64), seeded by the fault configuration
+static u64 StubRandom_Next()
+{
+    u64 value = ( stubBus.randomState += 0x9E3779B97F4A7C15ULL );
+    value = ( value ^ ( value >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+    value = ( value ^ ( value >> 27 ) ) * 0x94D049BB133111EBULL;
+    return value ^ ( value >> 31 );
+}
+
+static f64 StubRandom_Uniform()
+{
+    return (f64) ( StubRandom_Next() >> 11 ) / 9007199254740992.0;
+}
+
+static bool StubRandom_Check( f64 probability )
+{
+    return ( probability > 0.0 && StubRandom_Uniform() < probability );
+}
+
+void nxStub_SetFaults( const nxStubFaults_t* faults )
+{
+    stubBus.faults = *faults;
+    stubBus.randomState = faults->Seed;
+}
+
+// Force bus-off state for a given period (simulation times in seconds)
+void nxStub_SetBusOff( f64 start, f64 duration )
+{
+    stubBus.busOffStart = StubClock_FromSeconds( start );
+    stubBus.busOffEnd = StubClock_FromSeconds( start + duration );
+}
+
+static bool StubBus_IsBusOff( u64 time )
+{
+    return ( time >= stubBus.busOffStart && time < stubBus.busOffEnd );
+}
+
+// Make node stop communicating until the given simulation time (in seconds)
+void nxStub_SetNodeDropout( u8 nodeID, f64 end )
+{
+    if( nodeID < STUB_NODES_MAX ) stubBus.nodesList[ nodeID ].dropoutEnd = StubClock_FromSeconds( end );
+}
+
+// Read fault configuration from NIXNET_STUB_FAULTS environment variable
+// e.g. "seed=42,drop=0.01,corrupt=0.001,delay=uniform:0.0001:0.0005,busoff=0.00001:0.1,dropout=0.0001:0.5"
+static void StubFaults_Load()
+{
+    char config[ 256 ];
+    const char* configString = getenv( "NIXNET_STUB_FAULTS" );
+    if( configString == NULL ) return;
+
+    nxStubFaults_t faults = { 0 };
+    strncpy( config, configString, sizeof(config) - 1 );
+    config[ sizeof(config) - 1 ] = '\0';
+
+    for( char* option = strtok( config, "," ); option != NULL; option = strtok( NULL, "," ) )
+    {
+        char* value = strchr( option, '=' );
+        if( value == NULL ) continue;
+        *(value++) = '\0';
+
+        if( strcmp( option, "seed" ) == 0 ) faults.Seed = strtoull( value, NULL, 0 );
+        else if( strcmp( option, "drop" ) == 0 ) faults.DropProbability = strtod( value, NULL );
+        else if( strcmp( option, "corrupt" ) == 0 ) faults.CorruptProbability = strtod( value, NULL );
+        else if( strcmp( option, "busoff" ) == 0 ) sscanf( value, "%lf:%lf", &(faults.BusOffProbability), &(faults.BusOffDuration) );
+        else if( strcmp( option, "dropout" ) == 0 ) sscanf( value, "%lf:%lf", &(faults.DropoutProbability), &(faults.DropoutDuration) );
+        else if( strcmp( option, "delay" ) == 0 )
+        {
+            char* parameters = strchr( value, ':' );
+            if( parameters != NULL ) *(parameters++) = '\0';
+            if( strcmp( value, "constant" ) == 0 ) faults.DelayType = STUB_DELAY_CONSTANT;
+            else if( strcmp( value, "uniform" ) == 0 ) faults.DelayType = STUB_DELAY_UNIFORM;
+            else if( strcmp( value, "exponential" ) == 0 ) faults.DelayType = STUB_DELAY_EXPONENTIAL;
+            if( parameters != NULL ) sscanf( parameters, "%lf:%lf", &(faults.DelayMin), ( faults.DelayType == STUB_DELAY_EXPONENTIAL ) ? &(faults.DelayMean) : &(faults.DelayMax) );
+        }
+    }
+
+    nxStub_SetFaults( &faults );
+}
+
+static u64 StubFaults_GetDelay()
+{
+    const nxStubFaults_t* faults = &(stubBus.faults);
+
+    if( faults->DelayType == STUB_DELAY_CONSTANT ) return StubClock_FromSeconds( faults->DelayMin );
+    else if( faults->DelayType == STUB_DELAY_UNIFORM ) return StubClock_FromSeconds( faults->DelayMin + ( faults->DelayMax - faults->DelayMin ) * StubRandom_Uniform() );
+    else if( faults->DelayType == STUB_DELAY_EXPONENTIAL ) return StubClock_FromSeconds( faults->DelayMin - faults->DelayMean * log( 1.0 - StubRandom_Uniform() ) );
+
+    return 0;
+}
+
+// Frames of the EPOS CANOpen profile: NMT, SYNC, SDO_{TX,RX}_<node>, PDO0<n>_{TX,RX}_<node>
+static u32 StubBus_GetIdentifier( const char* frameName )
+{
+    unsigned int pdoNumber, nodeID;
+    char direction[ 3 ];
+
+    if( strcmp( frameName, "NMT" ) == 0 ) return 0x000;
+    else if( strcmp( frameName, "SYNC" ) == 0 ) return 0x080;
+    else if( sscanf( frameName, "SDO_%2[TXR]_%u", direction, &nodeID ) == 2 )
+        return ( ( strcmp( direction, "TX" ) == 0 ) ? 0x600 : 0x580 ) + ( nodeID & 0x7F );
+    else if( sscanf( frameName, "PDO%u_%2[TXR]_%u", &pdoNumber, direction, &nodeID ) == 3 && pdoNumber >= 1 && pdoNumber <= 4 )
+        return ( ( strcmp( direction, "TX" ) == 0 ) ? 0x100 : 0x080 ) + 0x100 * pdoNumber + ( nodeID & 0x7F );
+
+    return STUB_IDENTIFIERS_NUMBER - 1;
+}
+
+static void StubBus_Init()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    stubBus.startTime = (u64) now.tv_sec * 1000000000ULL + (u64) now.tv_nsec;
+
+    for( size_t id = 0; id < STUB_IDENTIFIERS_NUMBER; id++ )
+        stubBus.inputsByID[ id ] = -1;
+
+    StubFaults_Load();
+
+    const char* bitRateString = getenv( "NIXNET_STUB_BIT_RATE" );
+    stubBus.bitRate = ( bitRateString != NULL ) ? (u32) strtoul( bitRateString, NULL, 0 ) : STUB_DEFAULT_BIT_RATE;
+    stubBus.arbitratingFrames.isByIdentifier = true;
+
+    stubBus.isInitialized = true;
+}
+
+static bool StubEvents_IsBefore( const StubEventHeap* heap, const StubEvent* event, const StubEvent* otherEvent )
+{
+    u64 key = heap->isByIdentifier ? event->frame.Identifier : event->time;
+    u64 otherKey = heap->isByIdentifier ? otherEvent->frame.Identifier : otherEvent->time;
+
+    return ( key < otherKey || ( key == otherKey && event->sequence < otherEvent->sequence ) );
+}
+
+static void StubEvents_Push( StubEventHeap* heap, StubEvent event )
+{
+    if( heap->number >= STUB_EVENTS_MAX ) return;
+
+    size_t position = heap->number++;
+    while( position > 0 )
+    {
+        size_t parent = ( position - 1 ) / 2;
+        if( StubEvents_IsBefore( heap, &(heap->list[ parent ]), &event ) ) break;
+        heap->list[ position ] = heap->list[ parent ];
+        position = parent;
+    }
+    heap->list[ position ] = event;
+}
+
+static StubEvent StubEvents_Pop( StubEventHeap* heap )
+{
+    StubEvent first = heap->list[ 0 ];
+    StubEvent last = heap->list[ --heap->number ];
+
+    size_t position = 0;
+    while( 2 * position + 1 < heap->number )
+    {
+        size_t child = 2 * position + 1;
+        if( child + 1 < heap->number && StubEvents_IsBefore( heap, &(heap->list[ child + 1 ]), &(heap->list[ child ]) ) ) child++;
+        if( StubEvents_IsBefore( heap, &last, &(heap->list[ child ]) ) ) break;
+        heap->list[ position ] = heap->list[ child ];
+        position = child;
+    }
+    heap->list[ position ] = last;
+
+    return first;
+}
+
+// Length of a standard (11-bit identifier) data frame on the wire, including stuff bits and interframe space
+static u32 StubBus_GetFrameBits( const nxFrameVar_t* frame )
+{
+    u8 bitsList[ 1 + 11 + 3 + 4 + 64 + 15 ];
+    size_t bitsNumber = 0;
+    u8 dataLength = ( frame->PayloadLength > 8 ) ? 8 : frame->PayloadLength;
+
+    // SOF, identifier, RTR, IDE, r0 and DLC
+    bitsList[ bitsNumber++ ] = 0;
+    for( int bit = 10; bit >= 0; bit-- ) bitsList[ bitsNumber++ ] = ( frame->Identifier >> bit ) & 1;
+    bitsList[ bitsNumber++ ] = 0; bitsList[ bitsNumber++ ] = 0; bitsList[ bitsNumber++ ] = 0;
+    for( int bit = 3; bit >= 0; bit-- ) bitsList[ bitsNumber++ ] = ( dataLength >> bit ) & 1;
+    for( size_t byteIndex = 0; byteIndex < dataLength; byteIndex++ )
+    {
+        for( int bit = 7; bit >= 0; bit-- ) bitsList[ bitsNumber++ ] = ( frame->Payload[ byteIndex ] >> bit ) & 1;
+    }
+
+    // CRC-15 (polynomial 0x4599)
+    u16 crc = 0;
+    for( size_t bitIndex = 0; bitIndex < bitsNumber; bitIndex++ )
+    {
+        u8 crcNext = bitsList[ bitIndex ] ^ ( ( crc >> 14 ) & 1 );
+        crc = ( crc << 1 ) & 0x7FFF;
+        if( crcNext ) crc ^= 0x4599;
+    }
+    for( int bit = 14; bit >= 0; bit-- ) bitsList[ bitsNumber++ ] = ( crc >> bit ) & 1;
+
+    // Stuff bit after every 5 consecutive equal bits (the stuff bit starts a new sequence)
+    u32 stuffBitsNumber = 0;
+    u8 lastBit = bitsList[ 0 ], sameBitsCount = 1;
+    for( size_t bitIndex = 1; bitIndex < bitsNumber; bitIndex++ )
+    {
+        if( bitsList[ bitIndex ] == lastBit ) sameBitsCount++;
+        else { lastBit = bitsList[ bitIndex ]; sameBitsCount = 1; }
+        if( sameBitsCount == 5 )
+        {
+            stuffBitsNumber++;
+            lastBit = !lastBit;
+            sameBitsCount = 1;
+        }
+    }
+
+    // CRC delimiter, ACK slot and delimiter, EOF and interframe space
+    return (u32) bitsNumber + stuffBitsNumber + 1 + 2 + 7 + 3;
+}
+
+void nxStub_SetBitRate( u32 bitRate )
+{
+    stubBus.bitRate = bitRate;
+}
+
+void nxStub_GetBusStats( nxStubBusStats_t* ref_stats )
+{
+    *ref_stats = stubBus.busStats;
+    ref_stats->ElapsedTime = StubClock_GetTime();
+}
+
+// EPOS factory PDO mapping
+static void StubNode_Init( StubNode* node )
+{
+    const u32 DEFAULT_MAPPINGS[ 4 ][ 3 ] = { { 0x20620020, 0x20300010, 0x60400010 }, { 0x206B0020, 0x20780110, 0 },
+                                             { 0x60640020, 0x60780010, 0x60410010 }, { 0x606C0020, 0x207C0110, 0 } };
+
+    for( size_t mappingIndex = 0; mappingIndex < 4; mappingIndex++ )
+    {
+        node->pdoEntriesNumbers[ mappingIndex ] = 0;
+        for( size_t entryIndex = 0; entryIndex < 3 && DEFAULT_MAPPINGS[ mappingIndex ][ entryIndex ] != 0; entryIndex++ )
+            node->pdoMappings[ mappingIndex ][ node->pdoEntriesNumbers[ mappingIndex ]++ ] = DEFAULT_MAPPINGS[ mappingIndex ][ entryIndex ];
+    }
+
+    node->isPresent = true;
+}
+
+// Position on node mappings list of a PDO mapping object (0x1600-0x1601 for RPDOs, 0x1A00-0x1A01 for TPDOs), or -1
+static int StubNode_GetMappingIndex( u16 index )
+{
+    if( index == 0x1600 || index == 0x1601 ) return index - 0x1600;
+    if( index == 0x1A00 || index == 0x1A01 ) return 2 + index - 0x1A00;
+    return -1;
+}
+
+static i32 StubNode_GetValue( StubNode* node, u16 index, u8 subIndex, bool* ref_found )
+{
+    *ref_found = true;
+    switch( index )
+    {
+        case 0x6040: return node->controlWord;
+        case 0x6041: return node->statusWord;
+        case 0x6060: case 0x6061: return node->operationMode;
+        case 0x6064: return node->position;
+        case 0x606C: return node->velocity;
+        case 0x6078: return node->current;
+        case 0x607A: return node->targetSetpoint;
+        case 0x2062: return node->positionSetpoint;
+        case 0x206B: return node->velocitySetpoint;
+        case 0x2030: return node->currentSetpoint;
+        case 0x2078: if( subIndex == 0x01 ) return node->digitalOutput; break;
+        case 0x207C: if( subIndex == 0x01 ) return node->analog; break;
+        case 0x1600: case 0x1601: case 0x1A00: case 0x1A01:
+        {
+            int mappingIndex = StubNode_GetMappingIndex( index );
+            if( subIndex == 0x00 ) return node->pdoEntriesNumbers[ mappingIndex ];
+            if( subIndex <= STUB_PDO_ENTRIES_MAX ) return (i32) node->pdoMappings[ mappingIndex ][ subIndex - 1 ];
+            break;
+        }
+    }
+
+    for( size_t entryIndex = 0; entryIndex < node->entriesNumber; entryIndex++ )
+    {
+        if( node->dictionary[ entryIndex ].index == index && node->dictionary[ entryIndex ].subIndex == subIndex )
+            return node->dictionary[ entryIndex ].value;
+    }
+
+    *ref_found = false;
+    return 0;
+}
+
+// Profile position setpoint handshake, taking the target position object (0x607A) as new setpoint
+static void StubNode_UpdateSetpoint( StubNode* node, u16 controlWord )
+{
+    // New setpoint on bit 4, acknowledged until it is cleared (or later, if the single target buffer is full)
+    if( !( controlWord & 0x0010 ) ) node->isSetpointAcknowledged = false;
+    else if( !node->isSetpointAcknowledged && ( !node->hasBufferedTarget || ( controlWord & 0x0020 ) ) )
+    {
+        i32 target = node->targetSetpoint;
+        if( controlWord & 0x0040 ) target += node->hasBufferedTarget ? node->bufferedTarget : node->targetPosition; // Relative
+        // Without change immediately (bit 5), keep target until the current one is reached
+        if( !( controlWord & 0x0020 ) && !node->isTargetReached )
+        {
+            node->bufferedTarget = target;
+            node->hasBufferedTarget = true;
+        }
+        else
+        {
+            node->targetPosition = target;
+            node->isTargetReached = false;
+        }
+        node->isSetpointAcknowledged = true;
+    }
+}
+
+static void StubNode_SetControlWord( StubNode* node, u16 controlWord )
+{
+    // Fault reset on rising edge of bit 7
+    if( ( controlWord & 0x0080 ) && !( node->controlWord & 0x0080 ) ) node->hasFault = false;
+
+    if( node->operationMode == 1 && ( node->statusWord & 0x0004 ) ) StubNode_UpdateSetpoint( node, controlWord );
+
+    node->controlWord = controlWord;
+
+    // Simplified CiA 402 state machine
+    if( node->hasFault ) node->statusWord = 0x0008;
+    else if( ( controlWord & 0x0006 ) != 0x0006 ) node->statusWord = 0x0040;
+    else
+    {
+        node->statusWord = 0x0001 | 0x0010 | 0x0020;
+        if( controlWord & 0x0001 )
+        {
+            node->statusWord |= 0x0002;
+            if( controlWord & 0x0008 ) node->statusWord |= 0x0004;
+        }
+    }
+    node->statusWord |= 0x0200;
+    if( node->operationMode == 1 )
+    {
+        if( node->isTargetReached ) node->statusWord |= 0x0400;
+        if( node->isSetpointAcknowledged ) node->statusWord |= 0x1000;
+    }
+}
+
+// Move towards profile position target at constant velocity
+static void StubNode_MoveToTarget( StubNode* node, f64 timeStep )
+{
+    bool found;
+    i32 velocity = StubNode_GetValue( node, 0x6081, 0x00, &found );
+    if( !found || velocity <= 0 ) velocity = STUB_PROFILE_VELOCITY;
+
+    i32 maxStep = (i32) ( velocity * timeStep ) + 1;
+    i32 distance = node->targetPosition - node->position;
+    if( abs( distance ) > maxStep )
+    {
+        node->position += ( distance > 0 ) ? maxStep : -maxStep;
+        node->velocity = ( distance > 0 ) ? velocity : -velocity;
+        return;
+    }
+
+    node->position = node->targetPosition;
+    node->velocity = 0;
+    if( node->hasBufferedTarget )
+    {
+        node->targetPosition = node->bufferedTarget;
+        node->hasBufferedTarget = false;
+        StubNode_SetControlWord( node, node->controlWord );
+    }
+    else
+    {
+        node->isTargetReached = true;
+        node->statusWord |= 0x0400;
+    }
+}
+
+// PDO mapping write (CiA 301), only while pre-operational: entries may change while the mapping is disabled
+// (0 entries on subindex 0), which is then enabled with up to 64 bits of byte aligned objects
+static bool StubNode_SetMapping( StubNode* node, int mappingIndex, u8 subIndex, u32 value )
+{
+    if( node->isOperational ) return false;
+
+    if( subIndex == 0x00 )
+    {
+        if( value > STUB_PDO_ENTRIES_MAX ) return false;
+        u32 mappedBits = 0;
+        for( size_t entryIndex = 0; entryIndex < value; entryIndex++ )
+        {
+            u32 entryBits = node->pdoMappings[ mappingIndex ][ entryIndex ] & 0xFF;
+            if( entryBits == 0 || entryBits > 32 || entryBits % 8 != 0 ) return false;
+            mappedBits += entryBits;
+        }
+        if( mappedBits > 64 ) return false;
+        node->pdoEntriesNumbers[ mappingIndex ] = (u8) value;
+        return true;
+    }
+
+    if( subIndex > STUB_PDO_ENTRIES_MAX || node->pdoEntriesNumbers[ mappingIndex ] > 0 ) return false;
+    node->pdoMappings[ mappingIndex ][ subIndex - 1 ] = value;
+
+    return true;
+}
+
+static bool StubNode_SetValue( StubNode* node, u16 index, u8 subIndex, i32 value )
+{
+    switch( index )
+    {
+        case 0x6040: StubNode_SetControlWord( node, (u16) value ); return true;
+        case 0x6060:
+            node->operationMode = (i8) value;
+            // Profile position starts at rest on current position
+            node->targetPosition = node->position;
+            node->isTargetReached = true;
+            node->hasBufferedTarget = node->isSetpointAcknowledged = false;
+            return true;
+        case 0x6041: case 0x6061: case 0x6064: case 0x606C: case 0x6078: return false;
+        case 0x607A: node->targetSetpoint = value; return true;
+        case 0x2062: node->positionSetpoint = value; return true;
+        case 0x206B: node->velocitySetpoint = value; return true;
+        case 0x2030: node->currentSetpoint = (i16) value; return true;
+        case 0x2078:
+            if( subIndex != 0x01 ) break;
+            node->digitalOutput = (i16) value;
+            return true;
+        case 0x1600: case 0x1601: case 0x1A00: case 0x1A01:
+            return StubNode_SetMapping( node, StubNode_GetMappingIndex( index ), subIndex, (u32) value );
+        case 0x1800: case 0x1801:
+            if( subIndex == 0x06 )
+            {
+                if( value > 240 ) return false;
+                node->syncStartValues[ index - 0x1800 ] = (u8) value;
+                node->isSyncStarted[ index - 0x1800 ] = false;
+                return true;
+            }
+            if( subIndex != 0x02 ) break;
+            // Synchronous (cyclic) types only, counting from the change (or from the start value)
+            if( value > 240 ) return false;
+            node->transmissionTypes[ index - 0x1800 ] = (u8) value;
+            node->syncCounters[ index - 0x1800 ] = 0;
+            node->isSyncStarted[ index - 0x1800 ] = false;
+            return true;
+    }
+
+    for( size_t entryIndex = 0; entryIndex < node->entriesNumber; entryIndex++ )
+    {
+        if( node->dictionary[ entryIndex ].index == index && node->dictionary[ entryIndex ].subIndex == subIndex )
+        {
+            node->dictionary[ entryIndex ].value = value;
+            return true;
+        }
+    }
+
+    if( node->entriesNumber >= STUB_DICTIONARY_SIZE ) return false;
+    node->dictionary[ node->entriesNumber++ ] = (StubEntry) { index, subIndex, value };
+
+    return true;
+}
+
+// Fill PDO payload with the values of its mapped objects (little endian, in mapping order)
+static void StubNode_PackPDO( StubNode* node, int mappingIndex, u8 payload[ 8 ] )
+{
+    memset( payload, 0, 8 );
+
+    size_t offset = 0;
+    for( size_t entryIndex = 0; entryIndex < node->pdoEntriesNumbers[ mappingIndex ]; entryIndex++ )
+    {
+        u32 entry = node->pdoMappings[ mappingIndex ][ entryIndex ];
+        bool found;
+        u32 value = (u32) StubNode_GetValue( node, (u16) ( entry >> 16 ), (u8) ( entry >> 8 ), &found );
+        for( size_t byteIndex = 0; byteIndex < ( entry & 0xFF ) / 8 && offset < 8; byteIndex++ )
+            payload[ offset++ ] = (u8) ( ( value >> ( 8 * byteIndex ) ) & 0xFF );
+    }
+}
+
+// Write sign extended values of RPDO payload to its mapped objects. The Control Word goes last,
+// as it may take the other objects as new setpoints
+static void StubNode_UnpackPDO( StubNode* node, int mappingIndex, const u8 payload[ 8 ] )
+{
+    bool hasControlWord = false;
+    u16 controlWord = 0;
+
+    size_t offset = 0;
+    for( size_t entryIndex = 0; entryIndex < node->pdoEntriesNumbers[ mappingIndex ]; entryIndex++ )
+    {
+        u32 entry = node->pdoMappings[ mappingIndex ][ entryIndex ];
+        size_t length = ( entry & 0xFF ) / 8;
+        if( length == 0 || offset + length > 8 ) break;
+
+        u32 value = 0;
+        for( size_t byteIndex = 0; byteIndex < length; byteIndex++ )
+            value |= (u32) payload[ offset + byteIndex ] << ( 8 * byteIndex );
+        if( length < 4 && ( value & ( 1U << ( 8 * length - 1 ) ) ) ) value |= ~0U << ( 8 * length );
+        offset += length;
+
+        u16 index = (u16) ( entry >> 16 );
+        if( index == 0x6040 )
+        {
+            controlWord = (u16) value;
+            hasControlWord = true;
+        }
+        else StubNode_SetValue( node, index, (u8) ( entry >> 8 ), (i32) value );
+    }
+
+    if( hasControlWord ) StubNode_SetControlWord( node, controlWord );
+}
+
+static void StubNode_Respond( u32 identifier, const u8 payload[ 8 ], u64 time )
+{
+    nxFrameVar_t frame = { 0, identifier, nxFrameType_CAN_Data, 0, 0, 8, { 0 } };
+    memcpy( frame.Payload, payload, 8 );
+    StubBus_Transmit( &frame, time );
+}
+
+static void StubNode_ProcessSDO( StubNode* node, u8 nodeID, const u8 request[ 8 ], u64 time )
+{
+    u16 index = request[ 1 ] + request[ 2 ] * 0x100;
+    u8 subIndex = request[ 3 ];
+    i32 value = (i32) ( request[ 4 ] + request[ 5 ] * 0x100 + request[ 6 ] * 0x10000 + (u32) request[ 7 ] * 0x1000000 );
+    u8 response[ 8 ] = { 0x60, request[ 1 ], request[ 2 ], subIndex };
+
+    bool success = false;
+    if( request[ 0 ] == 0x40 )
+    {
+        value = StubNode_GetValue( node, index, subIndex, &success );
+        response[ 0 ] = 0x43;
+    }
+    else if( ( request[ 0 ] & 0xE0 ) == 0x20 ) success = StubNode_SetValue( node, index, subIndex, value );
+
+    if( !success )
+    {
+        response[ 0 ] = 0x80;
+        value = 0x06020000; // Object does not exist in the object dictionary
+    }
+
+    if( response[ 0 ] != 0x60 )
+    {
+        for( size_t byteIndex = 0; byteIndex < 4; byteIndex++ )
+            response[ 4 + byteIndex ] = (u8) ( ( (u32) value >> ( 8 * byteIndex ) ) & 0xFF );
+    }
+
+    StubNode_Respond( 0x580 + nodeID, response, time );
+}
+
+static void StubNode_Sync( StubNode* node, u8 nodeID, u8 syncCounter, u64 time )
+{
+    f64 timeStep = ( time - node->lastSyncTime ) / 1e9;
+    node->lastSyncTime = time;
+
+    if( node->statusWord & 0x0004 )
+    {
+        if( node->operationMode == -1 ) node->position = node->positionSetpoint;
+        else if( node->operationMode == -2 ) node->velocity = node->velocitySetpoint;
+        else if( node->operationMode == -3 ) node->current = node->currentSetpoint;
+    }
+
+    if( node->operationMode == 1 && ( node->statusWord & 0x0004 ) ) StubNode_MoveToTarget( node, timeStep );
+    else node->position += (i32) ( node->velocity * timeStep );
+
+    bool isTransmittingList[ 2 ];
+    for( size_t pdoIndex = 0; pdoIndex < 2; pdoIndex++ )
+    {
+        node->syncCounters[ pdoIndex ]++;
+        // Counted SYNCs with start value: first transmission when their counter reaches it
+        if( syncCounter > 0 && node->syncStartValues[ pdoIndex ] > 0 && !node->isSyncStarted[ pdoIndex ] )
+            isTransmittingList[ pdoIndex ] = node->isSyncStarted[ pdoIndex ] = ( syncCounter == node->syncStartValues[ pdoIndex ] );
+        else
+            isTransmittingList[ pdoIndex ] = ( node->syncCounters[ pdoIndex ] >= node->transmissionTypes[ pdoIndex ] );
+        if( isTransmittingList[ pdoIndex ] ) node->syncCounters[ pdoIndex ] = 0;
+    }
+
+    // TPDOs with their mapped objects (by default Position, Current and Status Word; Velocity and Analog input)
+    u8 payload[ 8 ];
+    for( size_t pdoIndex = 0; pdoIndex < 2; pdoIndex++ )
+    {
+        if( !isTransmittingList[ pdoIndex ] ) continue;
+        StubNode_PackPDO( node, 2 + (int) pdoIndex, payload );
+        StubNode_Respond( 0x180 + 0x100 * pdoIndex + nodeID, payload, time );
+    }
+}
+
+// Simulated drives reaction to a frame delivered on the bus
+static void StubNodes_Receive( const nxFrameVar_t* frame, u64 time )
+{
+    u32 functionCode = frame->Identifier & 0x780;
+    u8 nodeID = frame->Identifier & 0x7F;
+    const u8* payload = frame->Payload;
+
+    if( frame->Identifier == 0x000 )
+    {
+        for( u8 targetID = 1; targetID < STUB_NODES_MAX; targetID++ )
+        {
+            if( payload[ 1 ] != 0 && payload[ 1 ] != targetID ) continue;
+            if( payload[ 0 ] == 0x01 ) stubBus.nodesList[ targetID ].isOperational = true;
+            else if( payload[ 0 ] >= 0x80 ) stubBus.nodesList[ targetID ].isOperational = false;
+        }
+    }
+    else if( frame->Identifier == 0x080 )
+    {
+        // SYNC counter, if any, is its single byte
+        u8 syncCounter = ( frame->PayloadLength == 1 ) ? payload[ 0 ] : 0;
+        for( u8 targetID = 1; targetID < STUB_NODES_MAX; targetID++ )
+        {
+            StubNode* node = &(stubBus.nodesList[ targetID ]);
+            if( StubRandom_Check( stubBus.faults.DropoutProbability ) )
+                node->dropoutEnd = time + StubClock_FromSeconds( stubBus.faults.DropoutDuration );
+            if( node->isPresent && node->isOperational && time >= node->dropoutEnd ) StubNode_Sync( node, targetID, syncCounter, time );
+        }
+    }
+    else if( nodeID > 0 && stubBus.nodesList[ nodeID ].isPresent && time >= stubBus.nodesList[ nodeID ].dropoutEnd )
+    {
+        StubNode* node = &(stubBus.nodesList[ nodeID ]);
+        if( functionCode == 0x600 ) StubNode_ProcessSDO( node, nodeID, payload, time );
+        else if( ( functionCode == 0x200 || functionCode == 0x300 ) && node->isOperational )
+            StubNode_UnpackPDO( node, ( functionCode - 0x200 ) / 0x100, payload );
+    }
+}
+
+// Queue frame for transmission, subject to fault injection
+static void StubBus_Transmit( nxFrameVar_t* frame, u64 time )
+{
+    if( StubRandom_Check( stubBus.faults.BusOffProbability ) )
+    {
+        stubBus.busOffStart = time;
+        stubBus.busOffEnd = time + StubClock_FromSeconds( stubBus.faults.BusOffDuration );
+    }
+
+    if( StubBus_IsBusOff( time ) ) return;
+
+    if( StubRandom_Check( stubBus.faults.DropProbability ) ) return;
+
+    if( StubRandom_Check( stubBus.faults.CorruptProbability ) )
+        frame->Payload[ StubRandom_Next() % 8 ] ^= (u8) ( 1 << ( StubRandom_Next() % 8 ) );
+
+    StubEvent event = { time + StubFaults_GetDelay(), stubBus.eventsCount++, *frame };
+    StubEvents_Push( &(stubBus.pendingFrames), event );
+}
+
+static void StubBus_Deliver( StubEvent* event )
+{
+    event->frame.Timestamp = event->time / 100;
+
+    for( int sessionIndex = stubBus.inputsByID[ event->frame.Identifier ]; sessionIndex >= 0; sessionIndex = stubBus.sessionsList[ sessionIndex ].nextInput )
+    {
+        stubBus.sessionsList[ sessionIndex ].frame = event->frame;
+        if( stubBus.DeliverFrame != NULL ) stubBus.DeliverFrame( (nxSessionRef_t) sessionIndex, &(event->frame) );
+    }
+
+    StubNodes_Receive( &(event->frame), event->time );
+}
+
+// Run bus transmissions until the given time: each time the bus gets free, the ready frame with lowest identifier wins arbitration
+static void StubBus_Update( u64 time )
+{
+    while( true )
+    {
+        if( stubBus.isTransmitting )
+        {
+            if( stubBus.transmittedFrame.time > time ) break;
+            stubBus.isTransmitting = false;
+            StubBus_Deliver( &(stubBus.transmittedFrame) );
+            continue;
+        }
+
+        u64 startTime = stubBus.busFreeTime;
+        if( stubBus.arbitratingFrames.number == 0 )
+        {
+            if( stubBus.pendingFrames.number == 0 ) break;
+            if( stubBus.pendingFrames.list[ 0 ].time > startTime ) startTime = stubBus.pendingFrames.list[ 0 ].time;
+        }
+        if( startTime > time ) break;
+
+        while( stubBus.pendingFrames.number > 0 && stubBus.pendingFrames.list[ 0 ].time <= startTime )
+            StubEvents_Push( &(stubBus.arbitratingFrames), StubEvents_Pop( &(stubBus.pendingFrames) ) );
+
+        StubEvent event = StubEvents_Pop( &(stubBus.arbitratingFrames) );
+
+        u64 queueTime = startTime - event.time;
+        u32 frameBits = StubBus_GetFrameBits( &(event.frame) );
+        u64 frameTime = ( stubBus.bitRate > 0 ) ? ( (u64) frameBits * 1000000000ULL ) / stubBus.bitRate : 0;
+
+        stubBus.busStats.FramesNumber++;
+        stubBus.busStats.BitsNumber += frameBits;
+        stubBus.busStats.BusyTime += frameTime;
+        stubBus.busStats.TotalQueueTime += queueTime;
+        if( queueTime > stubBus.busStats.MaxQueueTime ) stubBus.busStats.MaxQueueTime = queueTime;
+
+        event.time = startTime + frameTime;
+        stubBus.busFreeTime = event.time;
+        stubBus.transmittedFrame = event;
+        stubBus.isTransmitting = true;
+    }
+}
+
+// Get notified of frames received by input sessions (e.g. to forward them to other processes)
+void nxStub_SetDeliveryCallback( void (*DeliverFrame)( nxSessionRef_t, const nxFrameVar_t* ) )
+{
+    stubBus.DeliverFrame = DeliverFrame;
+}
+
+// Run the simulated bus up to current time
+void nxStub_Update()
+{
+    pthread_mutex_lock( &stubLock );
+    StubBus_Update( StubClock_GetTime() );
+    pthread_mutex_unlock( &stubLock );
+}
+
+static nxStatus_t StubCreateSession( const char* DatabaseName, const char* ClusterName, const char* List, const char* Interface, u32 Mode, nxSessionRef_t* SessionRef )
+{
+    if( !stubBus.isInitialized ) StubBus_Init();
+
+    // Reuse slots of cleared sessions before taking new ones
+    size_t sessionIndex = 0;
+    while( sessionIndex < stubBus.sessionsNumber && stubBus.sessionsList[ sessionIndex ].isUsed ) sessionIndex++;
+    if( sessionIndex >= STUB_SESSIONS_MAX ) return nxErrMaxSessions;
+    if( sessionIndex == stubBus.sessionsNumber ) stubBus.sessionsNumber++;
+
+    *SessionRef = (nxSessionRef_t) sessionIndex;
+
+    StubSession* session = &(stubBus.sessionsList[ *SessionRef ]);
+    memset( session->name, 0, sizeof(session->name) );
+    strncpy( session->name, List, sizeof(session->name) - 1 );
+    session->mode = Mode;
+    session->identifier = StubBus_GetIdentifier( List );
+    session->isInput = ( Mode <= nxMode_FrameInSinglePoint && Mode != nxMode_SignalOutSinglePoint && Mode != nxMode_SignalOutWaveform && Mode != nxMode_SignalOutXY );
+    session->isUsed = true;
+    session->nextInput = -1;
+    memset( &(session->frame), 0, sizeof(nxFrameVar_t) );
+    session->frame.Identifier = session->identifier;
+    session->frame.PayloadLength = 8;
+
+    // Simulate a drive for each node addressed by the database frames
+    StubNode* node = &(stubBus.nodesList[ session->identifier & 0x7F ]);
+    if( ( session->identifier & 0x780 ) >= 0x180 && ( session->identifier & 0x7F ) > 0 && !node->isPresent ) StubNode_Init( node );
+
+    if( session->isInput )
+    {
+        session->nextInput = stubBus.inputsByID[ session->identifier ];
+        stubBus.inputsByID[ session->identifier ] = (int) *SessionRef;
+    }
+
+    fprintf( stderr, "database: %s - cluster name: %s - list: %s - interface: %s - session ref: %d\n", DatabaseName, ClusterName, List, Interface, *SessionRef );
+
+    return nxSuccess;
+}
+
+
 nxStatus_t nxCreateSession( const char* DatabaseName, const char* ClusterName, const char* List, const char* Interface, u32 Mode, nxSessionRef_t* SessionRef )
 {
-    static int count;
-    *SessionRef = count++;
-    
-    printf( "database: %s - cluster name: %s - list: %s - interface: %s - session ref: %d\n", DatabaseName, ClusterName, List, Interface, *SessionRef );
-    
+    pthread_mutex_lock( &stubLock );
+    nxStatus_t status = StubCreateSession( DatabaseName, ClusterName, List, Interface, Mode, SessionRef );
+    pthread_mutex_unlock( &stubLock );
+
+    return status;
+}
+
+static nxStatus_t StubWriteFrame( nxSessionRef_t SessionRef, void* Buffer, u32 NumberOfBytesForFrames, f64 Timeout )
+{
+    if( SessionRef >= stubBus.sessionsNumber || !stubBus.sessionsList[ SessionRef ].isUsed ) return nxErrInvalidSessionHandle;
+
+    StubSession* session = &(stubBus.sessionsList[ SessionRef ]);
+    u64 time = StubClock_SpendCallTime();
+
+    StubBus_Update( time );
+
+    nxFrameVar_t frame;
+    memcpy( &frame, Buffer, sizeof(nxFrameVar_t) );
+    frame.Identifier = session->identifier;
+    StubBus_Transmit( &frame, time );
+
+    StubBus_Update( time );
+
     return nxSuccess;
 }
 
+
 nxStatus_t nxWriteFrame( nxSessionRef_t SessionRef, void* Buffer, u32 NumberOfBytesForFrames, f64 Timeout )
 {
+    pthread_mutex_lock( &stubLock );
+    nxStatus_t status = StubWriteFrame( SessionRef, Buffer, NumberOfBytesForFrames, Timeout );
+    pthread_mutex_unlock( &stubLock );
+
+    return status;
+}
+
+static nxStatus_t StubReadFrame( nxSessionRef_t SessionRef, void* Buffer, u32 SizeOfBuffer, f64 Timeout, u32* NumberOfBytesReturned )
+{
+    if( SessionRef >= stubBus.sessionsNumber || !stubBus.sessionsList[ SessionRef ].isUsed ) return nxErrInvalidSessionHandle;
+
+    StubBus_Update( StubClock_SpendCallTime() );
+
+    // Single point: always return the last received frame
+    memcpy( Buffer, &(stubBus.sessionsList[ SessionRef ].frame), sizeof(nxFrameVar_t) );
+    *NumberOfBytesReturned = sizeof(nxFrameVar_t);
+
     return nxSuccess;
 }
 
+
 nxStatus_t nxReadFrame( nxSessionRef_t SessionRef, void* Buffer, u32 SizeOfBuffer, f64 Timeout, u32* NumberOfBytesReturned )
 {
-    static nxFrameVar_t frame;
-  
-    static int position;
-    static int velocity;
-    static char key;
-  
-    #ifndef WIN32
-    velocity = 0;
-    
-    if( (key = getch()) )
-    {
-        if( key == 'w' )
-	{
-	  position += 10;
-	  velocity = 10;
-	}
-	else if( key == 's' ) 
-	{
-	  position -= 10;
-	  velocity = -10;
-	}
-    }
-    #endif 
-  
-    if( SessionRef == 5 )
-    {
-	frame.Payload[0] = ( position & 0x000000ff );
-	frame.Payload[1] = ( position & 0x0000ff00 ) / 0x100;
-	frame.Payload[2] = ( position & 0x00ff0000 ) / 0x10000;
-	frame.Payload[3] = ( position & 0xff000000 ) / 0x1000000;
-	frame.Payload[4] = ( SessionRef & 0x000000ff );
-	frame.Payload[5] = ( SessionRef & 0x0000ff00 ) / 0x100; 
-	frame.Payload[6] = ( 0 & 0x000000ff );
-	frame.Payload[7] = ( 0 & 0x0000ff00 ) / 0x100;
-    }
-    else if( SessionRef == 7 )
-    {
-	frame.Payload[0] = ( velocity & 0x000000ff );
-	frame.Payload[1] = ( velocity & 0x0000ff00 ) / 0x100;
-	frame.Payload[2] = ( velocity & 0x00ff0000 ) / 0x10000;
-	frame.Payload[3] = ( velocity & 0xff000000 ) / 0x1000000;
-	frame.Payload[4] = ( SessionRef & 0x000000ff );
-	frame.Payload[5] = ( SessionRef & 0x0000ff00 ) / 0x100; 
-	frame.Payload[6] = ( 0 & 0x000000ff );
-	frame.Payload[7] = ( 0 & 0x0000ff00 ) / 0x100;
-    }
-    
-    memcpy( Buffer, &frame, sizeof(frame) );
-      
+    pthread_mutex_lock( &stubLock );
+    nxStatus_t status = StubReadFrame( SessionRef, Buffer, SizeOfBuffer, Timeout, NumberOfBytesReturned );
+    pthread_mutex_unlock( &stubLock );
+
+    return status;
+}
+
+static nxStatus_t StubReadState( nxSessionRef_t SessionRef, u32 StateID, u32 StateSize, void* StateValue, nxStatus_t* Fault )
+{
+    u64 time = StubClock_GetTime();
+
+    if( Fault != NULL ) *Fault = nxSuccess;
+
+    if( StateID == nxState_TimeCurrent && StateSize >= sizeof(nxTimestamp_t) ) *((nxTimestamp_t*) StateValue) = time / 100;
+    else if( StateID == nxState_CANComm && StateSize >= sizeof(u32) ) *((u32*) StateValue) = StubBus_IsBusOff( time ) ? nxCANCommState_BusOff : nxCANCommState_ErrorActive;
+    else return nxErrInvalidPropertyId;
+
+    return nxSuccess;
+}
+
+
+nxStatus_t nxReadState( nxSessionRef_t SessionRef, u32 StateID, u32 StateSize, void* StateValue, nxStatus_t* Fault )
+{
+    pthread_mutex_lock( &stubLock );
+    nxStatus_t status = StubReadState( SessionRef, StateID, StateSize, StateValue, Fault );
+    pthread_mutex_unlock( &stubLock );
+
+    return status;
+}
+
+static bool StubBus_IsPending( u32 identifier )
+{
+    if( stubBus.isTransmitting && stubBus.transmittedFrame.frame.Identifier == identifier ) return true;
+
+    for( size_t eventIndex = 0; eventIndex < stubBus.arbitratingFrames.number; eventIndex++ )
+        if( stubBus.arbitratingFrames.list[ eventIndex ].frame.Identifier == identifier ) return true;
+
+    for( size_t eventIndex = 0; eventIndex < stubBus.pendingFrames.number; eventIndex++ )
+        if( stubBus.pendingFrames.list[ eventIndex ].frame.Identifier == identifier ) return true;
+
+    return false;
+}
+
+static u64 StubBus_GetNextEventTime()
+{
+    if( stubBus.isTransmitting ) return stubBus.transmittedFrame.time;
+    if( stubBus.arbitratingFrames.number > 0 ) return stubBus.busFreeTime;
+
+    u64 nextTime = stubBus.pendingFrames.list[ 0 ].time;
+    return ( nextTime > stubBus.busFreeTime ) ? nextTime : stubBus.busFreeTime;
+}
+
+static nxStatus_t StubWait( nxSessionRef_t SessionRef, u32 Condition, u32 ParamIn, f64 Timeout, u32* ParamOut )
+{
+    if( SessionRef >= stubBus.sessionsNumber || !stubBus.sessionsList[ SessionRef ].isUsed ) return nxErrInvalidSessionHandle;
+
+    if( Condition != nxCondition_TransmitComplete ) return nxSuccess;
+
+    u32 identifier = stubBus.sessionsList[ SessionRef ].identifier;
+    u64 time = StubClock_SpendCallTime();
+    u64 timeoutTime = time + StubClock_FromSeconds( Timeout );
+
+    StubBus_Update( time );
+    while( StubBus_IsPending( identifier ) )
+    {
+        if( Timeout >= 0.0 && time >= timeoutTime ) return nxErrEventTimeout;
+        #ifdef NIXNET_STUB_VIRTUAL_TIME
+        u64 nextTime = StubBus_GetNextEventTime();
+        if( Timeout >= 0.0 && nextTime > timeoutTime ) nextTime = timeoutTime;
+        TimeVirtual_AdvanceTo( nextTime );
+        #endif
+        time = StubClock_GetTime();
+        StubBus_Update( time );
+    }
+
     return nxSuccess;
 }
 
+
+nxStatus_t nxWait( nxSessionRef_t SessionRef, u32 Condition, u32 ParamIn, f64 Timeout, u32* ParamOut )
+{
+    pthread_mutex_lock( &stubLock );
+    nxStatus_t status = StubWait( SessionRef, Condition, ParamIn, Timeout, ParamOut );
+    pthread_mutex_unlock( &stubLock );
+
+    return status;
+}
+
 void nxStatusToString( nxStatus_t Status, u32 SizeofString, char* StatusDescription )
 {
-    return;
+    snprintf( StatusDescription, SizeofString, "simulated status 0x%08X", (u32) Status );
 }
 
-nxStatus_t nxClear( nxSessionRef_t SessionRef )
+static nxStatus_t StubClear( nxSessionRef_t SessionRef )
 {
+    if( SessionRef >= stubBus.sessionsNumber ) return nxErrInvalidSessionHandle;
+
+    StubSession* session = &(stubBus.sessionsList[ SessionRef ]);
+    if( session->isUsed && session->isInput )
+    {
+        for( int* ref_index = &(stubBus.inputsByID[ session->identifier ]); *ref_index >= 0; ref_index = &(stubBus.sessionsList[ *ref_index ].nextInput) )
+        {
+            if( *ref_index == (int) SessionRef )
+            {
+                *ref_index = session->nextInput;
+                break;
+            }
+        }
+    }
+    session->isUsed = false;
+
     return nxSuccess;
 }
 
 
+nxStatus_t nxClear( nxSessionRef_t SessionRef )
+{
+    pthread_mutex_lock( &stubLock );
+    nxStatus_t status = StubClear( SessionRef );
+    pthread_mutex_unlock( &stubLock );
+
+    return status;
+}
+
+
 #endif /* ___nixnet_h___ */
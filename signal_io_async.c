@@ -22,13 +22,19 @@
 
 #include "signal_io/interface.h"
 #include "can_network.h"
+#include "can_commands.h"
+#include "can_channels.h"
+#include "signal_io_statistics.h"
+#include "alloc_tracking.h"
 
 #include "klib/khash.h"
 
 #include "debug/async_debug.h"
 
-enum { INPUT_POSITION, INPUT_VELOCITY, INPUT_CURRENT, INPUT_ANALOG, INPUT_CHANNELS_NUMBER };
-enum { OUTPUT_POSITION, OUTPUT_VELOCITY, OUTPUT_CURRENT, OUTPUT_CHANNELS_NUMBER };
+// Bus and host threads both delay, so they can't share the single threaded simulated clock
+#ifdef NIXNET_STUB_VIRTUAL_TIME
+  #error "asynchronous plug-in can't run on virtual time (NIXNET_STUB_VIRTUAL_TIME): use the stub on real time"
+#endif
 
 enum States { READY_2_SWITCH_ON = 1, SWITCHED_ON = 2, OPERATION_ENABLED = 4, FAULT = 8, VOLTAGE_ENABLED = 16, 
               QUICK_STOPPED = 32, SWITCH_ON_DISABLE = 64, REMOTE_NMT = 512, TARGET_REACHED = 1024, SETPOINT_ACK = 4096 };
@@ -38,18 +44,36 @@ enum Controls { SWITCH_ON = 1, ENABLE_VOLTAGE = 2, QUICK_STOP = 4, ENABLE_OPERAT
 
 static const size_t AQUISITION_BUFFER_LENGTH = 1;
 
+const int PROFILE_POSITION_MODE = 0x01;
+
+#define BUS_TASKS_MAX 128
+#define BUS_CYCLE_DELAY 1     // Default time (in milliseconds) between network cycles (their starts, with the Linux timing module)
+
 typedef struct _SignalIOTaskData
 {
   CANFrame readFramesList[ CAN_FRAME_TYPES_NUMBER ];
   CANFrame writeFramesList[ CAN_FRAME_TYPES_NUMBER ];
-  uint16_t statusWord, controlWord;
-  Thread threadID;
+  uint16_t controlWord;
+  CANCommandFuture statusRead;           // Statusword SDO read, while not reading TPDOs
+  bool isStatusWanted;                   // Statusword SDO read requested to the bus thread
   bool isReading;
-  unsigned int inputChannelUsesList[ INPUT_CHANNELS_NUMBER ];
-  Semaphore inputChannelLocksList[ INPUT_CHANNELS_NUMBER ];
-  double measuresList[ INPUT_CHANNELS_NUMBER ];
+  CANChannelsMap channels;
+  unsigned int inputChannelUsesList[ CAN_CHANNELS_MAX ];
+  Semaphore inputChannelLocksList[ CAN_CHANNELS_MAX ];
+  double measuresList[ CAN_CHANNELS_MAX ];
   bool isOutputChannelUsed; 
-  uint8_t readPayload[ 8 ], writePayload[ 8 ];
+  unsigned int outputChannel;
+  uint8_t readPayload[ 8 ];
+  uint8_t writePayloadsList[ CAN_FRAME_TYPES_NUMBER ][ 8 ];  // Last values of every RPDO object
+  uint64_t outputPayloadsList[ CAN_FRAME_TYPES_NUMBER ];     // RPDO payloads published to the bus thread
+  uint8_t newOutputsMask;                                    // RPDOs published since written (bits by PDO type)
+  unsigned int pdoDivisorsList[ CAN_FRAME_TYPES_NUMBER ];   // PDOs are exchanged every <divisor> network cycles
+  unsigned int pdoPhasesList[ CAN_FRAME_TYPES_NUMBER ];     // Scheduled SYNCs offset (RPDOs written before them, TPDOs answering them)
+  uint8_t outputPayload[ 8 ];
+  uint8_t nodeID;
+  double lastCycleTime;                  // For acquisition period statistics
+  CANMetricsTimes cycleTimes;
+  unsigned long overrunsCount, staleSamplesCount;
 }
 SignalIOTaskData;
 
@@ -58,16 +82,32 @@ typedef SignalIOTaskData* SignalIOTask;
 KHASH_MAP_INIT_INT( TaskInt, SignalIOTask )
 static khash_t( TaskInt )* tasksList = NULL;
 
+// A single thread owns the network cycle: it sends SYNC, executes queued commands and exchanges PDOs of all
+// registered tasks, which are only added and removed between its cycles
+static Thread busThreadID;
+static bool isBusRunning = false;
+static SignalIOTask busTasksList[ BUS_TASKS_MAX ];
+static unsigned long busCyclesCount = 0;
+
 IMPLEMENT_INTERFACE( SIGNAL_IO_FUNCTIONS ) 
 
 static SignalIOTask LoadTaskData( const char* );
 static void UnloadTaskData( SignalIOTask );
 
-static void* AsyncReadBuffer( void* );
+static void* AsyncUpdateBus( void* );
+static void RegisterBusTask( SignalIOTask );
+static void UnregisterBusTask( SignalIOTask );
+static void ReadInputs( SignalIOTask );
+static void WriteOutputs( SignalIOTask );
+static void UpdateMeasures( SignalIOTask, enum CANFrameTypes );
+static void RefreshStatusWord( SignalIOTask );
+static uint16_t GetStatusWord( SignalIOTask );
 static inline bool IsTaskStillUsed( SignalIOTask );
 
 int InitTask( const char* taskConfig )
 {
+  ALLOCATION_PHASE( INIT );
+  
   if( tasksList == NULL ) tasksList = kh_init( TaskInt );
   
   int taskKey = (int) kh_str_hash_func( taskConfig );
@@ -80,9 +120,12 @@ int InitTask( const char* taskConfig )
     if( kh_value( tasksList, newTaskIndex ) == NULL )
     {
       DEBUG_PRINT( "loading task %s failed", taskConfig );
-      EndTask( taskKey ); 
+      // No task data to release
+      kh_del( TaskInt, tasksList, newTaskIndex );
       return -1;
     }
+    
+    RegisterBusTask( kh_value( tasksList, newTaskIndex ) );
         
     DEBUG_PRINT( "new key %d inserted (iterator: %u - total: %u)", kh_key( tasksList, newTaskIndex ), newTaskIndex, kh_size( tasksList ) );
   }
@@ -93,14 +136,28 @@ int InitTask( const char* taskConfig )
 
 void EndTask( int taskID )
 {
+  ALLOCATION_PHASE( SHUTDOWN );
+  
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return;
   
   SignalIOTask task = kh_value( tasksList, taskIndex );
   
+  UnregisterBusTask( task );
+  
+  // Back to TPDOs sent on every SYNC
+  for( size_t pdoType = PDO01; pdoType < CAN_FRAME_TYPES_NUMBER; pdoType++ )
+  {
+    if( task->pdoDivisorsList[ pdoType ] > 1 ) 
+      CANChannels_WriteSchedule( pdoType, 1, 0, task->writeFramesList[ SDO ], task->readFramesList[ SDO ], task->nodeID );
+  }
+  
+  // Frames are released below, so no queued command may still refer to them
+  CANCommands_Flush();
+  
   UnloadTaskData( task );
   
-  kh_del( TaskInt, tasksList, (khint_t) taskID );
+  kh_del( TaskInt, tasksList, taskIndex );
   
   if( kh_size( tasksList ) == 0 )
   {
@@ -111,12 +168,14 @@ void EndTask( int taskID )
 
 bool Read( int taskID, unsigned int channel, double* ref_value )
 {
+  ALLOCATION_PHASE( CYCLE );
+  
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return false;
   
   SignalIOTask task = kh_value( tasksList, taskIndex );
   
-  if( channel >= INPUT_CHANNELS_NUMBER ) return false;
+  if( channel >= task->channels.inputsNumber ) return false;
   
   if( !task->isReading ) return false;
   
@@ -129,35 +188,36 @@ bool Read( int taskID, unsigned int channel, double* ref_value )
 
 bool HasError( int taskID )
 {
+  ALLOCATION_PHASE( CYCLE );
+  
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return false;
   
   SignalIOTask task = kh_value( tasksList, taskIndex );
   
-  if( !task->isReading )
-    task->statusWord = (uint16_t) CANNetwork_ReadSingleValue( task->writeFramesList[ SDO ], task->readFramesList[ SDO ], 0x6041, 0x00 );
-
-  return (bool) ( task->statusWord & FAULT );
+  return (bool) ( GetStatusWord( task ) & FAULT );
 }
 
 void Reset( int taskID )
 {
+  ALLOCATION_PHASE( CYCLE );
+  
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return;
   
   SignalIOTask task = kh_value( tasksList, taskIndex );
   
   task->controlWord |= FAULT_RESET;
-  CANNetwork_WriteSingleValue( task->writeFramesList[ SDO ], 0x6040, 0x00, task->controlWord );
-  
-  Timing.Delay( 200 );
+  CANCommands_WriteSingleValue( task->writeFramesList[ SDO ], task->readFramesList[ SDO ], 0x6040, 0x00, task->controlWord, 0, NULL, NULL );
   
   task->controlWord &= (~FAULT_RESET);
-  CANNetwork_WriteSingleValue( task->writeFramesList[ SDO ], 0x6040, 0x00, task->controlWord );
+  CANCommands_WriteSingleValue( task->writeFramesList[ SDO ], task->readFramesList[ SDO ], 0x6040, 0x00, task->controlWord, 200, NULL, NULL );
 }
 
 bool AcquireInputChannel( int taskID, unsigned int channel )
 {
+  ALLOCATION_PHASE( INIT );
+  
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return false;
   
@@ -165,9 +225,9 @@ bool AcquireInputChannel( int taskID, unsigned int channel )
   
   SignalIOTask task = kh_value( tasksList, taskIndex );
   
-  if( channel >= INPUT_CHANNELS_NUMBER ) return false;
+  if( channel >= task->channels.inputsNumber ) return false;
   
-  if( !task->isReading ) task->threadID = Threading.StartThread( AsyncReadBuffer, task, THREAD_JOINABLE );
+  __atomic_store_n( &(task->isReading), true, __ATOMIC_RELEASE );
   
   if( task->inputChannelUsesList[ channel ] >= SIGNAL_INPUT_CHANNEL_MAX_USES ) return false;
   
@@ -178,22 +238,21 @@ bool AcquireInputChannel( int taskID, unsigned int channel )
 
 void ReleaseInputChannel( int taskID, unsigned int channel )
 {
+  ALLOCATION_PHASE( INIT );
+  
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return;
   
   SignalIOTask task = kh_value( tasksList, taskIndex );
   
-  if( channel >= INPUT_CHANNELS_NUMBER ) return;
+  if( channel >= task->channels.inputsNumber ) return;
   
   if( task->inputChannelUsesList[ channel ] > 0 ) task->inputChannelUsesList[ channel ]--;
   
   if( IsTaskStillUsed( task ) )
   {
     if( task->isReading )
-    {
-      task->isReading = false;
-      Threading.WaitExit( task->threadID, 5000 );
-    }
+      __atomic_store_n( &(task->isReading), false, __ATOMIC_RELEASE );
     else
       EndTask( taskID );
   }
@@ -201,6 +260,8 @@ void ReleaseInputChannel( int taskID, unsigned int channel )
 
 void EnableOutput( int taskID, bool enable )
 {
+  ALLOCATION_PHASE( INIT );
+  
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return;
   
@@ -208,92 +269,80 @@ void EnableOutput( int taskID, bool enable )
   
   task->controlWord |= SWITCH_ON;
   task->controlWord &= (~ENABLE_OPERATION);
-  CANNetwork_WriteSingleValue( task->writeFramesList[ SDO ], 0x6040, 0x00, task->controlWord );
-  
-  Timing.Delay( 200 );
+  CANCommands_WriteSingleValue( task->writeFramesList[ SDO ], task->readFramesList[ SDO ], 0x6040, 0x00, task->controlWord, 0, NULL, NULL );
   
   if( enable ) task->controlWord |= ENABLE_OPERATION;
   else task->controlWord &= (~SWITCH_ON);
     
-  CANNetwork_WriteSingleValue( task->writeFramesList[ SDO ], 0x6040, 0x00, task->controlWord );
+  CANCommands_WriteSingleValue( task->writeFramesList[ SDO ], task->readFramesList[ SDO ], 0x6040, 0x00, task->controlWord, 200, NULL, NULL );
 }
 
 bool IsOutputEnabled( int taskID )
 {
+  ALLOCATION_PHASE( CYCLE );
+  
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return false;
   
   SignalIOTask task = kh_value( tasksList, taskIndex );
   
-  if( !task->isReading )
-    task->statusWord = (uint16_t) CANNetwork_ReadSingleValue( task->writeFramesList[ SDO ], task->readFramesList[ SDO ], 0x6041, 0x00 );
-
-  return (bool) ( task->statusWord & ( SWITCHED_ON | OPERATION_ENABLED ) ) ;
+  return (bool) ( GetStatusWord( task ) & ( SWITCHED_ON | OPERATION_ENABLED ) ) ;
 }
 
 bool Write( int taskID, unsigned int channel, double value )
 {
+  ALLOCATION_PHASE( CYCLE );
+  
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return false;
   
   SignalIOTask task = kh_value( tasksList, taskIndex );
   
-  int encoderSetpoint = (int) value;
-  int16_t currentSetpointHEX = (int16_t) value + ( ( value < 0.0 ) ? 0xFFFF : 0 );
-  
-  // Set values for PDO01 (Position Setpoint and Control Word)
-  task->writePayload[ 0 ] = (uint8_t) ( encoderSetpoint & 0x000000FF );
-  task->writePayload[ 1 ] = (uint8_t) ( ( encoderSetpoint & 0x0000FF00 ) / 0x100 );
-  task->writePayload[ 2 ] = (uint8_t) ( ( encoderSetpoint & 0x00FF0000 ) / 0x10000 );
-  task->writePayload[ 3 ] = (uint8_t) ( ( encoderSetpoint & 0xFF000000 ) / 0x1000000 );
-  task->writePayload[ 4 ] = (uint8_t) ( currentSetpointHEX & 0x000000FF );
-  task->writePayload[ 5 ] = (uint8_t) ( ( currentSetpointHEX & 0x0000FF00 ) / 0x100 ); 
-  task->writePayload[ 6 ] = (uint8_t) ( task->controlWord & 0x000000FF );
-  task->writePayload[ 7 ] = (uint8_t) ( ( task->controlWord & 0x0000FF00 ) / 0x100 ); 
-  
-  // Write values from buffer to PDO01 
-  CANFrame_Write( task->writeFramesList[ PDO01 ], task->writePayload );
-  
-  int velocitySetpointRPM = (int) value;
-  int16_t digitalOutput = (int16_t) value;
+  if( channel >= task->channels.outputsNumber ) return false;
   
-  //DEBUG_PRINT( "velocity setpoint: %d", rawVelocitySetpoint );
+  // Update channel object and Control Word on RPDO buffers
+  CANChannel* outputChannel = &(task->channels.outputsList[ channel ]);
+  CANChannel_Encode( outputChannel, (int64_t) ( value * outputChannel->rawScale ), task->writePayloadsList[ outputChannel->pdoType ] );
+  if( task->channels.controlWord.pdoType < CAN_FRAME_TYPES_NUMBER )
+    CANChannel_Encode( &(task->channels.controlWord), task->controlWord, task->writePayloadsList[ task->channels.controlWord.pdoType ] );
   
-  // Set values for PDO02 (Velocity Setpoint and Digital Output)
-  task->writePayload[ 0 ] = (uint8_t) ( velocitySetpointRPM & 0x000000FF );
-  task->writePayload[ 1 ] = (uint8_t) ( ( velocitySetpointRPM & 0x0000FF00 ) / 0x100 );
-  task->writePayload[ 2 ] = (uint8_t) ( ( velocitySetpointRPM & 0x00FF0000 ) / 0x10000 );
-  task->writePayload[ 3 ] = (uint8_t) ( ( velocitySetpointRPM & 0xFF000000 ) / 0x1000000 );
-  task->writePayload[ 4 ] = (uint8_t) ( digitalOutput & 0x000000FF );
-  task->writePayload[ 5 ] = (uint8_t) ( ( digitalOutput & 0x0000FF00 ) / 0x100 ); 
-  task->writePayload[ 6 ] = ( 0 & 0x000000FF );
-  task->writePayload[ 7 ] = ( 0 & 0x0000FF00 ) / 0x100; 
-  
-  // Write values from buffer to PDO01
-  CANFrame_Write( task->writeFramesList[ PDO02 ], task->writePayload );
-  
-  CANNetwork_Sync();
+  // Publish buffers (each RPDO payload as a whole) to the bus thread, which writes them before next SYNC
+  for( size_t pdoType = PDO01; pdoType < CAN_FRAME_TYPES_NUMBER; pdoType++ )
+  {
+    uint64_t payload;
+    memcpy( &payload, task->writePayloadsList[ pdoType ], sizeof(payload) );
+    __atomic_store_n( &(task->outputPayloadsList[ pdoType ]), payload, __ATOMIC_RELAXED );
+  }
+  __atomic_store_n( &(task->newOutputsMask), (uint8_t) ( ( 1 << CAN_FRAME_TYPES_NUMBER ) - ( 1 << PDO01 ) ), __ATOMIC_RELEASE );
   
   return true;
 }
 
 bool AcquireOuputChannel( int taskID, unsigned int channel )
 {
-  const int OPERATION_MODES[ OUTPUT_CHANNELS_NUMBER ] = { 0xFF, 0xFE, 0xFD };
+  ALLOCATION_PHASE( INIT );
   
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return false;
   
   SignalIOTask task = kh_value( tasksList, taskIndex );
   
-  if( channel >= OUTPUT_CHANNELS_NUMBER ) return false;
+  if( channel >= task->channels.outputsNumber ) return false;
+  
+  // Outputs that don't select an operation mode (e.g. digital outputs) may be written along with the active one
+  CANChannel* outputChannel = &(task->channels.outputsList[ channel ]);
+  if( outputChannel->operationMode == 0 ) return true;
+  
+  // No profile position setpoints handshake on the acquisition thread
+  if( outputChannel->operationMode == PROFILE_POSITION_MODE ) return false;
   
   if( task->isOutputChannelUsed ) return false;
   
-  DEBUG_PRINT( "setting operation mode %X", OPERATION_MODES[ channel ] );
+  DEBUG_PRINT( "setting operation mode %X", outputChannel->operationMode );
   
-  CANNetwork_WriteSingleValue( task->writeFramesList[ SDO ], 0x6060, 0x00, OPERATION_MODES[ channel ] );
+  CANCommands_WriteSingleValue( task->writeFramesList[ SDO ], task->readFramesList[ SDO ], 0x6060, 0x00, outputChannel->operationMode, 0, NULL, NULL );
   
+  task->outputChannel = channel;
   task->isOutputChannelUsed = true;
   
   return true;
@@ -301,62 +350,259 @@ bool AcquireOuputChannel( int taskID, unsigned int channel )
 
 void ReleaseOutputChannel( int taskID, unsigned int channel )
 {
+  ALLOCATION_PHASE( INIT );
+  
   khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
   if( taskIndex == kh_end( tasksList ) ) return;
   
   SignalIOTask task = kh_value( tasksList, taskIndex );
   
-  if( channel >= OUTPUT_CHANNELS_NUMBER ) return;
+  if( channel >= task->channels.outputsNumber ) return;
   
-  CANNetwork_WriteSingleValue( task->writeFramesList[ SDO ], 0x6060, 0x00, 0x00 );
+  if( task->channels.outputsList[ channel ].operationMode == 0 ) return;
+  
+  // Releasing another output (not the one in use) must not reset its operation mode
+  if( task->isOutputChannelUsed && channel != task->outputChannel ) return;
+  
+  CANCommands_WriteSingleValue( task->writeFramesList[ SDO ], task->readFramesList[ SDO ], 0x6060, 0x00, 0x00, 0, NULL, NULL );
   
   task->isOutputChannelUsed = false;
   
   if( !IsTaskStillUsed( task ) ) EndTask( taskID );
 }
 
+bool GetStatistics( int taskID, SignalIOStatistics* ref_statistics )
+{
+  SignalIOStatistics statistics;
+  
+  khint_t taskIndex = kh_get( TaskInt, tasksList, (khint_t) taskID );
+  if( taskIndex == kh_end( tasksList ) ) return false;
+  
+  SignalIOTask task = kh_value( tasksList, taskIndex );
+  
+  statistics.cyclesCount = (unsigned long) CANMetrics_GetTimes( &(task->cycleTimes), &(statistics.minCycleTime), &(statistics.averageCycleTime), &(statistics.maxCycleTime) );
+  statistics.overrunsCount = __atomic_load_n( &(task->overrunsCount), __ATOMIC_RELAXED );
+  statistics.framesReceivedCount = (unsigned long) CANMetrics_GetFramesCount( task->nodeID, false );
+  statistics.framesSentCount = (unsigned long) CANMetrics_GetFramesCount( task->nodeID, true );
+  statistics.errorsCount = (unsigned long) CANMetrics_GetErrorsCount( task->nodeID );
+  statistics.staleSamplesCount = __atomic_load_n( &(task->staleSamplesCount), __ATOMIC_RELAXED );
+  statistics.sdoTransfersCount = (unsigned long) CANMetrics_GetTimes( &(metrics.nodeSDOTimes[ task->nodeID ]), &(statistics.minSDOLatency), 
+                                                                     &(statistics.averageSDOLatency), &(statistics.maxSDOLatency) );
+  statistics.responsesCount = (unsigned long) CANMetrics_GetResponseTimes( task->nodeID, &(statistics.minResponseTime), 
+                                                                         &(statistics.averageResponseTime), &(statistics.maxResponseTime) );
+  
+  return SignalIOStatistics_Copy( &statistics, ref_statistics );
+}
 
-static void* AsyncReadBuffer( void* callbackData )
+bool GetBusStatistics( SignalIOStatistics* ref_statistics )
 {
-  SignalIOTask task = (SignalIOTask) callbackData;
+  SignalIOStatistics statistics;
+  
+  statistics.cyclesCount = (unsigned long) CANMetrics_GetTimes( &(metrics.cycleTimes), &(statistics.minCycleTime), &(statistics.averageCycleTime), &(statistics.maxCycleTime) );
+  statistics.overrunsCount = (unsigned long) __atomic_load_n( &(metrics.overrunsCount), __ATOMIC_RELAXED );
+  statistics.framesReceivedCount = (unsigned long) CANMetrics_GetFramesCount( CAN_METRICS_ALL_NODES, false );
+  statistics.framesSentCount = (unsigned long) CANMetrics_GetFramesCount( CAN_METRICS_ALL_NODES, true );
+  statistics.errorsCount = (unsigned long) CANMetrics_GetErrorsCount( CAN_METRICS_ALL_NODES );
+  statistics.staleSamplesCount = (unsigned long) CANMetrics_GetStaleSamplesCount();
+  statistics.sdoTransfersCount = (unsigned long) CANMetrics_GetTimes( &(metrics.nodeSDOTimes[ CAN_METRICS_ALL_NODES ]), &(statistics.minSDOLatency), 
+                                                                     &(statistics.averageSDOLatency), &(statistics.maxSDOLatency) );
+  statistics.responsesCount = (unsigned long) CANMetrics_GetResponseTimes( CAN_METRICS_ALL_NODES, &(statistics.minResponseTime), 
+                                                                         &(statistics.averageResponseTime), &(statistics.maxResponseTime) );
+  
+  return SignalIOStatistics_Copy( &statistics, ref_statistics );
+}
+
+
+static void* AsyncUpdateBus( void* data )
+{
+  // Longer cycles for larger networks (e.g. 2 RPDOs and 2 TPDOs for 127 nodes take about 60 ms at 1 Mbit/s)
+  const char* cycleDelayString = getenv( "NIXNET_CYCLE_DELAY" );
+  unsigned long cycleDelay = ( cycleDelayString != NULL ) ? strtoul( cycleDelayString, NULL, 0 ) : BUS_CYCLE_DELAY;
   
-  task->isReading = true;
+  #ifdef TIMING_LINUX
+  // Cycles start on absolute deadlines, so that their processing times don't add up to the period
+  uint64_t cyclePeriod = 1000000ULL * cycleDelay;
+  uint64_t nextCycleTime = TimeLinux_GetNanoseconds();
+  #endif
   
-  while( task->isReading )
+  while( __atomic_load_n( &isBusRunning, __ATOMIC_ACQUIRE ) )
   { 
+    // Steady state: no heap allocations expected from here
+    ALLOCATION_PHASE( CYCLE );
+    
+    // Apply setpoints written on last cycle
     CANNetwork_Sync();
-  
-    // Read values from PDO01 (Position, Current and Status Word) to buffer
-    CANFrame_Read( task->readFramesList[ PDO01 ], task->readPayload );  
-    // Update values from PDO01
-    task->measuresList[ INPUT_POSITION ] = task->readPayload[ 3 ] * 0x1000000 + task->readPayload[ 2 ] * 0x10000 + task->readPayload[ 1 ] * 0x100 + task->readPayload[ 0 ];
-    int currentHEX = task->readPayload[ 5 ] * 0x100 + task->readPayload[ 4 ];
-    double currentMA = currentHEX - ( ( currentHEX >= 0x8000 ) ? 0xFFFF : 0 );
-    task->measuresList[ INPUT_CURRENT ] = currentMA / 1000.0;
-  
-    task->statusWord = task->readPayload[ 7 ] * 0x100 + task->readPayload[ 6 ];
-  
-    // Read values from PDO02 (Velocity and Tension) to buffer
-    CANFrame_Read( task->readFramesList[ PDO02 ], task->readPayload );  
-    // Update values from PDO02
-    task->measuresList[ INPUT_VELOCITY ] = task->readPayload[ 3 ] * 0x1000000 + task->readPayload[ 2 ] * 0x10000 + task->readPayload[ 1 ] * 0x100 + task->readPayload[ 0 ];
-    task->measuresList[ INPUT_ANALOG ] = task->readPayload[ 5 ] * 0x100 + task->readPayload[ 4 ];
+    // Bus access for SDO/NMT commands from other threads happens here
+    CANCommands_Process();
+    CAN_PROBE1( cycle_start, CANNetwork_GetSyncCount() );
+    
+    for( size_t taskIndex = 0; taskIndex < BUS_TASKS_MAX; taskIndex++ )
+    {
+      SignalIOTask task = __atomic_load_n( &(busTasksList[ taskIndex ]), __ATOMIC_ACQUIRE );
+      if( task == NULL ) continue;
+      if( __atomic_load_n( &(task->isReading), __ATOMIC_ACQUIRE ) ) ReadInputs( task );
+      WriteOutputs( task );
+      RefreshStatusWord( task );
+    }
+    
+    CAN_PROBE1( cycle_end, CANNetwork_GetSyncCount() );
     
-    for( unsigned int channel = 0; channel < INPUT_CHANNELS_NUMBER; channel++ )
-      Semaphores.SetCount( task->inputChannelLocksList[ channel ], task->inputChannelUsesList[ channel ] );
+    __atomic_add_fetch( &busCyclesCount, 1, __ATOMIC_SEQ_CST );
+    
+    #ifdef TIMING_LINUX
+    nextCycleTime += cyclePeriod;
+    // Overrun cycles are not caught up: next one starts right away and the following ones a period apart
+    uint64_t currentTime = TimeLinux_GetNanoseconds();
+    if( nextCycleTime < currentTime ) nextCycleTime = currentTime;
+    TimeLinux_SleepUntil( nextCycleTime );
+    #else
+    Time_Delay( cycleDelay );
+    #endif
   }
   
-  DEBUG_PRINT( "ending aquisition thread %lx", THREAD_ID );
+  ALLOCATION_PHASE( SHUTDOWN );
+  
+  DEBUG_PRINT( "ending bus thread %lx", THREAD_ID );
   
   return NULL;
 }
 
+// Add task to the ones updated by the bus thread, starting it for the first one
+void RegisterBusTask( SignalIOTask task )
+{
+  for( size_t taskIndex = 0; taskIndex < BUS_TASKS_MAX; taskIndex++ )
+  {
+    SignalIOTask freeSlot = NULL;
+    if( __atomic_compare_exchange_n( &(busTasksList[ taskIndex ]), &freeSlot, task, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED ) ) break;
+  }
+  
+  if( !__atomic_load_n( &isBusRunning, __ATOMIC_ACQUIRE ) )
+  {
+    __atomic_store_n( &isBusRunning, true, __ATOMIC_RELEASE );
+    busThreadID = Threading.StartThread( AsyncUpdateBus, NULL, THREAD_JOINABLE );
+    CANCommands_SetCycleThread( true );
+  }
+}
+
+// Remove task from bus updates, returning only when the bus thread can't be using it anymore
+void UnregisterBusTask( SignalIOTask task )
+{
+  bool hasTasks = false;
+  for( size_t taskIndex = 0; taskIndex < BUS_TASKS_MAX; taskIndex++ )
+  {
+    if( busTasksList[ taskIndex ] == task ) __atomic_store_n( &(busTasksList[ taskIndex ]), NULL, __ATOMIC_SEQ_CST );
+    else if( busTasksList[ taskIndex ] != NULL ) hasTasks = true;
+  }
+  
+  if( !__atomic_load_n( &isBusRunning, __ATOMIC_ACQUIRE ) ) return;
+  
+  if( !hasTasks )
+  {
+    __atomic_store_n( &isBusRunning, false, __ATOMIC_RELEASE );
+    Threading.WaitExit( busThreadID, 5000 );
+    CANCommands_SetCycleThread( false );
+    return;
+  }
+  
+  // A cycle that started before the removal ends by incrementing the count, and the next one drops its pending outputs
+  unsigned long cyclesCount = __atomic_load_n( &busCyclesCount, __ATOMIC_SEQ_CST );
+  while( __atomic_load_n( &busCyclesCount, __ATOMIC_SEQ_CST ) - cyclesCount < 2 ) Time_Delay( 1 );
+}
+
+// Update measures from TPDOs answering last SYNC and release waiting readers (called from the bus thread)
+void ReadInputs( SignalIOTask task )
+{
+  double cycleTime = Time_GetExecSeconds();
+  if( task->lastCycleTime >= 0.0 )
+  {
+    CANMetrics_AddTime( &(task->cycleTimes), cycleTime - task->lastCycleTime );
+    if( cycleTime - task->lastCycleTime > CAN_METRICS_OVERRUN_TIME ) __atomic_add_fetch( &(task->overrunsCount), 1, __ATOMIC_RELAXED );
+  }
+  task->lastCycleTime = cycleTime;
+  
+  // Read values from PDO01 to buffer, waiting for the one answering last SYNC (if it was scheduled to)
+  if( CANNetwork_IsInputScheduled( task->pdoDivisorsList[ PDO01 ], task->pdoPhasesList[ PDO01 ] ) )
+  {
+    if( !CANNetwork_ReadInput( task->readFramesList[ PDO01 ], task->readPayload ) )
+    {
+      __atomic_add_fetch( &(task->staleSamplesCount), 1, __ATOMIC_RELAXED );
+      CANMetrics_AddStaleSample();
+    }
+    UpdateMeasures( task, PDO01 );
+  }
+  
+  // Read values from PDO02 to buffer
+  if( CANNetwork_IsInputScheduled( task->pdoDivisorsList[ PDO02 ], task->pdoPhasesList[ PDO02 ] ) )
+  {
+    CANNetwork_ReadInput( task->readFramesList[ PDO02 ], task->readPayload );  
+    UpdateMeasures( task, PDO02 );
+  }
+  
+  for( unsigned int channel = 0; channel < CAN_CHANNELS_MAX; channel++ )
+    Semaphores.SetCount( task->inputChannelLocksList[ channel ], task->inputChannelUsesList[ channel ] );
+}
+
+// Write RPDOs published since they were last written, on their scheduled cycles, to be applied on next SYNC (called from the bus thread)
+void WriteOutputs( SignalIOTask task )
+{
+  for( size_t pdoType = PDO01; pdoType < CAN_FRAME_TYPES_NUMBER; pdoType++ )
+  {
+    if( !CANNetwork_IsScheduled( task->pdoDivisorsList[ pdoType ], task->pdoPhasesList[ pdoType ] ) ) continue;
+    
+    uint8_t pdoBit = (uint8_t) ( 1 << pdoType );
+    if( !( __atomic_fetch_and( &(task->newOutputsMask), (uint8_t) ~pdoBit, __ATOMIC_ACQUIRE ) & pdoBit ) ) continue;
+    
+    uint64_t payload = __atomic_load_n( &(task->outputPayloadsList[ pdoType ]), __ATOMIC_RELAXED );
+    memcpy( task->outputPayload, &payload, sizeof(payload) );
+    CANFrame_Write( task->writeFramesList[ pdoType ], task->outputPayload );
+    CANNetwork_AddPendingOutputs( task->writeFramesList + pdoType, 1 );
+  }
+}
+
+// Decode input channels (and statusword) mapped on last read TPDO
+void UpdateMeasures( SignalIOTask task, enum CANFrameTypes pdoType )
+{
+  for( size_t channel = 0; channel < task->channels.inputsNumber; channel++ )
+  {
+    CANChannel* inputChannel = &(task->channels.inputsList[ channel ]);
+    if( inputChannel->pdoType == pdoType ) task->measuresList[ channel ] = CANChannel_Decode( inputChannel, task->readPayload ) * inputChannel->valueScale;
+  }
+  
+  if( task->channels.statusWord.pdoType == pdoType ) 
+    CANDictionary_SetValue( task->nodeID, OD_STATUS_WORD, (int32_t) CANChannel_Decode( &(task->channels.statusWord), task->readPayload ) );
+}
+
+// Read statusword of task without TPDO updates through SDO, if requested since last read (called from the bus thread)
+void RefreshStatusWord( SignalIOTask task )
+{
+  if( !__atomic_load_n( &(task->isStatusWanted), __ATOMIC_ACQUIRE ) ) return;
+  
+  // Response is stored on the dictionary cache
+  if( __atomic_load_n( &(task->statusRead.state), __ATOMIC_ACQUIRE ) == CAN_COMMAND_PENDING ) return;
+  
+  if( CANCommands_ReadSingleValue( task->writeFramesList[ SDO ], task->readFramesList[ SDO ], 0x6041, 0x00, NULL, NULL, &(task->statusRead) ) )
+    __atomic_store_n( &(task->isStatusWanted), false, __ATOMIC_RELEASE );
+}
+
+// Get last known statusword of task (0 if none yet), without waiting: TPDO statuswords are decoded on every
+// cycle, and the others are read by the bus thread on request
+uint16_t GetStatusWord( SignalIOTask task )
+{
+  if( !__atomic_load_n( &(task->isReading), __ATOMIC_ACQUIRE ) || task->channels.statusWord.pdoType >= CAN_FRAME_TYPES_NUMBER ) 
+    __atomic_store_n( &(task->isStatusWanted), true, __ATOMIC_RELEASE );
+  
+  int32_t statusWord = 0;
+  CANDictionary_GetValue( task->nodeID, OD_STATUS_WORD, &statusWord );
+  
+  return (uint16_t) statusWord;
+}
+
 bool IsTaskStillUsed( SignalIOTask task )
 {
   bool isStillUsed = false;
   if( task->inputChannelUsesList != NULL )
   {
-    for( size_t channel = 0; channel < INPUT_CHANNELS_NUMBER; channel++ )
+    for( size_t channel = 0; channel < CAN_CHANNELS_MAX; channel++ )
     {
       if( task->inputChannelUsesList[ channel ] > 0 )
       {
@@ -378,7 +624,21 @@ SignalIOTask LoadTaskData( const char* taskConfig )
   SignalIOTask newTask = (SignalIOTask) malloc( sizeof(SignalIOTaskData) );
   memset( newTask, 0, sizeof(SignalIOTaskData) );
   
-  unsigned int nodeID = (unsigned int) strtoul( taskConfig, NULL, 0 );
+  char* configEnd;
+  unsigned int nodeID = (unsigned int) strtoul( taskConfig, &configEnd, 0 );
+  newTask->nodeID = (uint8_t) nodeID;
+  newTask->lastCycleTime = -1.0;
+  newTask->statusRead.state = CAN_COMMAND_DONE;
+  
+  // Values cached for a previous task of the node are not valid anymore
+  CANDictionary_Clear( nodeID );
+  
+  // Optional PDO mapping tokens follow node configuration, after a space
+  if( !CANChannels_Load( &(newTask->channels), strpbrk( taskConfig, " \t" ) ) )
+  {
+    DEBUG_PRINT( "invalid PDO mapping configuration: %s", taskConfig );
+    loadError = true;
+  }
   
   DEBUG_PRINT( "trying to load CAN interface for node %u", nodeID );
   
@@ -388,7 +648,7 @@ SignalIOTask LoadTaskData( const char* taskConfig )
     if( (newTask->writeFramesList[ frameType ] = CANNetwork_InitFrame( frameType, FRAME_OUT, nodeID )) == NULL ) loadError = true;
   }
   
-  for( unsigned int channel = 0; channel < INPUT_CHANNELS_NUMBER; channel++ )
+  for( unsigned int channel = 0; channel < CAN_CHANNELS_MAX; channel++ )
     newTask->inputChannelLocksList[ channel ] = Semaphores.Create( 0, SIGNAL_INPUT_CHANNEL_MAX_USES );
   
   newTask->isOutputChannelUsed = false;
@@ -399,6 +659,17 @@ SignalIOTask LoadTaskData( const char* taskConfig )
     return NULL;
   }
   
+  // Optional rate divisors (from "<node>:<node divisor>:<PDO01 divisor>:<PDO02 divisor>" configuration), 
+  // applied to both RPDOs (written on their scheduled cycles) and TPDOs (by their transmission type and start value)
+  CANChannels_LoadSchedule( configEnd, newTask->pdoDivisorsList, newTask->pdoPhasesList );
+  for( size_t pdoType = PDO01; pdoType < CAN_FRAME_TYPES_NUMBER; pdoType++ )
+  {
+    if( newTask->pdoDivisorsList[ pdoType ] > 1 ) 
+      CANChannels_WriteSchedule( pdoType, newTask->pdoDivisorsList[ pdoType ], newTask->pdoPhasesList[ pdoType ], newTask->writeFramesList[ SDO ], newTask->readFramesList[ SDO ], nodeID );
+  }
+  
+  CANChannels_WriteMapping( &(newTask->channels), newTask->writeFramesList[ SDO ], newTask->readFramesList[ SDO ], nodeID );
+  
   return newTask;
 }
 
@@ -408,13 +679,7 @@ void UnloadTaskData( SignalIOTask task )
   
   DEBUG_PRINT( "ending task %p", task );
   
-  if( task->isReading )
-  {
-    task->isReading = false;
-    Threading.WaitExit( task->threadID, 5000 );
-  }
-  
-  for( unsigned int channel = 0; channel < INPUT_CHANNELS_NUMBER; channel++ )
+  for( unsigned int channel = 0; channel < CAN_CHANNELS_MAX; channel++ )
     Semaphores.Discard( task->inputChannelLocksList[ channel ] );
   
   for( size_t frameID = 0; frameID < CAN_FRAME_TYPES_NUMBER; frameID++ )
@@ -423,5 +688,8 @@ void UnloadTaskData( SignalIOTask task )
     CANNetwork_EndFrame( task->writeFramesList[ frameID ] );
   }
   
+  for( size_t pdoType = PDO01; pdoType < CAN_FRAME_TYPES_NUMBER; pdoType++ )
+    CANNetwork_RemoveScheduledFrame( task->pdoDivisorsList[ pdoType ], task->pdoPhasesList[ pdoType ] );
+  
   free( task );
 }
@@ -0,0 +1,69 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>       //
+//                                                                            //
+//  This file is part of Signal-IO-NIXNET.                                    //
+//                                                                            //
+//  Signal-IO-NIXNETs free software: you can redistribute it and/or modify    //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,       //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.  //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Runtime statistics returned by GetStatistics (per task) and GetBusStatistics (per CAN bus)
+// plug-in functions, so that the host may show and log them without linking to plug-in internals
+
+#ifndef SIGNAL_IO_STATISTICS_H
+#define SIGNAL_IO_STATISTICS_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+// New fields only go at the end: plug-ins fill the ones covered by the caller size, so that hosts
+// and plug-ins built against different versions of this header keep working together
+typedef struct _SignalIOStatistics
+{
+  size_t size;                                              // Set by the caller to sizeof(SignalIOStatistics)
+  unsigned long cyclesCount;                                // Network cycles (bus) or measures updates (task)
+  unsigned long overrunsCount;                              // Cycles longer than expected period
+  double minCycleTime, averageCycleTime, maxCycleTime;      // In seconds
+  unsigned long framesReceivedCount, framesSentCount;
+  unsigned long errorsCount;                                // Driver frame errors and failed SDO transfers
+  unsigned long staleSamplesCount;                          // Measures updates without new TPDO data
+  unsigned long sdoTransfersCount;                          // Answered (completed or aborted) SDO requests
+  double minSDOLatency, averageSDOLatency, maxSDOLatency;   // In seconds
+  unsigned long responsesCount;                             // TPDOs received in answer to SYNC
+  double minResponseTime, averageResponseTime, maxResponseTime;   // From SYNC transmission to TPDO reception, in seconds
+}
+SignalIOStatistics;
+
+// Statistics structure ready to be passed to GetStatistics or GetBusStatistics
+#define SIGNAL_IO_STATISTICS_INIT { .size = sizeof(SignalIOStatistics) }
+
+// Copy statistics gathered by the plug-in to the caller structure, up to its size (fields the plug-in doesn't know
+// are left untouched), failing if the caller didn't set it
+static inline bool SignalIOStatistics_Copy( const SignalIOStatistics* statistics, SignalIOStatistics* ref_statistics )
+{
+  const size_t FIELDS_OFFSET = offsetof( SignalIOStatistics, cyclesCount );
+  
+  size_t size = ref_statistics->size;
+  if( size <= FIELDS_OFFSET ) return false;
+  if( size > sizeof(SignalIOStatistics) ) size = sizeof(SignalIOStatistics);
+  
+  memcpy( (char*) ref_statistics + FIELDS_OFFSET, (const char*) statistics + FIELDS_OFFSET, size - FIELDS_OFFSET );
+  
+  return true;
+}
+
+#endif // SIGNAL_IO_STATISTICS_H
@@ -0,0 +1,92 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                      //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>                 //
+//                                                                                      //
+//  This file is part of Signal-IO-NIXNET.                                              //
+//                                                                                      //
+//  Signal-IO-NIXNET is free software: you can redistribute it and/or modify            //
+//  it under the terms of the GNU Lesser General Public License as published            //
+//  by the Free Software Foundation, either version 3 of the License, or                //
+//  (at your option) any later version.                                                 //
+//                                                                                      //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,                 //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of                      //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                        //
+//  GNU Lesser General Public License for more details.                                 //
+//                                                                                      //
+//  You should have received a copy of the GNU Lesser General Public License            //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.            //
+//                                                                                      //
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef STARTUP_PROFILE_H
+#define STARTUP_PROFILE_H
+
+#include "timing/timing.h"
+
+#include "debug/data_logging.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#define STARTUP_PROFILE_NODES_NUMBER 128 // Node 0 accounts for network wide operations
+
+enum StartupPhase { STARTUP_SESSIONS, STARTUP_NETWORK_RESET, STARTUP_SDO_CONFIGURATION, STARTUP_OUTPUT_ENABLE, STARTUP_PHASES_NUMBER };
+
+const char* STARTUP_PHASE_NAMES[ STARTUP_PHASES_NUMBER ] = { "sessions", "network reset", "SDO configuration", "output enable" };
+
+// Accumulated time (in seconds) spent on each startup phase, per node
+static double startupTimesList[ STARTUP_PHASES_NUMBER ][ STARTUP_PROFILE_NODES_NUMBER ];
+static double startupBeginTime = -1.0;
+
+void StartupProfile_Print();
+
+// Get phase start time (first call also marks startup begin)
+double StartupProfile_GetTime()
+{
+  double currentTime = Time_GetExecSeconds();
+  
+  if( startupBeginTime < 0.0 )
+  {
+    startupBeginTime = currentTime;
+    if( getenv( "STARTUP_PROFILE_REPORT" ) != NULL ) atexit( StartupProfile_Print );
+  }
+  
+  return currentTime;
+}
+
+void StartupProfile_Add( enum StartupPhase phase, unsigned int nodeID, double phaseStartTime )
+{
+  if( phase >= STARTUP_PHASES_NUMBER || nodeID >= STARTUP_PROFILE_NODES_NUMBER ) return;
+  
+  startupTimesList[ phase ][ nodeID ] += Time_GetExecSeconds() - phaseStartTime;
+}
+
+// Report per phase and per node startup times
+void StartupProfile_Print()
+{
+  double phaseTotalsList[ STARTUP_PHASES_NUMBER ] = { 0.0 };
+  
+  DEBUG_PRINT( "startup profile (%.3f s since first session):", Time_GetExecSeconds() - startupBeginTime );
+  
+  for( unsigned int nodeID = 0; nodeID < STARTUP_PROFILE_NODES_NUMBER; nodeID++ )
+  {
+    bool hasNodeTimes = false;
+    for( int phase = 0; phase < STARTUP_PHASES_NUMBER; phase++ )
+    {
+      phaseTotalsList[ phase ] += startupTimesList[ phase ][ nodeID ];
+      if( startupTimesList[ phase ][ nodeID ] > 0.0 ) hasNodeTimes = true;
+    }
+    
+    if( hasNodeTimes )
+      DEBUG_PRINT( "  node %3u: sessions %.6f s - network reset %.6f s - SDO configuration %.6f s - output enable %.6f s", nodeID,
+                   startupTimesList[ STARTUP_SESSIONS ][ nodeID ], startupTimesList[ STARTUP_NETWORK_RESET ][ nodeID ],
+                   startupTimesList[ STARTUP_SDO_CONFIGURATION ][ nodeID ], startupTimesList[ STARTUP_OUTPUT_ENABLE ][ nodeID ] );
+  }
+  
+  for( int phase = 0; phase < STARTUP_PHASES_NUMBER; phase++ )
+    DEBUG_PRINT( "  total %s: %.6f s", STARTUP_PHASE_NAMES[ phase ], phaseTotalsList[ phase ] );
+}
+
+#endif  /* STARTUP_PROFILE_H */
@@ -0,0 +1,76 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>       //
+//                                                                            //
+//  This file is part of Signal-IO-NIXNET.                                    //
+//                                                                            //
+//  Signal-IO-NIXNETs free software: you can redistribute it and/or modify    //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,       //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.  //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Steady state allocations test: network cycles with setpoints, measures and SDO transfers on simulated
+// drives must not use the heap. Built with ALLOCATION_TRACKING (wrapped allocation functions) in strict mode,
+// so that the first cycle phase allocation aborts the test
+
+#include "ni_can_epos.c"
+
+#include "benchmark_stub.h"
+
+#ifndef ALLOCATION_TRACKING
+  #error "allocations test requires ALLOCATION_TRACKING build (alloc_tracking.c and wrapped allocation functions)"
+#endif
+
+#define NODES_NUMBER 4
+#define CYCLES_NUMBER 1000
+#define SDO_CYCLES_INTERVAL 50
+#define OUTPUT_CHANNEL 0
+
+int main( int argc, char** argv )
+{
+  AllocTracking_SetStrict( true );
+  
+  unsigned long period = BenchmarkStub_GetCyclePeriod( NODES_NUMBER );
+  
+  if( !BenchmarkStub_InitNodes( NODES_NUMBER, NULL, OUTPUT_CHANNEL ) ) return EXIT_FAILURE;
+  if( BenchmarkStub_EnableNodes( NODES_NUMBER, OUTPUT_CHANNEL, period ) < 0.0 ) return EXIT_FAILURE;
+  
+  size_t initialAllocationsCount = AllocTracking_GetAllocationsCount( ALLOCATION_PHASE_CYCLE );
+  
+  size_t sdoReadsCount = 0;
+  for( unsigned long cycleIndex = 0; cycleIndex < CYCLES_NUMBER; cycleIndex++ )
+  {
+    BenchmarkStub_RunCycle( NODES_NUMBER, OUTPUT_CHANNEL, (double) cycleIndex, period );
+    
+    size_t nodeID = 1 + cycleIndex % NODES_NUMBER;
+    if( HasError( benchmarkTasksList[ nodeID ] ) ) Reset( benchmarkTasksList[ nodeID ] );
+    
+    // SDO transfers (statusword read and controlword writes) going through the commands queue
+    if( cycleIndex % SDO_CYCLES_INTERVAL == 0 )
+    {
+      SignalIOTask task = kh_value( tasksList, kh_get( TaskInt, tasksList, (khint_t) benchmarkTasksList[ nodeID ] ) );
+      CANCommandFuture statusRead;
+      CANCommands_ReadSingleValue( task->writeFramesList[ SDO ], task->readFramesList[ SDO ], 0x6041, 0x00, NULL, NULL, &statusRead );
+      if( CANCommands_Wait( &statusRead, 1000 ) ) sdoReadsCount++;
+      Reset( benchmarkTasksList[ nodeID ] );
+    }
+  }
+  
+  size_t allocationsCount = AllocTracking_GetAllocationsCount( ALLOCATION_PHASE_CYCLE ) - initialAllocationsCount;
+  printf( "%u cycles on %u nodes: %zu SDO reads, %zu cycle phase allocations\n", CYCLES_NUMBER, NODES_NUMBER, sdoReadsCount, allocationsCount );
+  
+  BenchmarkStub_EndNodes( NODES_NUMBER );
+  
+  return ( allocationsCount == 0 && sdoReadsCount == CYCLES_NUMBER / SDO_CYCLES_INTERVAL ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
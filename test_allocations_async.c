@@ -0,0 +1,115 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>       //
+//                                                                            //
+//  This file is part of Signal-IO-NIXNET.                                    //
+//                                                                            //
+//  Signal-IO-NIXNETs free software: you can redistribute it and/or modify    //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,       //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.  //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Steady state allocations test of the asynchronous plug-in: the bus thread cycles (SYNC, queued SDO transfers,
+// PDOs exchange and statusword refreshes) and the host calls feeding it must not use the heap. Built with
+// ALLOCATION_TRACKING in strict mode, against simulated drives of the NI-XNET stub on real time (the bus and
+// host threads can't share the virtual clock), so that the first cycle phase allocation of any thread aborts the test
+
+#include "signal_io_async.c"
+
+#ifndef ALLOCATION_TRACKING
+  #error "allocations test requires ALLOCATION_TRACKING build (alloc_tracking.c and wrapped allocation functions)"
+#endif
+
+#define NODES_NUMBER 4
+#define CYCLES_NUMBER 1000
+#define SDO_CYCLES_INTERVAL 50
+#define CYCLE_DELAY "3"               // Milliseconds: 4 PDOs per node and SYNC take about 2.2 ms at 1 Mbit/s, and SDO responses lose arbitration on a full bus
+#define CONFIGURATION_TIMEOUT 5.0     // Seconds for queued commands of all nodes to be done
+#define INPUT_CHANNEL 0
+#define OUTPUT_CHANNEL 0
+
+static int tasksIDsList[ NODES_NUMBER + 1 ];
+
+static bool InitNodes()
+{
+  char taskConfig[ 16 ];
+  for( size_t nodeID = 1; nodeID <= NODES_NUMBER; nodeID++ )
+  {
+    snprintf( taskConfig, sizeof(taskConfig), "%u", (unsigned int) nodeID );
+    if( (tasksIDsList[ nodeID ] = InitTask( taskConfig )) == -1 ) return false;
+    if( !AcquireOuputChannel( tasksIDsList[ nodeID ], OUTPUT_CHANNEL ) ) return false;
+    if( !AcquireInputChannel( tasksIDsList[ nodeID ], INPUT_CHANNEL ) ) return false;
+    EnableOutput( tasksIDsList[ nodeID ], true );
+  }
+  
+  // Wait for configuration and enabling commands to go through the bus thread
+  double startTime = Time_GetExecSeconds();
+  while( !CANCommands_IsEmpty() )
+  {
+    if( Time_GetExecSeconds() - startTime > CONFIGURATION_TIMEOUT ) return false;
+    Time_Delay( 1 );
+  }
+  
+  return true;
+}
+
+int main( int argc, char** argv )
+{
+  AllocTracking_SetStrict( true );
+  
+  setenv( "NIXNET_CYCLE_DELAY", CYCLE_DELAY, 1 );
+  
+  if( !InitNodes() ) return EXIT_FAILURE;
+  
+  size_t initialAllocationsCount = AllocTracking_GetAllocationsCount( ALLOCATION_PHASE_CYCLE );
+  unsigned long initialCyclesCount = __atomic_load_n( &busCyclesCount, __ATOMIC_SEQ_CST );
+  
+  size_t sdoReadsCount = 0;
+  for( unsigned long cycleIndex = 0; cycleIndex < CYCLES_NUMBER; cycleIndex++ )
+  {
+    // Setpoints go out on next bus cycle, and reads block until its measures are updated
+    double measure;
+    for( size_t nodeID = 1; nodeID <= NODES_NUMBER; nodeID++ )
+      Write( tasksIDsList[ nodeID ], OUTPUT_CHANNEL, (double) cycleIndex );
+    for( size_t nodeID = 1; nodeID <= NODES_NUMBER; nodeID++ )
+      Read( tasksIDsList[ nodeID ], INPUT_CHANNEL, &measure );
+    
+    size_t nodeID = 1 + cycleIndex % NODES_NUMBER;
+    if( HasError( tasksIDsList[ nodeID ] ) ) Reset( tasksIDsList[ nodeID ] );
+    
+    // SDO transfers (statusword read and controlword writes) queued from the host thread for the bus one
+    if( cycleIndex % SDO_CYCLES_INTERVAL == 0 )
+    {
+      SignalIOTask task = kh_value( tasksList, kh_get( TaskInt, tasksList, (khint_t) tasksIDsList[ nodeID ] ) );
+      CANCommandFuture statusRead;
+      CANCommands_ReadSingleValue( task->writeFramesList[ SDO ], task->readFramesList[ SDO ], 0x6041, 0x00, NULL, NULL, &statusRead );
+      if( CANCommands_Wait( &statusRead, 1000 ) ) sdoReadsCount++;
+      Reset( tasksIDsList[ nodeID ] );
+    }
+  }
+  
+  size_t allocationsCount = AllocTracking_GetAllocationsCount( ALLOCATION_PHASE_CYCLE ) - initialAllocationsCount;
+  unsigned long busCyclesNumber = __atomic_load_n( &busCyclesCount, __ATOMIC_SEQ_CST ) - initialCyclesCount;
+  
+  for( size_t nodeID = 1; nodeID <= NODES_NUMBER; nodeID++ )
+  {
+    ReleaseInputChannel( tasksIDsList[ nodeID ], INPUT_CHANNEL );
+    ReleaseOutputChannel( tasksIDsList[ nodeID ], OUTPUT_CHANNEL );
+  }
+  
+  printf( "%u host cycles (%lu bus cycles) on %u nodes: %zu SDO reads, %zu cycle phase allocations\n", CYCLES_NUMBER, busCyclesNumber, 
+          NODES_NUMBER, sdoReadsCount, allocationsCount );
+  
+  return ( allocationsCount == 0 && sdoReadsCount == CYCLES_NUMBER / SDO_CYCLES_INTERVAL ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
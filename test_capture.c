@@ -0,0 +1,175 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>       //
+//                                                                            //
+//  This file is part of Signal-IO-NIXNET.                                    //
+//                                                                            //
+//  Signal-IO-NIXNETs free software: you can redistribute it and/or modify    //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,       //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.  //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Capture codec round trip test: blocks of cyclic (compressible) frames, random (stored raw) frames and
+// empty data go through the LZ coder and the block decoder, and a whole capture written by the writer
+// thread is read back through its index
+
+#include "can_capture.h"
+
+#define RECORDS_NUMBER 1000
+#define FILE_RECORDS_NUMBER ( 3 * CAN_CAPTURE_BLOCK_RECORDS + RECORDS_NUMBER )    // Last block is written on capture stop
+#define CAPTURE_FILE_PATH "test_capture.bin"
+
+static CANCaptureRecord recordsList[ FILE_RECORDS_NUMBER ];
+static CANCaptureRecord decodedRecordsList[ CAN_CAPTURE_BLOCK_RECORDS ];
+static uint8_t decompressedBlock[ CAN_CAPTURE_BLOCK_SIZE_MAX ];
+
+// SYNC followed by RPDO and TPDO frames of 4 nodes, with slowly changing payloads
+static void FillCyclicRecords( size_t recordsNumber )
+{
+  for( size_t recordIndex = 0; recordIndex < recordsNumber; recordIndex++ )
+  {
+    CANCaptureRecord* record = &(recordsList[ recordIndex ]);
+    size_t frameIndex = recordIndex % 9;
+    record->time = 130000000000000000ULL + recordIndex * 1000 + frameIndex * 10;
+    record->identifier = ( frameIndex == 0 ) ? 0x080 : ( ( frameIndex % 2 == 1 ) ? 0x200 : 0x180 ) + ( frameIndex + 1 ) / 2;
+    record->direction = ( frameIndex % 2 == 1 || frameIndex == 0 ) ? CAPTURE_TX : CAPTURE_RX;
+    record->length = ( frameIndex == 0 ) ? 0 : 8;
+    memset( record->payload, 0, sizeof(record->payload) );
+    for( size_t byteIndex = 0; byteIndex < record->length; byteIndex++ ) record->payload[ byteIndex ] = (uint8_t) ( ( recordIndex / 90 ) >> byteIndex );
+  }
+}
+
+// Random identifiers, lengths, payloads and time steps (including backwards ones), that don't compress
+static void FillRandomRecords( size_t recordsNumber )
+{
+  uint64_t time = 1000;
+  for( size_t recordIndex = 0; recordIndex < recordsNumber; recordIndex++ )
+  {
+    CANCaptureRecord* record = &(recordsList[ recordIndex ]);
+    time += (uint64_t) ( rand() % 2000000 ) - 1000;
+    record->time = time;
+    record->identifier = (uint32_t) ( rand() % 0x800 );
+    record->direction = (uint8_t) ( rand() % 2 );
+    record->length = (uint8_t) ( rand() % 9 );
+    for( size_t byteIndex = 0; byteIndex < record->length; byteIndex++ ) record->payload[ byteIndex ] = (uint8_t) rand();
+  }
+}
+
+static bool CompareRecords( const CANCaptureRecord* record, const CANCaptureRecord* decodedRecord )
+{
+  return ( record->time == decodedRecord->time && record->identifier == decodedRecord->identifier && record->direction == decodedRecord->direction
+           && record->length == decodedRecord->length && memcmp( record->payload, decodedRecord->payload, record->length ) == 0 );
+}
+
+// Encode records into a block, store it as the writer thread does and decode it back
+static bool TestBlock( const char* name, size_t recordsNumber, bool isCompressible )
+{
+  captureBlockHeader.recordsNumber = 0;
+  captureBlockHeader.rawSize = 0;
+  captureBlockHeader.firstTime = captureBlockHeader.lastTime = 0;
+  for( size_t recordIndex = 0; recordIndex < recordsNumber; recordIndex++ )
+    EncodeCaptureRecord( &(recordsList[ recordIndex ]) );
+
+  size_t storedSize = CANCapture_Compress( captureRawBlock, captureBlockHeader.rawSize, captureStoredBlock, sizeof(captureStoredBlock) );
+  // Blocks that don't compress are stored raw
+  const uint8_t* rawData = captureRawBlock;
+  if( storedSize > 0 )
+  {
+    memset( decompressedBlock, 0xAA, sizeof(decompressedBlock) );
+    if( !CANCapture_Decompress( captureStoredBlock, storedSize, decompressedBlock, captureBlockHeader.rawSize ) )
+    {
+      printf( "%s block: decompression failed\n", name );
+      return false;
+    }
+    rawData = decompressedBlock;
+  }
+
+  size_t decodedRecordsNumber = CANCapture_DecodeBlock( &captureBlockHeader, rawData, decodedRecordsList, CAN_CAPTURE_BLOCK_RECORDS );
+
+  size_t mismatchesNumber = ( decodedRecordsNumber == recordsNumber ) ? 0 : 1;
+  for( size_t recordIndex = 0; recordIndex < decodedRecordsNumber && recordIndex < recordsNumber; recordIndex++ )
+  {
+    if( !CompareRecords( &(recordsList[ recordIndex ]), &(decodedRecordsList[ recordIndex ]) ) ) mismatchesNumber++;
+  }
+
+  printf( "%s block: %zu records, %u raw bytes, %zu stored bytes, %zu decoded, %zu mismatches\n", name, recordsNumber,
+          captureBlockHeader.rawSize, ( storedSize > 0 ) ? storedSize : captureBlockHeader.rawSize, decodedRecordsNumber, mismatchesNumber );
+
+  return ( mismatchesNumber == 0 && ( storedSize > 0 ) == isCompressible );
+}
+
+// Append records to a capture file through the ring and writer thread, then read all its blocks through the index
+static bool TestFile( size_t recordsNumber )
+{
+  FillCyclicRecords( recordsNumber );
+
+  if( !CANCapture_Start( CAPTURE_FILE_PATH ) ) return false;
+  for( size_t recordIndex = 0; recordIndex < recordsNumber; recordIndex++ )
+  {
+    CANCaptureRecord* record = &(recordsList[ recordIndex ]);
+    CANCapture_Append( record->time, record->identifier, record->direction, record->payload, record->length );
+  }
+  CANCapture_Stop();
+
+  CANCaptureIndex index = CANCaptureIndex_Load( CAPTURE_FILE_PATH );
+  FILE* captureFile = fopen( CAPTURE_FILE_PATH, "rb" );
+  if( index == NULL || captureFile == NULL ) return false;
+
+  size_t decodedRecordsNumber = 0, mismatchesNumber = 0;
+  for( size_t entryIndex = 0; entryIndex < index->entriesNumber; entryIndex++ )
+  {
+    size_t blockRecordsNumber = CANCapture_ReadBlock( captureFile, &(index->entriesList[ entryIndex ]), decodedRecordsList, CAN_CAPTURE_BLOCK_RECORDS );
+    for( size_t recordIndex = 0; recordIndex < blockRecordsNumber && decodedRecordsNumber < recordsNumber; recordIndex++, decodedRecordsNumber++ )
+    {
+      if( !CompareRecords( &(recordsList[ decodedRecordsNumber ]), &(decodedRecordsList[ recordIndex ]) ) ) mismatchesNumber++;
+    }
+  }
+
+  // Node 1 frames are on every block
+  bool isNodeIndexed = ( CANCaptureIndex_FindNodeTime( index, 1, recordsList[ recordsNumber - 1 ].time ) == index->entriesNumber - 1 );
+
+  printf( "capture file: %zu records appended, %zu blocks, %zu read back, %zu mismatches, %zu dropped\n", recordsNumber,
+          index->entriesNumber, decodedRecordsNumber, mismatchesNumber, CANCapture_GetDroppedCount() );
+
+  fclose( captureFile );
+  CANCaptureIndex_Discard( index );
+  remove( CAPTURE_FILE_PATH );
+  remove( CAPTURE_FILE_PATH CAN_CAPTURE_INDEX_EXTENSION );
+
+  return ( decodedRecordsNumber == recordsNumber && mismatchesNumber == 0 && isNodeIndexed );
+}
+
+int main( int argc, char** argv )
+{
+  bool isSuccess = true;
+
+  srand( 1 );
+
+  // Full blocks are written to file as soon as their last record is encoded
+  FillCyclicRecords( CAN_CAPTURE_BLOCK_RECORDS - 1 );
+  isSuccess &= TestBlock( "cyclic", CAN_CAPTURE_BLOCK_RECORDS - 1, true );
+
+  FillRandomRecords( RECORDS_NUMBER );
+  isSuccess &= TestBlock( "random", RECORDS_NUMBER, false );
+
+  isSuccess &= TestBlock( "empty", 0, false );
+
+  // Single record blocks are too short to compress
+  FillCyclicRecords( 1 );
+  isSuccess &= TestBlock( "single", 1, false );
+
+  isSuccess &= TestFile( FILE_RECORDS_NUMBER );
+
+  return isSuccess ? EXIT_SUCCESS : EXIT_FAILURE;
+}
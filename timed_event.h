@@ -0,0 +1,128 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2016-2017 Leonardo Consoni <consoni_2519@hotmail.com>       //
+//                                                                            //
+//  This file is part of Signal-IO-NIXNET.                                    //
+//                                                                            //
+//  Signal-IO-NIXNETs free software: you can redistribute it and/or modify    //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-NIXNET is distributed in the hope that it will be useful,       //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-NIXNET. If not, see <http://www.gnu.org/licenses/>.  //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Event with timed wait, signaled from the network cycle (e.g. statusword edges) to a waiting thread. 
+// Auto reset: a successful wait consumes the signal. Win32 events or POSIX condition variables 
+// (on the monotonic clock), as the threading library has no timed waits
+
+#ifndef TIMED_EVENT_H
+#define TIMED_EVENT_H
+
+#include <stdbool.h>
+
+#ifdef _WIN32
+  #include <windows.h>
+  typedef HANDLE TimedEvent;
+#else
+  #include <pthread.h>
+  #include <time.h>
+  #include <errno.h>
+  typedef struct _TimedEvent
+  {
+    pthread_mutex_t lock;
+    pthread_cond_t condition;
+    bool isSet;
+  }
+  TimedEvent;
+#endif
+
+bool TimedEvent_Init( TimedEvent* event )
+{
+#ifdef _WIN32
+  *event = CreateEvent( NULL, FALSE, FALSE, NULL );
+  return ( *event != NULL );
+#else
+  pthread_condattr_t conditionAttributes;
+  pthread_condattr_init( &conditionAttributes );
+  pthread_condattr_setclock( &conditionAttributes, CLOCK_MONOTONIC );
+  
+  event->isSet = false;
+  bool isInitialized = ( pthread_mutex_init( &(event->lock), NULL ) == 0 && pthread_cond_init( &(event->condition), &conditionAttributes ) == 0 );
+  pthread_condattr_destroy( &conditionAttributes );
+  
+  return isInitialized;
+#endif
+}
+
+void TimedEvent_Discard( TimedEvent* event )
+{
+#ifdef _WIN32
+  if( *event != NULL ) CloseHandle( *event );
+#else
+  pthread_cond_destroy( &(event->condition) );
+  pthread_mutex_destroy( &(event->lock) );
+#endif
+}
+
+void TimedEvent_Signal( TimedEvent* event )
+{
+#ifdef _WIN32
+  SetEvent( *event );
+#else
+  pthread_mutex_lock( &(event->lock) );
+  event->isSet = true;
+  pthread_cond_signal( &(event->condition) );
+  pthread_mutex_unlock( &(event->lock) );
+#endif
+}
+
+// Drop signal not waited for
+void TimedEvent_Reset( TimedEvent* event )
+{
+#ifdef _WIN32
+  ResetEvent( *event );
+#else
+  pthread_mutex_lock( &(event->lock) );
+  event->isSet = false;
+  pthread_mutex_unlock( &(event->lock) );
+#endif
+}
+
+// Block until event is signaled or timeout (in milliseconds) expires. Returns false on timeout
+bool TimedEvent_Wait( TimedEvent* event, unsigned long timeout )
+{
+#ifdef _WIN32
+  return ( WaitForSingleObject( *event, (DWORD) timeout ) == WAIT_OBJECT_0 );
+#else
+  struct timespec deadline;
+  clock_gettime( CLOCK_MONOTONIC, &deadline );
+  deadline.tv_sec += (time_t) ( timeout / 1000 );
+  deadline.tv_nsec += (long) ( timeout % 1000 ) * 1000000L;
+  if( deadline.tv_nsec >= 1000000000L )
+  {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  
+  pthread_mutex_lock( &(event->lock) );
+  int waitResult = 0;
+  while( !event->isSet && waitResult != ETIMEDOUT )
+    waitResult = pthread_cond_timedwait( &(event->condition), &(event->lock), &deadline );
+  bool isSignaled = event->isSet;
+  event->isSet = false;
+  pthread_mutex_unlock( &(event->lock) );
+  
+  return isSignaled;
+#endif
+}
+
+#endif // TIMED_EVENT_H
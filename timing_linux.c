@@ -0,0 +1,123 @@
+///////////////////////////////////////////////////////////////////////////////
+///// Wrapper library for time measurement and thread sleeping (blocking) /////
+///// using POSIX monotonic clock and absolute deadline sleeps, with       /////
+///// optional TSC timestamps (Linux High Resolution Version)             /////
+///////////////////////////////////////////////////////////////////////////////
+
+#define _GNU_SOURCE
+
+#include "timing/timing.h"
+
+#include "timing_linux.h"
+
+#include <time.h>
+#include <errno.h>
+
+#if defined( TIMING_TSC ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+  #include <x86intrin.h>
+  #include <cpuid.h>
+  #define TIMING_HAS_TSC
+#endif
+
+#define TIMING_TSC_CALIBRATION_TIME 10000000ULL    // Nanoseconds of TSC ticks counting against the system clock
+
+static uint64_t startTime = 0;       // CLOCK_MONOTONIC value at module load, in nanoseconds
+
+#ifdef TIMING_HAS_TSC
+static bool isUsingTSC = false;
+static uint64_t tscStartTicks = 0;
+static uint64_t tscScale = 0;        // Nanoseconds per tick (32.32 fixed point)
+#endif
+
+static inline uint64_t GetClockNanoseconds( void )
+{
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+
+  return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+#ifdef TIMING_HAS_TSC
+// Use TSC only if it ticks at constant rate and never stops (invariant TSC), so that it may follow the system clock
+static void CalibrateTSC( void )
+{
+  unsigned int eax, ebx, ecx, edx;
+  if( __get_cpuid( 0x80000007, &eax, &ebx, &ecx, &edx ) == 0 || !( edx & ( 1 << 8 ) ) ) return;
+
+  uint64_t clockStartTime = GetClockNanoseconds();
+  uint64_t ticksStart = __rdtsc();
+  TimeLinux_SleepUntil( clockStartTime - startTime + TIMING_TSC_CALIBRATION_TIME );
+  uint64_t clockEndTime = GetClockNanoseconds();
+  uint64_t ticksEnd = __rdtsc();
+
+  if( ticksEnd <= ticksStart ) return;
+
+  tscScale = ( ( clockEndTime - clockStartTime ) << 32 ) / ( ticksEnd - ticksStart );
+  tscStartTicks = ticksEnd - (uint64_t) ( ( (unsigned __int128) ( clockEndTime - startTime ) << 32 ) / tscScale );
+  isUsingTSC = true;
+}
+#endif
+
+__attribute__((constructor)) static void InitializeTiming( void )
+{
+  startTime = GetClockNanoseconds();
+
+  #ifdef TIMING_HAS_TSC
+  CalibrateTSC();
+  #endif
+}
+
+uint64_t TimeLinux_GetNanoseconds( void )
+{
+  return GetClockNanoseconds() - startTime;
+}
+
+uint64_t TimeLinux_GetTimestamp( void )
+{
+  #ifdef TIMING_HAS_TSC
+  if( isUsingTSC ) return (uint64_t) ( ( (unsigned __int128) ( __rdtsc() - tscStartTicks ) * tscScale ) >> 32 );
+  #endif
+
+  return TimeLinux_GetNanoseconds();
+}
+
+bool TimeLinux_IsUsingTSC( void )
+{
+  #ifdef TIMING_HAS_TSC
+  return isUsingTSC;
+  #else
+  return false;
+  #endif
+}
+
+void TimeLinux_SleepUntil( uint64_t deadline )
+{
+  deadline += startTime;
+  struct timespec deadlineTime = { .tv_sec = (time_t) ( deadline / 1000000000ULL ), .tv_nsec = (long) ( deadline % 1000000000ULL ) };
+
+  // Absolute deadlines are not extended when interrupted by signals
+  while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &deadlineTime, NULL ) == EINTR );
+}
+
+void TimeLinux_Sleep( uint64_t nanoseconds )
+{
+  TimeLinux_SleepUntil( TimeLinux_GetNanoseconds() + nanoseconds );
+}
+
+// Make the calling thread wait for the given time ( in milliseconds )
+void Time_Delay( unsigned long milliseconds )
+{
+  TimeLinux_Sleep( 1000000ULL * milliseconds );
+}
+
+// Get system time in milliseconds
+unsigned long Time_GetExecMilliseconds()
+{
+  return (unsigned long) ( TimeLinux_GetTimestamp() / 1000000 );
+}
+
+// Get system time in seconds
+double Time_GetExecSeconds()
+{
+  return ( (double) TimeLinux_GetTimestamp() ) / 1000000000.0;
+}
@@ -0,0 +1,28 @@
+///////////////////////////////////////////////////////////////////////////////
+///// High resolution extensions of the Linux implementation of the       /////
+///// timing module: nanosecond monotonic time, absolute deadline sleeps  /////
+///// and (optionally) calibrated TSC timestamps                          /////
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef TIMING_LINUX_H
+#define TIMING_LINUX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Get monotonic time (since module load) in nanoseconds
+uint64_t TimeLinux_GetNanoseconds( void );
+
+// Get monotonic time in nanoseconds from the calibrated TSC when available (cheaper, for frequent timestamps)
+uint64_t TimeLinux_GetTimestamp( void );
+
+// Check if TimeLinux_GetTimestamp reads the TSC instead of the system clock
+bool TimeLinux_IsUsingTSC( void );
+
+// Make the calling thread wait until the given monotonic time (in nanoseconds, same base as TimeLinux_GetNanoseconds)
+void TimeLinux_SleepUntil( uint64_t deadline );
+
+// Make the calling thread wait for the given time ( in nanoseconds )
+void TimeLinux_Sleep( uint64_t nanoseconds );
+
+#endif // TIMING_LINUX_H
@@ -0,0 +1,87 @@
+///////////////////////////////////////////////////////////////////////////////
+///// Wrapper library for time measurement and thread sleeping (blocking) ///// 
+///// using a simulated clock (Virtual Time Version): delays only advance /////
+///// the clock, so simulations run as fast as the CPU allows             /////
+///////////////////////////////////////////////////////////////////////////////
+
+// Single threaded clock: a delay is not a wait for the other threads, which keep running meanwhile, so
+// time can only be advanced (delays, stub driver calls and input waits) by the thread that first did it.
+// Other threads may read it (e.g. metrics exporter), but advancing it from them aborts the simulation,
+// as deadlines shared between threads (e.g. an asynchronous bus thread) would not hold
+
+#include "timing/timing.h"
+
+#include "timing_virtual.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+static uint64_t virtualTime = 0;
+
+static pthread_t clockThread;
+static bool hasClockThread = false;
+static pthread_mutex_t clockThreadLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Take clock ownership on first advance and reject advances from any other thread
+static void CheckClockThread( void )
+{
+  if( !__atomic_load_n( &hasClockThread, __ATOMIC_ACQUIRE ) )
+  {
+    pthread_mutex_lock( &clockThreadLock );
+    if( !hasClockThread )
+    {
+      clockThread = pthread_self();
+      __atomic_store_n( &hasClockThread, true, __ATOMIC_RELEASE );
+    }
+    pthread_mutex_unlock( &clockThreadLock );
+  }
+  
+  if( !pthread_equal( clockThread, pthread_self() ) )
+  {
+    fprintf( stderr, "virtual time advanced from a second thread: simulated clock supports a single timing thread\n" );
+    abort();
+  }
+}
+
+uint64_t TimeVirtual_GetNanoseconds( void )
+{
+  return __atomic_load_n( &virtualTime, __ATOMIC_ACQUIRE );
+}
+
+void TimeVirtual_Advance( uint64_t nanoseconds )
+{
+  CheckClockThread();
+  
+  __atomic_add_fetch( &virtualTime, nanoseconds, __ATOMIC_ACQ_REL );
+}
+
+void TimeVirtual_AdvanceTo( uint64_t nanoseconds )
+{
+  CheckClockThread();
+  
+  uint64_t currentTime = __atomic_load_n( &virtualTime, __ATOMIC_ACQUIRE );
+  while( currentTime < nanoseconds )
+  {
+    if( __atomic_compare_exchange_n( &virtualTime, &currentTime, nanoseconds, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) ) break;
+  }
+}
+
+// Make the calling thread "wait" for the given time ( in milliseconds )
+void Time_Delay( unsigned long milliseconds )
+{
+  TimeVirtual_Advance( 1000000ULL * milliseconds );
+}
+
+// Get simulated time in milliseconds
+unsigned long Time_GetExecMilliseconds()
+{
+  return (unsigned long) ( TimeVirtual_GetNanoseconds() / 1000000 );
+}
+
+// Get simulated time in seconds
+double Time_GetExecSeconds()
+{
+  return ( (double) TimeVirtual_GetNanoseconds() ) / 1000000000.0;
+}
@@ -0,0 +1,24 @@
+///////////////////////////////////////////////////////////////////////////////
+///// Simulated clock shared by the virtual time implementation of the    /////
+///// timing module and the NI-XNET stub bus, for faster than real time   /////
+///// deterministic simulations                                           /////
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef TIMING_VIRTUAL_H
+#define TIMING_VIRTUAL_H
+
+#include <stdint.h>
+
+// The clock is advanced by a single thread (the first one doing it), and read by any:
+// advancing it from other threads aborts (see timing_virtual.c)
+
+// Get simulated time in nanoseconds
+uint64_t TimeVirtual_GetNanoseconds( void );
+
+// Move simulated time forward (clock thread only)
+void TimeVirtual_Advance( uint64_t nanoseconds );
+
+// Move simulated time forward up to the given time (never backwards, clock thread only)
+void TimeVirtual_AdvanceTo( uint64_t nanoseconds );
+
+#endif // TIMING_VIRTUAL_H